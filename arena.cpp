@@ -0,0 +1,119 @@
+// Arena Implementation File
+// Each block is obtained with a single allocation, with the
+// block header at its front.  Every object is preceded by a
+// small header linking it to the previous object, so that the
+// objects can be destroyed when the arena is released.
+//
+// The statistics are counted separately by each thread, so that
+// threads allocating at once do not contend for them, and are added
+// to the totals when the thread finishes.  (An arena may be released
+// by a different thread than filled it, so one thread's counts
+// may well be negative.)
+#include <new>
+#include <mutex>
+#include "arena.h"
+#include "exprtree.h"
+
+static Arena::Counts totals;		// from threads that have finished
+static mutex totalsLock;
+thread_local Arena::Counts Arena::counts;
+
+// A thread that has allocated a block enlists, so that
+// its counts are added to the totals when it finishes
+struct Enlisted
+{
+    bool active;
+    ~Enlisted()
+    {
+	lock_guard<mutex> hold( totalsLock );
+	Arena::Counts &counts = Arena::counts;
+	totals.allocations += counts.allocations;
+	totals.live += counts.live;
+	totals.blockCount += counts.blockCount;
+	totals.resident += counts.resident;
+	counts = Arena::Counts();
+    }
+};
+static thread_local Enlisted enlisted;
+
+const size_t FirstBlock = 4096,		// size of an arena's first block
+	     LargestBlock = 1 << 20;	// later blocks double up to this
+
+// Blocks are aligned for any object, as are the objects within
+static size_t align( size_t size )
+{
+    const size_t a = alignof(max_align_t);
+    return (size + a - 1) & ~(a - 1);
+}
+
+//  newBlock
+//  Obtain a block with room for at least the given size
+//  (allocate itself is inline, see arena.h)
+void Arena::newBlock( size_t need )
+{
+    size_t bytes = blocks == NULL ? FirstBlock : 2 * blocks->size;
+    if (bytes > LargestBlock)
+	bytes = LargestBlock;
+    if (bytes < need)
+	bytes = need;
+
+    Block *b = (Block *) ::operator new( align( sizeof(Block) ) + bytes );
+    b->next = blocks;
+    b->size = bytes;
+    blocks = b;
+    avail = (char *) b + align( sizeof(Block) );
+    limit = avail + bytes;
+    counts.blockCount++;
+    counts.resident += bytes;
+    enlisted.active = true;
+}
+
+//  release
+//  Give up one reference to the arena, reclaiming everything
+//  in it when there are no more
+void Arena::release()
+{
+    if (--refs == 0)
+	delete this;
+}
+
+Arena::~Arena()
+{
+    while (objects != NULL)
+    {
+	Object *o = objects;
+	objects = o->next;
+	((ExprNode *) ((char *) o + Header))->~ExprNode();
+	counts.live--;
+    }
+    while (blocks != NULL)
+    {
+	Block *b = blocks;
+	blocks = b->next;
+	counts.blockCount--;
+	counts.resident -= b->size;
+	::operator delete( b );
+    }
+}
+
+//  bytes
+//  The total size of this arena's blocks
+size_t Arena::bytes() const
+{
+    size_t total = 0;
+    for (Block *b = blocks; b != NULL; b = b->next)
+	total += align( sizeof(Block) ) + b->size;
+    return total;
+}
+
+//  report
+//  Display the statistics for all arenas, as far as this thread
+//  and those that have finished can tell
+void Arena::report( ostream &out )
+{
+    lock_guard<mutex> hold( totalsLock );
+    out << totals.allocations + counts.allocations << " nodes allocated, "
+	<< totals.live + counts.live << " still live in "
+	<< totals.blockCount + counts.blockCount << " blocks of "
+	<< totals.resident + counts.resident << " bytes" << endl;
+}
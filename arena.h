@@ -0,0 +1,87 @@
+// Arena Header File
+// Expression tree nodes are not allocated one at a time, but are
+// carved out of large blocks belonging to an arena.  Since all
+// the nodes for one parse share a lifetime, they are released
+// together, simply by releasing the arena.
+//
+// A one-shot expression releases its arena as soon as it has been
+// evaluated.  A function body keeps its arena for as long as some
+// definition refers to it, which is tracked by a reference count;
+// redefining the function releases the old body.
+#ifndef ARENA
+#define ARENA
+
+#include <iostream>
+#include <stddef.h>
+using namespace std;
+
+class Arena
+{
+    private:
+	struct Block			// one large piece of memory
+	{
+	    Block  *next;		// previously allocated block
+	    size_t  size;		// bytes in data[]
+	};
+	struct Object			// precedes each allocation
+	{
+	    Object *next;		// previously allocated object
+	};
+	static const size_t Align = alignof(max_align_t),
+			    Header = (sizeof(Object) + Align - 1) & ~(Align - 1);
+
+	Block	*blocks;		// most recent block first
+	Object	*objects;		// most recent object first
+	char	*avail, *limit;		// unused part of the newest block
+	int	refs;			// number of owners
+
+	~Arena();			// only release() may destroy
+	void newBlock( size_t need );
+
+    public:
+	// Statistics for all arenas, to tell whether memory is reclaimed.
+	// Each thread keeps its own counts (see arena.cpp).
+	struct Counts
+	{
+	    long allocations,		// objects allocated ever
+		 live,			// objects not yet reclaimed
+		 blockCount,		// blocks currently held
+		 resident;		// bytes currently held
+	};
+	static thread_local Counts counts;	// this thread's (see arena.cpp)
+
+	Arena()
+	{
+	    blocks = NULL;
+	    objects = NULL;
+	    avail = limit = NULL;
+	    refs = 1;			// the creator is an owner
+	}
+
+	// allocate
+	// Obtain memory for one object, which will be destroyed
+	// when the arena is (it must be an ExprNode)
+	void *allocate( size_t size )
+	{
+	    size_t need = Header + ((size + Align - 1) & ~(Align - 1));
+	    if ((size_t) (limit - avail) < need)
+		newBlock( need );
+	    Object *o = (Object *) avail;
+	    avail += need;
+	    o->next = objects;
+	    objects = o;
+	    counts.allocations++;
+	    counts.live++;
+	    return (char *) o + Header;
+	}
+	void retain()			// one more owner
+	{
+	    refs++;
+	}
+	void release();			// one less owner
+	size_t bytes() const;		// memory held by this arena
+
+	static void report( ostream &out );
+};
+
+#endif
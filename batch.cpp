@@ -0,0 +1,191 @@
+// Batch Evaluation Implementation File
+// An ordinary file is mapped into memory all at once, privately,
+// so that each newline may be overwritten with the terminator
+// the evaluator expects; no line is ever copied.  Anything that
+// cannot be mapped (a pipe, or standard input) is read a line
+// at a time instead, into a string that grows as needed.
+//
+// With more than one thread, the lines are not evaluated here but
+// handed on to a ParallelBatch (see parallel.h).
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <string.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "batch.h"
+#include "parallel.h"
+
+OutputBuffer::OutputBuffer( int fd, size_t size )
+{
+    this->fd = fd;
+    failed = false;
+    buffer = new char[size];
+    setp( buffer, buffer + size );
+}
+
+OutputBuffer::~OutputBuffer()
+{
+    drain();
+    delete [] buffer;
+}
+
+//  drain
+//  Write out everything collected so far
+bool OutputBuffer::drain()
+{
+    const char *p = pbase();
+    while (!failed && p < pptr())
+    {
+	ssize_t n = ::write( fd, p, pptr() - p );
+	if (n > 0)
+	    p += n;
+	else
+	    failed = true;
+    }
+    setp( buffer, epptr() );
+    return !failed;
+}
+
+//  overflow
+//  The buffer is full:  empty it, then accept one more character
+int OutputBuffer::overflow( int ch )
+{
+    if (!drain())
+	return traits_type::eof();
+    if (ch != traits_type::eof())
+    {
+	*pptr() = ch;
+	pbump( 1 );
+    }
+    return traits_type::not_eof( ch );
+}
+
+int OutputBuffer::sync()
+{
+    return drain() ? 0 : -1;
+}
+
+// What every line of a batch is evaluated with
+struct Batch
+{
+    VarTree	  &vars;
+    FunctionDef	  &funs;
+    EvalMode	   mode;
+    ostream	  &out;
+    Workspace	  &space;
+    ParallelBatch *parallel;		// NULL to evaluate each line at once
+};
+
+//  evaluateLine
+//  Evaluate one line, unless there is nothing on it
+static bool evaluateLine( char *line, size_t length, Batch &b )
+{
+    if (length > 0 && line[length - 1] == '\r')
+	line[--length] = '\0';		// written on another system
+    size_t i = 0;
+    while (i < length && isspace( line[i] ))
+	i++;
+    if (i == length)
+	return false;
+    if (b.parallel != NULL)
+	b.parallel->add( line, length );
+    else
+    {
+	evaluate( line, b.vars, b.funs, b.mode, b.out, b.space );
+	b.out << '\n';
+    }
+    return true;
+}
+
+//  mapped
+//  Evaluate a file that has been mapped into memory
+static long mapped( char *text, size_t size, Batch &b )
+{
+    long count = 0;
+    char *line = text, *end = text + size;
+    while (line < end)
+    {
+	char *eol = (char *) memchr( line, '\n', end - line );
+	if (eol == NULL)
+	{				// no room for a terminator
+	    string last( line, end - line );
+	    count += evaluateLine( &last[0], last.size(), b );
+	    break;
+	}
+	*eol = '\0';
+	count += evaluateLine( line, eol - line, b );
+	line = eol + 1;
+    }
+    return count;
+}
+
+//  streamed
+//  Evaluate input that can only be read in sequence
+static long streamed( istream &in, Batch &b, long &bytes )
+{
+    long count = 0;
+    string line;
+    while (getline( in, line ))
+    {
+	bytes += line.size() + 1;
+	count += evaluateLine( &line[0], line.size(), b );
+    }
+    return count;
+}
+
+bool runBatch( const char path[], VarTree &vars, FunctionDef &funs,
+	       EvalMode mode, ostream &out, BatchStats &stats,
+	       Workspace &space, int threads )
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    stats.expressions = 0;
+    stats.bytes = 0;
+    ParallelBatch *parallel = NULL;
+    if (threads > 1)
+	parallel = new ParallelBatch( threads, vars, funs, mode, out, space );
+    Batch b = { vars, funs, mode, out, space, parallel };
+
+    if (string( path ) == "-")
+	stats.expressions = streamed( cin, b, stats.bytes );
+    else
+    {
+	int fd = open( path, O_RDONLY );
+	if (fd < 0)
+	{
+	    delete parallel;
+	    return false;
+	}
+	struct stat info;
+	void *text = MAP_FAILED;
+	if (fstat( fd, &info ) == 0 && S_ISREG( info.st_mode ) && info.st_size > 0)
+	    text = mmap( NULL, info.st_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE, fd, 0 );
+	if (text != MAP_FAILED)
+	{
+	    madvise( text, info.st_size, MADV_SEQUENTIAL );
+	    stats.bytes = info.st_size;
+	    stats.expressions = mapped( (char *) text, info.st_size, b );
+	    munmap( text, info.st_size );
+	}
+	else
+	{
+	    ifstream in( path );
+	    stats.expressions = streamed( in, b, stats.bytes );
+	}
+	close( fd );
+    }
+
+    if (parallel != NULL)
+    {
+	parallel->finish();
+	delete parallel;
+    }
+    out.flush();
+    stats.seconds = chrono::duration<double>( chrono::steady_clock::now()
+					      - start ).count();
+    return true;
+}
@@ -0,0 +1,61 @@
+// Batch Evaluation Header File
+// Besides the interactive prompt, a whole file of expressions
+// may be evaluated at once, one expression per line.  Lines may
+// be of any length.  Each result is written on its own line,
+// through a large output buffer that is only flushed when full,
+// rather than after every single result.  The lines may also be
+// shared out among several threads (see parallel.h).
+#ifndef BATCH
+#define BATCH
+
+#include <iostream>
+#include <streambuf>
+#include "evaluate.h"
+using namespace std;
+
+// OutputBuffer
+// A stream buffer writing directly to a file descriptor,
+// collecting output until a large block of it is ready
+class OutputBuffer : public streambuf
+{
+    private:
+	int   fd;		// where the output goes
+	char *buffer;		// output not yet written
+	bool  failed;		// a write has failed
+
+	bool drain();
+    protected:
+	int overflow( int ch );
+	int sync();
+    public:
+	OutputBuffer( int fd, size_t size = 1 << 20 );
+	OutputBuffer( const OutputBuffer & ) = delete;
+	~OutputBuffer();
+};
+
+// BatchStats
+// What was accomplished by one batch run
+struct BatchStats
+{
+    long   expressions;	// lines evaluated
+    long   bytes;		// size of the input
+    double seconds;		// time spent evaluating
+};
+
+// runBatch
+// Evaluate every non-blank line of a file, in order
+// Parameters:
+//	path	(input string)		file to read ("-" for standard input)
+//	vars	(modified VarTree)	variables to work with
+//	funs	(modified FunctionDef)	functions to define or call
+//	mode	(input EvalMode)	which engine to evaluate with
+//	out	(output stream)		where the results are written
+//	stats	(output BatchStats)	counts and timing
+//	space	(modified Workspace)	to evaluate in
+//	threads	(input int)		number of threads to evaluate with
+// Returns false if the file could not be read
+bool runBatch( const char path[], VarTree &vars, FunctionDef &funs,
+	       EvalMode mode, ostream &out, BatchStats &stats,
+	       Workspace &space, int threads = 1 );
+
+#endif
@@ -0,0 +1,415 @@
+// Benchmark Program
+// Measures the three phases of evaluating an expression separately:
+// -- tokenizing, which constructs its TokenList,
+// -- parsing, which builds, simplifies and resolves its tree
+//    (see parseExpression in evaluate.h),
+// -- and evaluating, which walks the tree (or, with -vm, executes
+//    the bytecode it was compiled to, the compiling being timed as
+//    a phase of its own).
+//
+// The workloads are calls to the functions every session begins with,
+// and randomly generated expressions, nested deeply or spread widely.
+// A call to a built-in function (see builtins.h) is timed once more
+// calling the definition it replaced, interpreted, for comparison.
+// Then a few formulas are evaluated over columns of random rows, both
+// walking the tree once per row and by columns (see columns.h).
+// Every phase of every workload is timed once per iteration, and the
+// times are summarized as percentiles, in nanoseconds, written to
+// the standard output as JSON so that two runs may be compared.
+//
+// The results of function calls are forgotten before each iteration,
+// so that every evaluation actually computes them.
+//
+// This is a program of its own, built from every file but driver.cpp,
+// loadgen.cpp, stress.cpp and tests.cpp:
+//	g++ -std=c++17 -O2 -o benchmark benchmark.cpp <the rest> -pthread
+// Options:
+//	-iterations n	times to repeat each workload (default 1000)
+//	-depth d	nesting of the deep expression (default 64)
+//	-width w	terms in the wide expression (default 256)
+//	-seed s		for generating the expressions (default 1)
+//	-rows r		rows the formulas are evaluated over (default 10000)
+//	-vm		evaluate with the bytecode machine
+//	-jit n		as for the interpreter (see jit.h)
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+#include "evaluate.h"
+#include "tokenlist.h"
+#include "exprtree.h"
+#include "bytecode.h"
+#include "arena.h"
+#include "memo.h"
+#include "jit.h"
+#include "builtins.h"
+#include "columns.h"
+using namespace std;
+
+// The functions every session begins with, besides those built in
+// (as in driver.cpp)
+static const char *builtins[] =
+{
+    "deffn mod(a,b) = a % b",
+    "deffn cube(x) = x * x * x",
+    "deffn sum3(x,y,z) = x + y + z",
+    "deffn avg5(x,y,z,a,b) = (x + y + z + a + b)/5",
+    "deffn odd(x) = x%2?1:0",
+    "deffn even(x) = x%2?0:1",
+    "deffn neg(x) = -x"
+};
+
+// The variables the generated expressions refer to
+static const char *variables[] = { "x = 7", "y = -3", "z = 12" };
+
+// Formulas evaluated over columns a and b:  arithmetic alone, a
+// conditional, and a call whose result does not fit in an int in some
+// rows (which are then walked singly)
+static const char *columnFormulas[] =
+{
+    "a * b - 3 * a + b % 7",
+    "a > b ? a - b : cube(b % 100) + 1",
+    "a % 16 < 8 ? mod(a, 9) : fact(a % 16)"
+};
+
+struct Workload
+{
+    string name;
+    string expr;
+    bool   builtin;		// also timed as interpreted
+};
+
+// Timings of one phase, in nanoseconds
+struct Samples
+{
+    vector<long> times;
+
+    void add( chrono::steady_clock::time_point from,
+	      chrono::steady_clock::time_point to )
+    {
+	times.push_back( chrono::duration_cast<chrono::nanoseconds>( to - from ).count() );
+    }
+};
+
+// Generator
+// Builds random expressions whose evaluation cannot fail:
+// nothing is divided, and remainders are only taken by constants
+class Generator
+{
+    private:
+	mt19937 random;
+
+	int below( int n )
+	{
+	    return uniform_int_distribution<int>( 0, n - 1 )( random );
+	}
+	string leaf()
+	{
+	    static const char *names[] = { "x", "y", "z" };
+	    if (below( 2 ) == 0)
+		return names[below( 3 )];
+	    return to_string( 1 + below( 9 ) );
+	}
+	string oper()
+	{
+	    static const char *opers[] = { " + ", " - ", " * ", " + ", " - " };
+	    return opers[below( 5 )];
+	}
+    public:
+	Generator( unsigned seed ) : random( seed )
+	{
+	}
+
+	// deep
+	// An expression nested to the given depth
+	string deep( int depth )
+	{
+	    if (depth == 0)
+		return leaf();
+	    switch (below( 4 ))
+	    {
+	    case 0:
+		return "(" + deep( depth - 1 ) + oper() + leaf() + ")";
+	    case 1:
+		return "(" + leaf() + oper() + deep( depth - 1 ) + ")";
+	    case 2:
+		return "(" + deep( depth - 1 ) + " % " + to_string( 2 + below( 97 ) ) + ")";
+	    default:
+		return "(" + leaf() + " < " + leaf() + " ? " + deep( depth - 1 ) +
+		       " : " + leaf() + ")";
+	    }
+	}
+
+	// wide
+	// A long sum of small terms
+	string wide( int width )
+	{
+	    string expr = leaf() + " * " + leaf();
+	    for (int i = 1; i < width; i++)
+		if (below( 4 ) == 0)
+		    expr += oper() + "sqr(" + leaf() + ")";
+		else
+		    expr += oper() + leaf() + " * " + leaf();
+	    return expr;
+	}
+};
+
+//  forgetResults
+//  Empty the cache of every function, so that calls are evaluated again
+static void forgetResults( FunctionDef &funs )
+{
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+	if (f->second.memo != NULL)
+	    f->second.memo->clear();
+}
+
+//  writeSummary
+//  One phase's timings as a JSON object
+static void writeSummary( ostream &out, const char name[], Samples &s )
+{
+    vector<long> &t = s.times;
+    sort( t.begin(), t.end() );
+    double total = 0;
+    for (size_t i = 0; i < t.size(); i++)
+	total += t[i];
+    auto rank = [&]( double p )
+    {
+	size_t i = (size_t) (p * t.size());
+	return t[i < t.size() ? i : t.size() - 1];
+    };
+    out << "\"" << name << "\": { \"min\": " << t.front()
+	<< ", \"mean\": " << (long) (total / t.size())
+	<< ", \"p50\": " << rank( 0.50 )
+	<< ", \"p90\": " << rank( 0.90 )
+	<< ", \"p99\": " << rank( 0.99 )
+	<< ", \"max\": " << t.back() << " }";
+}
+
+//  run
+//  Time every phase of one workload, and write its results
+static void run( const Workload &w, int iterations, EvalMode mode,
+		 VarTree &vars, FunctionDef &funs, ostream &out )
+{
+    Samples tokenize, parse, compile, evaluate;
+    CallStack calls;
+    Integer result;
+    string value;
+    int tokens = 0, nodes = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+	forgetResults( funs );
+	Arena *arena = new Arena();
+
+	auto t0 = chrono::steady_clock::now();
+	TokenList list( w.expr.c_str() );
+	auto t1 = chrono::steady_clock::now();
+	ExprNode *root = parseExpression( list, vars, funs, *arena );
+	auto t2 = chrono::steady_clock::now();
+	if (root == NULL)
+	{
+	    cerr << w.name << " is nested more than " << MaxDepth
+		 << " deep (see evaluate.h)" << endl;
+	    exit( 1 );
+	}
+	tokenize.add( t0, t1 );
+	parse.add( t1, t2 );
+
+	if (mode == MACHINE)
+	{
+	    Program prog;
+	    auto t3 = chrono::steady_clock::now();
+	    root->compile( prog );
+	    prog.emit( RETURN );
+	    auto t4 = chrono::steady_clock::now();
+	    result = execute( prog, vars, funs );
+	    auto t5 = chrono::steady_clock::now();
+	    compile.add( t3, t4 );
+	    evaluate.add( t4, t5 );
+	}
+	else
+	{
+	    auto t3 = chrono::steady_clock::now();
+	    result = root->evaluate( vars.slots(), calls );
+	    auto t4 = chrono::steady_clock::now();
+	    evaluate.add( t3, t4 );
+	}
+	tokens = list.end() - list.begin();
+	nodes = root->nodeCount();
+	value = result.toString();
+	arena->release();
+	Integer::releaseTemporaries();
+    }
+
+    out << "    { \"name\": \"" << w.name << "\", \"length\": " << w.expr.size()
+	<< ", \"tokens\": " << tokens << ", \"nodes\": " << nodes
+	<< ", \"result\": " << value << ",\n      ";
+    writeSummary( out, "tokenize", tokenize );
+    out << ",\n      ";
+    writeSummary( out, "parse", parse );
+    if (mode == MACHINE)
+    {
+	out << ",\n      ";
+	writeSummary( out, "compile", compile );
+    }
+    out << ",\n      ";
+    writeSummary( out, "evaluate", evaluate );
+    out << " }";
+}
+
+//  runColumns
+//  Time one formula over every row, first walking its tree once per
+//  row and then evaluating it by columns, and write the results
+static void runColumns( const char formula[], const vector<int> &a,
+			const vector<int> &b, int iterations, VarTree &vars,
+			FunctionDef &funs, ostream &out )
+{
+    Samples rowwise, columnar;
+    int rows = a.size();
+    CallStack calls;
+    Arena *arena = new Arena();
+    ExprNode *root = parseExpression( formula, vars, funs, *arena );
+    ColumnExpr columns( formula, vars, funs );
+    columns.bind( "a", a.data() );
+    columns.bind( "b", b.data() );
+    vector<Integer> frame( vars.slots(), vars.slots() + vars.size() );
+    vector<Integer> results( rows );
+    int slotA = vars.find( "a" ), slotB = vars.find( "b" );
+    vector<string> expected;		// what walking each row gave
+    long differed = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+	forgetResults( funs );
+	auto t0 = chrono::steady_clock::now();
+	for (int r = 0; r < rows; r++)
+	{
+	    frame[slotA] = Integer( a[r] );
+	    frame[slotB] = Integer( b[r] );
+	    results[r] = root->evaluate( frame.data(), calls );
+	}
+	auto t1 = chrono::steady_clock::now();
+	rowwise.add( t0, t1 );
+	if (i == 0)
+	    for (int r = 0; r < rows; r++)
+		expected.push_back( results[r].toString() );
+	Integer::releaseTemporaries();
+
+	forgetResults( funs );
+	auto t2 = chrono::steady_clock::now();
+	columns.run( rows, results.data() );
+	auto t3 = chrono::steady_clock::now();
+	columnar.add( t2, t3 );
+	if (i == 0)
+	    for (int r = 0; r < rows; r++)
+		differed += results[r].toString() != expected[r];
+	Integer::releaseTemporaries();
+    }
+    arena->release();
+
+    out << "    { \"formula\": \"" << formula << "\", \"rows\": " << rows
+	<< ", \"fallbacks\": " << columns.fallbacks / iterations
+	<< ", \"differed\": " << differed << ",\n      ";
+    writeSummary( out, "by_row", rowwise );
+    out << ",\n      ";
+    writeSummary( out, "by_column", columnar );
+    out << " }";
+}
+
+int main( int argc, char *argv[] )
+{
+    int iterations = 1000, depth = 64, width = 256, rows = 10000;
+    unsigned seed = 1;
+    EvalMode mode = TREE;
+    for (int i = 1; i < argc; i++)
+    {
+	string arg = argv[i];
+	if (arg == "-vm")
+	    mode = MACHINE;
+	else if (i + 1 < argc && arg == "-iterations")
+	    iterations = atoi( argv[++i] );
+	else if (i + 1 < argc && arg == "-depth")
+	    depth = atoi( argv[++i] );
+	else if (i + 1 < argc && arg == "-width")
+	    width = atoi( argv[++i] );
+	else if (i + 1 < argc && arg == "-rows")
+	    rows = atoi( argv[++i] );
+	else if (i + 1 < argc && arg == "-seed")
+	    seed = atol( argv[++i] );
+	else if (i + 1 < argc && arg == "-jit")
+	    nativeThreshold = atol( argv[++i] );
+	else
+	{
+	    cerr << "usage: " << argv[0] << " [-iterations n] [-depth d]"
+		 << " [-width w] [-seed s] [-rows r] [-vm] [-jit n]" << endl;
+	    return 1;
+	}
+    }
+    if (iterations < 1)
+	iterations = 1;
+    if (rows < 1)
+	rows = 1;
+
+    VarTree vars;
+    FunctionDef funs, interpreted;	// (the latter with nothing built in)
+    ostream quiet( NULL );
+    Workspace space;
+    defineBuiltins( funs );
+    for (const char *b : builtins)
+	evaluate( b, vars, funs, mode, quiet, space );
+    for (const BuiltinFunction &b : builtinFunctions())
+	evaluate( b.definition, vars, interpreted, mode, quiet, space );
+    for (const char *v : variables)
+	evaluate( v, vars, funs, mode, quiet, space );
+
+    Generator generate( seed );
+    vector<Workload> workloads =
+    {
+	{ "fib", "fib(20)", true },
+	{ "fact", "fact(12)", true },
+	{ "pow", "pow(3, 19)", true },
+	{ "gcf", "gcf(832040, 514229)", true },
+	{ "lcm", "lcm(1234, 5678)", true },
+	{ "abs", "abs(-12345)", true },
+	{ "sqr", "sqr(99991)", true },
+	{ "deep", generate.deep( depth ), false },
+	{ "wide", generate.wide( width ), false }
+    };
+
+    cout << "{ \"engine\": \"" << (mode == MACHINE ? "machine" : "tree")
+	 << "\", \"unit\": \"ns\", \"iterations\": " << iterations
+	 << ", \"depth\": " << depth << ", \"width\": " << width
+	 << ", \"rows\": " << rows << ", \"seed\": " << seed
+	 << ",\n  \"workloads\": [\n";
+    for (size_t i = 0; i < workloads.size(); i++)
+    {
+	run( workloads[i], iterations, mode, vars, funs, cout );
+	if (workloads[i].builtin)
+	{
+	    Workload w = { workloads[i].name + " (interpreted)", workloads[i].expr, false };
+	    cout << ",\n";
+	    run( w, iterations, mode, vars, interpreted, cout );
+	}
+	cout << (i + 1 < workloads.size() ? ",\n" : "\n");
+    }
+
+    // (the columns are evaluated by columns whatever the engine)
+    mt19937 random( seed );
+    uniform_int_distribution<int> range( -1000, 1000 );
+    vector<int> a( rows ), b( rows );
+    for (int r = 0; r < rows; r++)
+    {
+	a[r] = range( random );
+	b[r] = range( random );
+    }
+    cout << "  ],\n  \"columns\": [\n";
+    int count = sizeof columnFormulas / sizeof columnFormulas[0];
+    for (int i = 0; i < count; i++)
+    {
+	runColumns( columnFormulas[i], a, b, iterations, vars, funs, cout );
+	cout << (i + 1 < count ? ",\n" : "\n");
+    }
+    cout << "  ] }" << endl;
+    return 0;
+}
@@ -0,0 +1,199 @@
+// Built-in Function Implementation File
+// Each function takes its arguments already evaluated, one for each
+// parameter, and returns its result as arithmetic on Integers would
+// (so that a large result is a temporary, like any other).
+//
+// Where a definition would never return -- pow with a negative
+// exponent recursing without end -- the built-in function gives
+// what integer division would, 1 / pow(a,-b), instead.
+#include <algorithm>
+#include <limits.h>
+#include "builtins.h"
+
+//  bits
+//  The magnitude of a value, and its highest bit that is set
+//  Returns:	the number of bits below and including it (0 if none)
+static long bits( Integer i, vector<uint32_t> &limbs )
+{
+    i.magnitude( limbs );
+    if (limbs.empty())
+	return 0;
+    return 32 * (long) limbs.size() - __builtin_clz( limbs.back() );
+}
+
+static inline bool bit( const vector<uint32_t> &limbs, long n )
+{
+    return (limbs[n / 32] >> (n % 32)) & 1;
+}
+
+//  gcf
+//  Two non-negative values small enough for a word have their
+//  common factor found by the binary algorithm, which only shifts
+//  and subtracts.  Any others take the definition's way, whose
+//  result takes its sign from the remainders along the way (and
+//  which divides by zero just as the definition would).
+static Integer gcf( const Integer args[] )
+{
+    Integer a = args[0], b = args[1];
+    if (a.isSmall() && b.isSmall() && a.small() >= 0 && b.small() > 0)
+    {
+	unsigned long x = a.small(), y = b.small();
+	if (x == 0)
+	    return b;
+	int shift = __builtin_ctzl( x | y );
+	x >>= __builtin_ctzl( x );
+	do
+	{
+	    y >>= __builtin_ctzl( y );
+	    if (x > y)
+		swap( x, y );
+	    y -= x;
+	} while (y != 0);
+	return Integer( (long) (x << shift) );
+    }
+    for (;;)
+    {
+	Integer rem = a % b;
+	if (rem.isZero())
+	    return b;
+	a = b;
+	b = rem;
+    }
+}
+
+//  lcm
+//  Dividing first keeps the product small, and is exact, since the
+//  common factor divides a
+static Integer lcm( const Integer args[] )
+{
+    return args[0] / gcf( args ) * args[1];
+}
+
+static Integer square( const Integer args[] )
+{
+    return args[0] * args[0];
+}
+
+static Integer absolute( const Integer args[] )
+{
+    return args[0] > Integer( 0 ) ? args[0] : Integer( 0 ) - args[0];
+}
+
+//  factorial
+//  Factors are multiplied together in a word for as long as they fit,
+//  so that a large product is multiplied only once for several
+static Integer factorial( const Integer args[] )
+{
+    Integer n = args[0], product = 1;
+    if (n <= Integer( 1 ))
+	return 1;
+    long last = n.isSmall() ? n.small() : LONG_MAX - 1,	// (never reached)
+	 run = 1, more;
+    for (long i = 2; i <= last; i++)
+	if (!__builtin_mul_overflow( run, i, &more ))
+	    run = more;
+	else
+	{
+	    product = product * Integer( run );
+	    run = i;
+	}
+    return product * Integer( run );
+}
+
+//  power
+//  Squaring for each bit of the exponent, from the highest
+static Integer power( const Integer args[] )
+{
+    Integer a = args[0], b = args[1], result = 1;
+    vector<uint32_t> limbs;
+    bool negative = b < Integer( 0 );
+    for (long n = bits( b, limbs ) - 1; n >= 0; n--)
+    {
+	result = result * result;
+	if (bit( limbs, n ))
+	    result = result * a;
+    }
+    return negative ? Integer( 1 ) / result : result;
+}
+
+//  fibonacci
+//  By doubling:  for each bit of n, from the highest, fib(k) and
+//  fib(k+1) become
+//	fib(2k)   = fib(k) * (2 fib(k+1) - fib(k))
+//	fib(2k+1) = fib(k)^2 + fib(k+1)^2
+//  and then move one step further if the bit is set
+static Integer fibonacci( const Integer args[] )
+{
+    Integer n = args[0];
+    if (n < Integer( 2 ))
+	return n;
+    Integer f = 0, next = 1;		// fib(k) and fib(k+1), k = 0
+    vector<uint32_t> limbs;
+    for (long i = bits( n, limbs ) - 1; i >= 0; i--)
+    {
+	Integer even = f * (next + next - f),
+		odd = f * f + next * next;
+	if (bit( limbs, i ))
+	{
+	    f = odd;
+	    next = even + odd;
+	}
+	else
+	{
+	    f = even;
+	    next = odd;
+	}
+    }
+    return f;
+}
+
+static const vector<BuiltinFunction> functions =
+{
+    { "gcf", { "a", "b" }, gcf, "deffn gcf(a,b) = (rem = a%b) == 0?b:gcf(b,rem)" },
+    { "lcm", { "a", "b" }, lcm, "deffn lcm(a,b) = a*b/gcf(a,b)" },
+    { "sqr", { "s" }, square, "deffn sqr(s) = s*s" },
+    { "abs", { "x" }, absolute, "deffn abs(x) = x > 0 ? x : -x" },
+    { "fact", { "n" }, factorial, "deffn fact(n) = n <= 1 ? 1 : n * fact(n-1)" },
+    { "pow", { "a", "b" }, power, "deffn pow(a,b)= b==0?1:a*pow(a,b-1)" },
+    { "fib", { "n" }, fibonacci, "deffn fib(n) = n <2?n:fib(n-1)+fib(n-2)" }
+};
+
+const vector<BuiltinFunction> &builtinFunctions()
+{
+    return functions;
+}
+
+void defineBuiltins( FunctionDef &funs )
+{
+    for (const BuiltinFunction &b : functions)
+    {
+	FunDef f;
+	f.name = b.name;
+	for (int i = 0; i < 2 && b.parameter[i] != NULL; i++)
+	    f.parameter[i] = b.parameter[i];
+	f.locals = NULL;		// (nothing is evaluated)
+	f.functionBody = f.parsedBody = NULL;
+	f.arena = NULL;
+	f.code = NULL;
+	f.pure = true;
+	f.memo = NULL;			// (never worth caching)
+	f.number = funs.size();
+	f.native = NULL;
+	f.calls = -1;			// (it is never translated)
+	f.stored = NULL;
+	f.builtin = &b;
+	funs[f.name] = f;
+    }
+}
+
+string signature( const FunDef &f )
+{
+    string print = f.name + "(";
+    for (int i = 0; i < 10 && f.parameter[i] != ""; i++)
+    {
+	if (i != 0)
+	    print += ",";
+	print += f.parameter[i];
+    }
+    return print + ")";
+}
@@ -0,0 +1,48 @@
+// Built-in Function Header File
+// The standard functions every session begins with are computed in
+// C++ rather than interpreted:  pow by repeated squaring rather than
+// by b nested calls, fib by doubling rather than by the two calls that
+// make the definition take exponential time (without its cache), gcf
+// by the binary algorithm, and fact in a loop.  Each gives the same
+// results the definition it replaces would have (see definition
+// below), and is pure.
+//
+// They are entered in the function table before anything else, so
+// every engine finds them exactly as it finds any other function,
+// and a definition of the same name cannot take their place unless
+// it says so:
+//	deffn shadow gcf(a,b) = ...
+// after which that name is an ordinary function like any other.
+// (Each built-in function computes everything itself, so lcm is
+// unchanged by replacing gcf.)
+#ifndef BUILTINS
+#define BUILTINS
+
+#include <string>
+#include <vector>
+#include "funmap.h"
+#include "integer.h"
+using namespace std;
+
+struct BuiltinFunction
+{
+    const char *name;
+    const char *parameter[2];		// (only as many as it takes)
+    Integer   (*compute)( const Integer args[] );
+    const char *definition;		// what it computes, as interpreted
+};
+
+// builtinFunctions
+// Every function that is built in
+const vector<BuiltinFunction> &builtinFunctions();
+
+// defineBuiltins
+// Enter every built-in function in a function table (one that holds
+// no definitions of the same names yet)
+void defineBuiltins( FunctionDef &funs );
+
+// signature
+// A function's name and parameters, as they are defined
+string signature( const FunDef &f );
+
+#endif
@@ -0,0 +1,206 @@
+// Bytecode Implementation File
+// Assembles programs for the stack machine and runs them.
+// The machine keeps its own value stack and call stack,
+// so that recursive functions do not consume the native stack.
+#include "bytecode.h"
+#include "memo.h"
+#include "snapshot.h"
+#include "builtins.h"
+
+Program::~Program()
+{
+    for (unsigned i = 0; i < constants.size(); i++)
+	constants[i].discard();
+}
+
+//  emit
+//  Append one instruction to the program
+//  Returns:		the position of the new instruction
+int Program::emit( OpCode op, int arg, int count )
+{
+    Instruction in;
+    in.op = op;
+    in.count = count;
+    in.arg = arg;
+    code.push_back( in );
+    return code.size() - 1;
+}
+
+//  addName
+//  Find the index of a name in the name table, adding it if needed
+int Program::addName( string name )
+{
+    for (unsigned i = 0; i < names.size(); i++)
+	if (names[i] == name)
+	    return i;
+    names.push_back( name );
+    return names.size() - 1;
+}
+
+//  addConstant
+//  Add a large value to the constant table, keeping a copy
+int Program::addConstant( Integer value )
+{
+    constants.push_back( value.keep() );
+    return constants.size() - 1;
+}
+
+// A suspended caller, waiting for a function to return
+struct Frame
+{
+    const Program	*prog;		// caller's code
+    const Instruction	*pc;		// where to resume
+    FunDef		*callee;	// function to record result for
+    int			count;		// and its arguments
+    Integer		args[10];
+    int			base;		// where its variables begin
+};
+
+// A call that is answered without running the function
+// must still return, if it replaced the current call
+static const Instruction returnNow = { RETURN, 0, 0 };
+
+Integer execute( const Program &prog, VarTree &vars, FunctionDef &funs )
+{
+    vector<Integer> stack;		// operand stack
+    vector<Frame> frames;		// suspended callers
+    vector<Integer> locals;		// variables of active calls
+    const Program *p = &prog;
+    const Instruction *pc = &p->code[0];
+    Integer *v = vars.slots();
+    Integer right;
+
+    for (;;)
+    {
+	const Instruction &in = *pc++;
+	switch (in.op)
+	{
+	case PUSH:
+	    stack.push_back( in.arg );
+	    break;
+	case CONST:
+	    stack.push_back( p->constants[in.arg] );
+	    break;
+	case LOAD:
+	    stack.push_back( v[in.arg] );
+	    break;
+	case STORE:
+	    v[in.arg] = stack.back();
+	    break;
+	case ADD:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = stack.back() + right;
+	    break;
+	case SUB:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = stack.back() - right;
+	    break;
+	case MUL:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = stack.back() * right;
+	    break;
+	case DIV:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = stack.back() / right;
+	    break;
+	case MOD:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = stack.back() % right;
+	    break;
+	case LE:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = Integer( stack.back() <= right );
+	    break;
+	case GE:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = Integer( stack.back() >= right );
+	    break;
+	case LT:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = Integer( stack.back() < right );
+	    break;
+	case GT:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = Integer( stack.back() > right );
+	    break;
+	case EQ:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = Integer( stack.back() == right );
+	    break;
+	case NE:
+	    right = stack.back();  stack.pop_back();
+	    stack.back() = Integer( stack.back() != right );
+	    break;
+	case JUMPF:
+	    right = stack.back();  stack.pop_back();
+	    if (right.isZero())
+		pc = &p->code[in.arg];
+	    break;
+	case JUMP:
+	    pc = &p->code[in.arg];
+	    break;
+	case CALL:
+	case TAILCALL:
+	{
+	    FunctionDef::iterator found = funs.find( p->names[in.arg] );
+	    Integer *args = &stack[stack.size() - in.count];
+	    if (found != funs.end())
+		decoded( found->second );	// (if loaded, and not called before)
+	    if (found == funs.end() ||
+		(found->second.code == NULL && found->second.builtin == NULL))
+	    {
+		stack.resize( stack.size() - in.count );	// unknown function
+		stack.push_back( Integer() );
+		if (in.op == TAILCALL)
+		    pc = &returnNow;
+		break;
+	    }
+	    FunDef *f = &found->second;
+	    Frame call = { p, pc, NULL, 0, {}, (int) locals.size() };
+	    for ( ; call.count < 10 && f->parameter[call.count] != ""; call.count++)
+		call.args[call.count] = call.count < in.count ? args[call.count] : Integer();
+	    stack.resize( stack.size() - in.count );
+	    if (f->builtin != NULL)
+	    {
+		stack.push_back( f->builtin->compute( call.args ) );
+		if (in.op == TAILCALL)
+		    pc = &returnNow;
+		break;
+	    }
+	    if (f->pure && memoFor( f )->find( call.args, call.count, right ))
+	    {
+		stack.push_back( right );
+		if (in.op == TAILCALL)
+		    pc = &returnNow;
+		break;
+	    }
+	    if (in.op == CALL)
+	    {
+		if (f->pure)
+		    call.callee = f;
+		frames.push_back( call );
+	    }
+	    locals.resize( frames.back().base );	// reuse for a tail call
+	    locals.resize( frames.back().base + f->locals->size() );
+	    v = locals.data() + frames.back().base;
+	    for (int i = 0; i < call.count; i++)
+		v[i] = call.args[i];		// parameters come first
+	    p = f->code;
+	    pc = &p->code[0];
+	    break;
+	}
+	case RETURN:
+	    if (frames.empty())
+		return stack.back();
+	    if (frames.back().callee != NULL)
+		memoFor( frames.back().callee )->insert( frames.back().args,
+			frames.back().count, stack.back() );
+	    p = frames.back().prog;		// result stays on the stack
+	    pc = frames.back().pc;
+	    locals.resize( frames.back().base );
+	    frames.pop_back();
+	    v = frames.empty() ? vars.slots() : locals.data() + frames.back().base;
+	    break;
+	}
+    }
+}
@@ -0,0 +1,78 @@
+// Bytecode Header File
+// An alternative to walking the expression tree:  a parsed tree
+// may be lowered into a linear sequence of simple instructions,
+// which are then run by a small stack machine.  Each instruction
+// either pushes a value, pops its operands and pushes a result,
+// or transfers control.
+//
+// Function bodies are compiled once when they are defined,
+// and one-shot expressions are compiled just before they are run.
+#ifndef BYTECODE
+#define BYTECODE
+
+#include <vector>
+#include <string>
+#include "vartree.h"
+#include "funmap.h"
+#include "integer.h"
+using namespace std;
+
+// The instruction set of the stack machine
+enum OpCode
+{
+    PUSH,		// push the constant arg
+    CONST,		// push constants[arg] (one too large for arg)
+    LOAD,		// push the variable in slot arg
+    STORE,		// assign top of stack to slot arg (leaves it there)
+    ADD, SUB, MUL, DIV, MOD,			// arithmetic
+    LE, GE, LT, GT, EQ, NE,			// comparison
+    JUMPF,		// pop, and go to arg if it was zero
+    JUMP,		// go to arg
+    CALL,		// call function names[arg] with count arguments
+    TAILCALL,		// the same, replacing the current call
+    RETURN		// return top of stack to the caller
+};
+
+struct Instruction
+{
+    unsigned char op;		// what to do (an OpCode)
+    unsigned char count;	// argument count for CALL
+    int		  arg;		// constant, name index, or jump target
+};
+
+class Program
+{
+    public:
+	vector<Instruction> code;	// the instructions themselves
+	vector<string>	names;		// functions referred to
+	vector<Integer> constants;	// large values (kept)
+
+	Program()
+	{
+	}
+	Program( const Program & ) = delete;
+	~Program();
+
+	int  emit( OpCode op, int arg = 0, int count = 0 );
+	int  addName( string name );
+	int  addConstant( Integer value );
+	void patch( int at, int target )	// fill in a forward jump
+	{
+	    code[at].arg = target;
+	}
+	int  size() const
+	{
+	    return code.size();
+	}
+};
+
+// Execute
+// Run a compiled program to completion
+// Parameters:
+//	prog	(input Program)		code to run (must end with RETURN)
+//	vars	(modified VarTree)	variables the program was resolved in
+//	funs	(input FunctionDef)	functions that may be called
+// Returns:				the value left on the stack
+Integer execute( const Program &prog, VarTree &vars, FunctionDef &funs );
+
+#endif
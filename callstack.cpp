@@ -0,0 +1,68 @@
+// Call Stack Implementation File
+// Only the rare operations live here:  creating the stack,
+// moving on to another chunk when one fills up, and clearing it.
+#include <new>
+#include "callstack.h"
+
+const int FirstChunk = 1 << 16;		// integers in the first chunk
+
+CallStack::CallStack()
+{
+    current = NULL;
+    top = limit = NULL;
+    nextChunk( FirstChunk );
+}
+
+CallStack::~CallStack()
+{
+    while (current->prev != NULL)
+	current = current->prev;
+    while (current != NULL)
+    {
+	Chunk *c = current;
+	current = c->next;
+	::operator delete( c );
+    }
+}
+
+void CallStack::clear()
+{
+    while (current->prev != NULL)
+	current = current->prev;
+    top = current->data;
+    limit = current->data + current->size;
+}
+
+//  nextChunk
+//  Move on to a chunk with room for a frame of the given size,
+//  reusing the next one if it is big enough
+void CallStack::nextChunk( int size )
+{
+    Chunk *c = current != NULL ? current->next : NULL;
+    if (c != NULL && c->size < size)
+    {
+	current->next = NULL;		// too small:  discard the rest
+	while (c != NULL)
+	{
+	    Chunk *n = c->next;
+	    ::operator delete( c );
+	    c = n;
+	}
+    }
+    if (c == NULL)
+    {
+	int ints = current == NULL ? size : 2 * current->size;
+	if (ints < size)
+	    ints = size;
+	c = (Chunk *) ::operator new( sizeof(Chunk) + ints * sizeof(Integer) );
+	c->size = ints;
+	c->prev = current;
+	c->next = NULL;
+	if (current != NULL)
+	    current->next = c;
+    }
+    c->below = top;
+    current = c;
+    top = c->data;
+    limit = c->data + c->size;
+}
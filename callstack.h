@@ -0,0 +1,67 @@
+// Call Stack Header File
+// The variables for each function call are kept in a frame:
+// a fixed-size array of Integers, with the parameters first and
+// then the local variables, sized from the function's locals.
+// Frames are pushed and popped in strict order, so they are simply
+// carved off the top of a large contiguous region.
+//
+// Memory is only requested when the stack grows deeper than ever
+// before; the region is kept in chunks that are never moved, so
+// a frame stays where it is for as long as the call is active.
+#ifndef CALLSTACK
+#define CALLSTACK
+
+#include <stddef.h>
+#include "integer.h"
+
+class CallStack
+{
+    private:
+	struct Chunk
+	{
+	    Chunk *prev, *next;		// neighboring chunks
+	    Integer *below;		// top of prev when this was entered
+	    int    size;		// number of Integers in data
+	    Integer data[1];		// (actually size of them)
+	};
+	Chunk *current;			// chunk holding the top frame
+	Integer *top, *limit;		// free space within current
+
+	void nextChunk( int size );
+    public:
+	CallStack();
+	~CallStack();
+
+	// push
+	// Obtain a new frame, with all variables initially 0
+	Integer *push( int size )
+	{
+	    if (limit - top < size)
+		nextChunk( size );
+	    Integer *frame = top;
+	    top += size;
+	    for (int i = 0; i < size; i++)
+		frame[i] = Integer();
+	    return frame;
+	}
+
+	// pop
+	// Discard the most recent frame
+	void pop( Integer *frame )
+	{
+	    if (frame == current->data && current->prev != NULL)
+	    {
+		top = current->below;	// back to the previous chunk
+		current = current->prev;
+		limit = current->data + current->size;
+	    }
+	    else
+		top = frame;
+	}
+
+	// clear
+	// Discard every frame at once (when an evaluation is abandoned)
+	void clear();
+};
+
+#endif
@@ -0,0 +1,412 @@
+// Columnar Evaluation Implementation File
+// The loops over a block of rows are kept free of branches and of
+// anything that could fail, so that the compiler may vectorize them.
+// Sums, differences and products are computed in 64 bits, and a
+// selected row whose result does not fit in an int is marked to be
+// evaluated again; one that overflows in a case that is not selected
+// cannot upset the rest.  A division that would fail is done with
+// a divisor of 1 instead, and its row likewise marked.
+#include <string.h>
+#include <limits.h>
+#include "columns.h"
+#include "exprtree.h"
+#include "evaluate.h"
+#include "arena.h"
+
+ColumnPlan::ColumnPlan( int slotCount )
+{
+    slots.assign( slotCount, -1 );
+    inputs.assign( slotCount, -1 );
+    columns.assign( slotCount, NULL );
+    mask = -1;
+    result = -1;
+    unplanned = false;
+}
+
+int ColumnPlan::newRegister( RegisterKind kind, int value, int slot )
+{
+    Register r;
+    r.kind = kind;
+    r.value = value;
+    r.slot = slot;
+    registers.push_back( r );
+    return registers.size() - 1;
+}
+
+//  newStep
+//  A step of the given kind, with a register for its result
+ColumnPlan::Step ColumnPlan::newStep( StepKind kind )
+{
+    Step s;
+    s.kind = kind;
+    s.oper = NO_OP;
+    s.a = s.b = s.c = -1;
+    s.mask = -1;
+    s.sense = false;
+    s.call = NULL;
+    s.dest = newRegister( COMPUTED );
+    return s;
+}
+
+int ColumnPlan::constant( Integer value )
+{
+    if (!value.fitsInt())
+    {
+	unplanned = true;		// (so its register is never used)
+	return newRegister( CONSTANT, 0 );
+    }
+    return newRegister( CONSTANT, value.small() );
+}
+
+//  variable
+//  A variable holds its own value until it is assigned
+int ColumnPlan::variable( int slot )
+{
+    if (slots[slot] >= 0)
+	return slots[slot];
+    if (inputs[slot] < 0)
+	inputs[slot] = newRegister( VARIABLE, 0, slot );
+    return inputs[slot];
+}
+
+void ColumnPlan::assign( int slot, int reg )
+{
+    slots[slot] = reg;
+}
+
+//  activeMask
+//  The register selecting the rows now being planned (-1 for all),
+//  computed the first time a step needs it
+int ColumnPlan::activeMask()
+{
+    if (mask < 0)
+	return -1;
+    vector<int> pending;		// masks to compute, innermost first
+    for (int m = mask; m >= 0 && masks[m].reg < 0; m = masks[m].outer)
+	pending.push_back( m );
+    while (!pending.empty())
+    {
+	Mask &m = masks[pending.back()];
+	Step s = newStep( MASK );
+	s.a = m.test;
+	s.mask = m.outer < 0 ? -1 : masks[m.outer].reg;
+	s.sense = m.sense;
+	m.reg = s.dest;
+	steps.push_back( s );
+	pending.pop_back();
+    }
+    return masks[mask].reg;
+}
+
+int ColumnPlan::binary( OpKind oper, int a, int b )
+{
+    int m = -1;
+    if (oper == PLUS || oper == MINUS || oper == TIMES ||
+	oper == DIVIDE || oper == MODULO)
+	m = activeMask();		// only these rows may fail
+    Step s = newStep( BINARY );
+    s.oper = oper;
+    s.a = a;
+    s.b = b;
+    s.mask = m;
+    steps.push_back( s );
+    return s.dest;
+}
+
+int ColumnPlan::call( const Functional *f, const vector<int> &args )
+{
+    int m = activeMask();
+    Step s = newStep( CALL );
+    s.call = f;
+    s.args = args;
+    s.mask = m;
+    steps.push_back( s );
+    return s.dest;
+}
+
+void ColumnPlan::beginTrue( Branch &b, int test )
+{
+    Mask m = { test, mask, true, -1 };
+    b.test = test;
+    b.outer = mask;
+    b.before = slots;
+    masks.push_back( m );
+    mask = masks.size() - 1;
+}
+
+void ColumnPlan::beginFalse( Branch &b, int trueValue )
+{
+    Mask m = { b.test, b.outer, false, -1 };
+    b.trueValue = trueValue;
+    b.afterTrue = slots;
+    slots = b.before;
+    masks.push_back( m );
+    mask = masks.size() - 1;
+}
+
+//  endBranch
+//  Select the value of the conditional, and of every variable
+//  that either case assigned
+int ColumnPlan::endBranch( Branch &b, int falseValue )
+{
+    mask = b.outer;
+    Step s = newStep( SELECT );
+    s.a = b.test;
+    s.b = b.trueValue;
+    s.c = falseValue;
+    steps.push_back( s );
+
+    for (unsigned slot = 0; slot < slots.size(); slot++)
+	if (b.afterTrue[slot] != slots[slot])
+	{
+	    int t = b.afterTrue[slot] >= 0 ? b.afterTrue[slot] : variable( slot );
+	    int f = slots[slot] >= 0 ? slots[slot] : variable( slot );
+	    Step v = s;
+	    v.b = t;
+	    v.c = f;
+	    v.dest = newRegister( COMPUTED );
+	    steps.push_back( v );
+	    slots[slot] = v.dest;
+	}
+    return s.dest;
+}
+
+// lane
+// The operation on one row's values, 64 bits wide for arithmetic
+template <OpKind K> inline long lane( long l, long r );
+template <> inline long lane<PLUS>( long l, long r )	{ return l + r; }
+template <> inline long lane<MINUS>( long l, long r )	{ return l - r; }
+template <> inline long lane<TIMES>( long l, long r )	{ return l * r; }
+template <> inline long lane<DIVIDE>( long l, long r )	{ return l / r; }
+template <> inline long lane<MODULO>( long l, long r )	{ return l % r; }
+template <> inline long lane<LESS_EQ>( long l, long r )	{ return l <= r; }
+template <> inline long lane<GREATER_EQ>( long l, long r ) { return l >= r; }
+template <> inline long lane<LESS>( long l, long r )	{ return l < r; }
+template <> inline long lane<GREATER>( long l, long r )	{ return l > r; }
+template <> inline long lane<EQUAL>( long l, long r )	{ return l == r; }
+template <> inline long lane<NOT_EQUAL>( long l, long r ) { return l != r; }
+
+//  The loops for each operator
+template <OpKind K>
+static void lanes( int *__restrict d, const int *a, const int *b, int n )
+{
+    for (int i = 0; i < n; i++)
+	d[i] = lane<K>( a[i], b[i] );
+}
+
+//  arithmetic
+//  Rows whose result does not fit, if they were selected, are
+//  marked as failed
+template <OpKind K>
+static void arithmetic( int *__restrict d, const int *a, const int *b,
+			const int *m, unsigned char *failed, int n )
+{
+    for (int i = 0; i < n; i++)
+    {
+	long wide = lane<K>( a[i], b[i] );
+	d[i] = (int) wide;
+	failed[i] |= (wide != d[i]) & (m == NULL ? 1 : m[i] & 1);
+    }
+}
+
+//  divide
+//  Rows where the divisor is unusable get a divisor of 1, and if
+//  they were selected, are marked as failed
+template <OpKind K>
+static void divide( int *__restrict d, const int *a, const int *b,
+		    const int *m, unsigned char *failed, int n )
+{
+    for (int i = 0; i < n; i++)
+    {
+	int bad = (b[i] == 0) | ((a[i] == INT_MIN) & (b[i] == -1));
+	d[i] = lane<K>( a[i], bad ? 1 : b[i] );
+	failed[i] |= bad & (m == NULL ? 1 : m[i] & 1);
+    }
+}
+
+long ColumnPlan::run( int rows, VarTree &vars, const ExprNode *root,
+		      CallStack &calls, Integer out[] )
+{
+    // Registers that are not bound to a column get storage,
+    // and those that never change are filled in just once
+    vector<int *> reg( registers.size() );
+    bool everyRow = unplanned;		// walk every row singly
+    int owned = 0;
+    for (unsigned r = 0; r < registers.size(); r++)
+	if (registers[r].kind != VARIABLE || columns[registers[r].slot] == NULL)
+	    owned++;
+    vector<int> storage( (size_t) owned * Block );
+    owned = 0;
+    for (unsigned r = 0; r < registers.size(); r++)
+    {
+	const Register &g = registers[r];
+	if (g.kind == VARIABLE && columns[g.slot] != NULL)
+	    continue;
+	reg[r] = &storage[(size_t) owned++ * Block];
+	if (g.kind == VARIABLE && !vars.value( g.slot ).fitsInt())
+	    everyRow = true;
+	else if (g.kind != COMPUTED)
+	    for (int i = 0; i < Block; i++)
+		reg[r][i] = g.kind == CONSTANT ? g.value : vars.value( g.slot ).small();
+    }
+
+    vector<Integer> frame;		// for a row walked on its own
+    unsigned char failed[Block];
+    Integer values[10];
+    long single = 0;
+    for (int start = 0; start < rows; start += Block)
+    {
+	int n = rows - start < Block ? rows - start : Block;
+	for (unsigned r = 0; r < registers.size(); r++)
+	    if (registers[r].kind == VARIABLE && columns[registers[r].slot] != NULL)
+		reg[r] = (int *) columns[registers[r].slot] + start;
+	memset( failed, everyRow, n );
+
+	for (unsigned k = 0; k < steps.size() && !everyRow; k++)
+	{
+	    const Step &s = steps[k];
+	    int *d = reg[s.dest];
+	    const int *a = s.a < 0 ? NULL : reg[s.a];
+	    const int *m = s.mask < 0 ? NULL : reg[s.mask];
+	    switch (s.kind)
+	    {
+	    case BINARY:
+	    {
+		const int *b = reg[s.b];
+		switch (s.oper)
+		{
+		case PLUS:	arithmetic<PLUS>( d, a, b, m, failed, n );	break;
+		case MINUS:	arithmetic<MINUS>( d, a, b, m, failed, n );	break;
+		case TIMES:	arithmetic<TIMES>( d, a, b, m, failed, n );	break;
+		case DIVIDE:	divide<DIVIDE>( d, a, b, m, failed, n );	break;
+		case MODULO:	divide<MODULO>( d, a, b, m, failed, n );	break;
+		case LESS_EQ:	lanes<LESS_EQ>( d, a, b, n );		break;
+		case GREATER_EQ: lanes<GREATER_EQ>( d, a, b, n );	break;
+		case LESS:	lanes<LESS>( d, a, b, n );		break;
+		case GREATER:	lanes<GREATER>( d, a, b, n );		break;
+		case EQUAL:	lanes<EQUAL>( d, a, b, n );		break;
+		case NOT_EQUAL:	lanes<NOT_EQUAL>( d, a, b, n );		break;
+		default:	break;
+		}
+		break;
+	    }
+	    case MASK:
+		for (int i = 0; i < n; i++)
+		    d[i] = (m == NULL ? -1 : m[i]) &
+			-(s.sense ? a[i] != 0 : a[i] == 0);
+		break;
+	    case SELECT:
+	    {
+		const int *t = reg[s.b], *f = reg[s.c];
+		for (int i = 0; i < n; i++)
+		{
+		    int pick = -(a[i] != 0);
+		    d[i] = (t[i] & pick) | (f[i] & ~pick);
+		}
+		break;
+	    }
+	    case CALL:
+		for (int i = 0; i < n; i++)
+		{
+		    d[i] = 0;
+		    if ((m != NULL && m[i] == 0) || failed[i])
+			continue;
+		    for (unsigned j = 0; j < s.args.size(); j++)
+			values[j] = reg[s.args[j]][i];
+		    Integer value = s.call->callWith( values, calls );
+		    if (value.fitsInt())
+			d[i] = value.small();
+		    else
+			failed[i] = 1;
+		}
+		break;
+	    }
+	}
+	if (!everyRow)
+	    for (int i = 0; i < n; i++)
+		out[start + i] = reg[result][i];
+
+	for (int i = 0; i < n; i++)
+	    if (failed[i])
+	    {
+		frame.assign( vars.slots(), vars.slots() + vars.size() );
+		for (unsigned slot = 0; slot < columns.size(); slot++)
+		    if (columns[slot] != NULL)
+			frame[slot] = Integer( columns[slot][start + i] );
+		out[start + i] = root->evaluate( frame.data(), calls );
+		single++;
+	    }
+    }
+    return single;
+}
+
+ColumnExpr::ColumnExpr( const char expr[], VarTree &v, FunctionDef &funs )
+    : vars( v )
+{
+    arena = new Arena();
+    root = parseExpression( expr, vars, funs, *arena );
+    plan = new ColumnPlan( vars.size() );
+    plan->finish( root->vectorize( *plan ) );
+    fallbacks = 0;
+}
+
+ColumnExpr::~ColumnExpr()
+{
+    delete plan;
+    arena->release();
+}
+
+bool ColumnExpr::bind( const string &name, const int *column )
+{
+    int slot = vars.find( name );
+    if (slot < 0 || slot >= (int) vars.size())
+	return false;
+    plan->bind( slot, column );
+    return true;
+}
+
+void ColumnExpr::run( int rows, Integer out[] )
+{
+    fallbacks += plan->run( rows, vars, root, calls, out );
+}
+
+int Value::vectorize( ColumnPlan &plan ) const
+{
+    return plan.constant( value );
+}
+
+int Variable::vectorize( ColumnPlan &plan ) const
+{
+    return plan.variable( slot );
+}
+
+int Operation::vectorize( ColumnPlan &plan ) const
+{
+    int l = left->vectorize( plan );
+    return plan.binary( oper, l, right->vectorize( plan ) );
+}
+
+int Assignment::vectorize( ColumnPlan &plan ) const
+{
+    int r = right->vectorize( plan );
+    plan.assign( slot, r );
+    return r;
+}
+
+int Conditional::vectorize( ColumnPlan &plan ) const
+{
+    ColumnPlan::Branch b;
+    plan.beginTrue( b, test->vectorize( plan ) );
+    plan.beginFalse( b, trueCase->vectorize( plan ) );
+    return plan.endBranch( b, falseCase->vectorize( plan ) );
+}
+
+//  The arguments are computed in blocks, and only the call itself
+//  is made one row at a time
+int Functional::vectorize( ColumnPlan &plan ) const
+{
+    vector<int> args;
+    for (int i = 0; i < 10 && para_list[i] != NULL; i++)
+	args.push_back( para_list[i]->vectorize( plan ) );
+    return plan.call( this, args );
+}
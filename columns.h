@@ -0,0 +1,178 @@
+// Columnar Evaluation Header File
+// When one formula is evaluated over a great many rows of inputs,
+// it is far faster to evaluate each operator over a whole block of
+// rows at a time than to evaluate the whole formula once per row.
+// Each variable is then a column:  an array with one value per row.
+//
+// A parsed expression is translated to a plan:  a straight sequence
+// of steps, each computing one register (a block of values) from
+// others with a simple loop that the compiler may turn into vector
+// instructions.  Then
+// -- a conditional evaluates both of its cases, and selects between
+//    them row by row with a mask (only one case is evaluated in each
+//    row as far as anything observable is concerned),
+// -- an assignment simply makes the variable refer to the register
+//    holding its new value, for the rest of that row,
+// -- a function call cannot be done in blocks, so it is made one row
+//    at a time, in the rows whose conditions select it,
+// -- and a row where a division would fail, or where any value would
+//    not fit in an int, is evaluated once more on its own by walking
+//    the tree, to fail (or to compute a large Integer) exactly as it
+//    would there.
+//
+// The blocks hold plain ints.  An expression with a constant too
+// large for one, or run with a variable whose value is, has every
+// row walked singly.
+//
+// Assignments only affect the row being evaluated:  nothing is
+// stored back into the variables.
+#ifndef COLUMNS
+#define COLUMNS
+
+#include <string>
+#include <vector>
+#include "vartree.h"
+#include "funmap.h"
+#include "callstack.h"
+#include "token.h"
+using namespace std;
+
+class ExprNode;
+class Functional;
+class Arena;
+
+class ColumnPlan
+{
+    public:
+	static const int Block = 256;	// rows computed at once
+
+    private:
+	enum RegisterKind
+	{
+	    CONSTANT,			// the same value in every row
+	    VARIABLE,			// a column, or else a variable's value
+	    COMPUTED			// the result of a step
+	};
+	struct Register
+	{
+	    RegisterKind kind;
+	    int		 value;		// for a constant
+	    int		 slot;		// for a variable
+	};
+	enum StepKind
+	{
+	    BINARY,			// dest = a kind b
+	    MASK,			// dest = mask & (a != 0), or (a == 0)
+	    SELECT,			// dest = a != 0 ? b : c, per row
+	    CALL			// dest = call(args), in masked rows
+	};
+	struct Step
+	{
+	    StepKind	kind;
+	    OpKind	oper;		// for BINARY
+	    int		dest, a, b, c;	// registers
+	    int		mask;		// rows to compute (-1 for all)
+	    bool	sense;		// for MASK, whether a must be true
+	    const Functional *call;	// for CALL
+	    vector<int> args;		// for CALL
+	};
+	struct Mask			// rows reaching one case of a conditional
+	{
+	    int	 test, outer;		// test register, and enclosing mask
+	    bool sense;			// which case
+	    int	 reg;			// register, once one is needed
+	};
+
+	vector<Register> registers;
+	vector<Step>	 steps;
+	vector<Mask>	 masks;
+	vector<int>	 slots;		// register assigned to each variable
+	vector<int>	 inputs;	// register for each variable's own value
+	vector<const int *> columns;	// column bound to each slot, or NULL
+	int		 mask;		// rows now being planned (-1 for all)
+	int		 result;	// register holding the final value
+	bool		 unplanned;	// some constant does not fit a block
+
+	int  newRegister( RegisterKind kind, int value = 0, int slot = -1 );
+	Step newStep( StepKind kind );
+	int  activeMask();		// register for mask, creating it
+    public:
+	ColumnPlan( int slotCount );
+
+	// Planning:  each function returns the register for its result
+	int constant( Integer value );
+	int variable( int slot );
+	void assign( int slot, int reg );
+	int binary( OpKind oper, int a, int b );
+	int call( const Functional *f, const vector<int> &args );
+
+	// A conditional plans its test, then each case in turn
+	// (each case begins with the variables as they were before
+	// either), and then selects between them
+	struct Branch
+	{
+	    int		test, outer;
+	    vector<int> before, afterTrue;
+	    int		trueValue;
+	};
+	void beginTrue( Branch &b, int test );
+	void beginFalse( Branch &b, int trueValue );
+	int  endBranch( Branch &b, int falseValue );
+
+	void finish( int reg )
+	{
+	    result = reg;
+	}
+
+	// Binding and running
+	void bind( int slot, const int *column )
+	{
+	    columns[slot] = column;
+	}
+
+	// run
+	// Compute the result for every row
+	// Parameters:
+	//	rows	(input int)		number of rows
+	//	vars	(input VarTree)		values of unbound variables
+	//	root	(input ExprNode)	the expression planned
+	//	calls	(modified CallStack)	for calls and failing rows
+	//	out	(output Integer array)	one result per row (large
+	//					ones are temporaries)
+	// Returns:				number of rows walked singly
+	long run( int rows, VarTree &vars, const ExprNode *root,
+		  CallStack &calls, Integer out[] );
+};
+
+// ColumnExpr
+// An expression prepared for evaluation over columns
+class ColumnExpr
+{
+    private:
+	VarTree	   &vars;
+	Arena	   *arena;		// holds the expression tree
+	ExprNode   *root;
+	ColumnPlan *plan;
+	CallStack   calls;
+    public:
+	long	    fallbacks;		// rows that had to be walked singly
+
+	// Parse an expression (not a definition, nor nested more deeply
+	// than MaxDepth, see evaluate.h), with the variables it names
+	// interned in vars
+	ColumnExpr( const char expr[], VarTree &vars, FunctionDef &funs );
+	ColumnExpr( const ColumnExpr & ) = delete;
+	~ColumnExpr();
+
+	// bind
+	// Supply a column for a variable (an unbound variable has the
+	// same value in every row -- its value in vars)
+	// Returns:	false if there is no such variable
+	bool bind( const string &name, const int *column );
+
+	// run
+	// Evaluate the expression for rows 0..rows-1 of the columns
+	void run( int rows, Integer out[] );
+};
+
+#endif
@@ -0,0 +1,311 @@
+// Common Subexpression Implementation File
+// The tree is walked twice, in the order it would be evaluated.
+// The first walk counts how often each subexpression is found again.
+// The second walk makes the same decisions in the same order, and
+// so meets the same subexpressions, this time rebuilding the tree:
+// the first occurrence of a repeated one becomes an assignment to
+// a temporary, and the later ones become references to it.
+#include "cse.h"
+#include "exprtree.h"
+#include "arena.h"
+
+Subexpressions::Subexpressions()
+{
+    buckets.assign( 64, -1 );
+    funs = NULL;
+    arena = NULL;
+}
+
+void Subexpressions::start( FunctionDef &fs, Arena &a )
+{
+    funs = &fs;
+    arena = &a;
+    entries.clear();
+    temps = 0;
+    rewriting = false;
+    restart();
+}
+
+//  restart
+//  Begin a walk from the top of the expression
+void Subexpressions::restart()
+{
+    truncate( 0 );			// leaves every bucket empty
+    regions.clear();
+    generation = generations = 0;
+    recorded = 0;
+}
+
+//  find
+//  Look for an equal subexpression evaluated in this region
+//  Returns:		its entry, or -1 if there is none
+int Subexpressions::find( const ExprNode *e ) const
+{
+    size_t shape = e->shapeHash();
+    for (int id = buckets[shape & (buckets.size() - 1)]; id >= 0;
+	 id = entries[id].chain)
+	if (entries[id].shape == shape && entries[id].generation == generation &&
+	    entries[id].node->same( *e ))
+	    return id;
+    return -1;
+}
+
+//  truncate
+//  Forget the subexpressions evaluated since a point in the walk.
+//  They are forgotten in the reverse of the order they were
+//  evaluated, so each is still at the front of its bucket.
+void Subexpressions::truncate( int size )
+{
+    while ((int) evaluated.size() > size)
+    {
+	int id = evaluated.back();
+	buckets[entries[id].shape & (buckets.size() - 1)] = entries[id].chain;
+	evaluated.pop_back();
+    }
+}
+
+//  reuse
+//  Returns:		what to evaluate instead of a subexpression
+//			evaluated before, or NULL if it was not
+ExprNode *Subexpressions::reuse( ExprNode *e )
+{
+    int id = find( e );
+    if (id < 0)
+	return NULL;
+    if (!rewriting)
+    {
+	entries[id].uses++;
+	return e;
+    }
+    return new (*arena) Variable( "#" + to_string( entries[id].temp ) );
+}
+
+//  record
+//  Note that a subexpression has been evaluated
+//  Parameters:
+//	original	(input ExprNode)	the subexpression as parsed
+//	result		(input ExprNode)	what it was rewritten to
+//  Returns:				what to evaluate in its place
+ExprNode *Subexpressions::record( ExprNode *original, ExprNode *result )
+{
+    int id = recorded++;
+    if (!rewriting)
+    {
+	Entry e;
+	e.node = original;
+	e.shape = original->shapeHash();
+	e.uses = 0;
+	e.temp = -1;
+	entries.push_back( e );
+	if (entries.size() > buckets.size() / 2)
+	{				// grow while nothing is evaluated
+	    vector<int> saved( evaluated );
+	    truncate( 0 );
+	    buckets.assign( 2 * buckets.size(), -1 );
+	    evaluated.clear();
+	    for (unsigned i = 0; i < saved.size(); i++)
+	    {
+		int &bucket = buckets[entries[saved[i]].shape & (buckets.size() - 1)];
+		entries[saved[i]].chain = bucket;
+		bucket = saved[i];
+		evaluated.push_back( saved[i] );
+	    }
+	}
+    }
+    int &bucket = buckets[entries[id].shape & (buckets.size() - 1)];
+    entries[id].generation = generation;
+    entries[id].chain = bucket;
+    bucket = id;
+    evaluated.push_back( id );
+
+    if (!rewriting || entries[id].uses == 0)
+	return result;
+    entries[id].temp = temps++;
+    return new (*arena) Assignment(
+	new (*arena) Variable( "#" + to_string( entries[id].temp ) ), result );
+}
+
+void Subexpressions::assigned()
+{
+    generation = ++generations;
+    if (!regions.empty())
+	regions.back().assigned = true;
+}
+
+bool Subexpressions::pure( const string &name ) const
+{
+    FunctionDef::const_iterator f = funs->find( name );
+    return f != funs->end() && f->second.pure;
+}
+
+void Subexpressions::beginCase()
+{
+    Region r;
+    r.size = evaluated.size();
+    r.generation = generation;
+    r.assigned = false;
+    regions.push_back( r );
+}
+
+//  Neither case can rely on the other having been evaluated
+void Subexpressions::nextCase()
+{
+    truncate( regions.back().size );
+    generation = regions.back().generation;
+}
+
+void Subexpressions::endCases()
+{
+    Region r = regions.back();
+    truncate( r.size );
+    generation = r.generation;
+    regions.pop_back();
+    if (r.assigned)
+	assigned();			// one case or the other did
+}
+
+//  startRewriting
+//  Prepare for the second walk, if it would change anything
+bool Subexpressions::startRewriting()
+{
+    bool shared = false;
+    for (unsigned i = 0; i < entries.size() && !shared; i++)
+	shared = entries[i].uses > 0;
+    if (!shared)
+	return false;
+    restart();
+    rewriting = true;
+    return true;
+}
+
+ExprNode *eliminateCommon( ExprNode *root, FunctionDef &funs, Arena &arena )
+{
+    static thread_local Subexpressions cse;	// reused to keep its storage
+    bool shareable;
+    cse.start( funs, arena );
+    root->eliminate( cse, shareable );
+    if (cse.startRewriting())
+	root = root->eliminate( cse, shareable );
+    return root;
+}
+
+bool Value::same( const ExprNode &e ) const
+{
+    const Value *v = dynamic_cast<const Value *>( &e );
+    return v != NULL && v->value == value;
+}
+
+bool Variable::same( const ExprNode &e ) const
+{
+    const Variable *v = dynamic_cast<const Variable *>( &e );
+    return v != NULL && v->name == name;
+}
+
+bool Operation::same( const ExprNode &e ) const
+{
+    const Operation *o = dynamic_cast<const Operation *>( &e );
+    return o != NULL && o->oper == oper &&
+	left->same( *o->left ) && right->same( *o->right );
+}
+
+ExprNode *Operation::eliminate( Subexpressions &cse, bool &shareable )
+{
+    ExprNode *e = cse.reuse( this );
+    if (e != NULL)
+    {
+	shareable = true;
+	return e;
+    }
+
+    bool l, r;
+    ExprNode *newLeft = left->eliminate( cse, l ),
+	     *newRight = right->eliminate( cse, r );
+    e = this;
+    if (newLeft != left || newRight != right)
+	e = make( cse.nodes(), newLeft, oper, newRight );
+    shareable = l && r;
+    return shareable ? cse.record( this, e ) : e;
+}
+
+//  Only the right side is evaluated, and then everything
+//  evaluated so far may be out of date
+ExprNode *Assignment::eliminate( Subexpressions &cse, bool &shareable )
+{
+    bool r;
+    ExprNode *newRight = right->eliminate( cse, r );
+    cse.assigned();
+    shareable = false;
+    if (newRight == right)
+	return this;
+    return new (cse.nodes()) Assignment( left, newRight );
+}
+
+bool Conditional::same( const ExprNode &e ) const
+{
+    const Conditional *c = dynamic_cast<const Conditional *>( &e );
+    return c != NULL && test->same( *c->test ) &&
+	trueCase->same( *c->trueCase ) && falseCase->same( *c->falseCase );
+}
+
+ExprNode *Conditional::eliminate( Subexpressions &cse, bool &shareable )
+{
+    ExprNode *e = cse.reuse( this );
+    if (e != NULL)
+    {
+	shareable = true;
+	return e;
+    }
+
+    bool b, t, f;
+    ExprNode *newTest = test->eliminate( cse, b );
+    cse.beginCase();
+    ExprNode *newTrue = trueCase->eliminate( cse, t );
+    cse.nextCase();
+    ExprNode *newFalse = falseCase->eliminate( cse, f );
+    cse.endCases();
+    e = this;
+    if (newTest != test || newTrue != trueCase || newFalse != falseCase)
+	e = new (cse.nodes()) Conditional( newTest, newTrue, newFalse );
+    shareable = b && t && f;
+    return shareable ? cse.record( this, e ) : e;
+}
+
+bool Functional::same( const ExprNode &e ) const
+{
+    const Functional *c = dynamic_cast<const Functional *>( &e );
+    if (c == NULL || c->name != name)
+	return false;
+    for (int i = 0; i < 10; i++)
+    {
+	if (para_list[i] == NULL || c->para_list[i] == NULL)
+	    return para_list[i] == c->para_list[i];
+	if (!para_list[i]->same( *c->para_list[i] ))
+	    return false;
+    }
+    return true;
+}
+
+ExprNode *Functional::eliminate( Subexpressions &cse, bool &shareable )
+{
+    ExprNode *e = cse.reuse( this );
+    if (e != NULL)
+    {
+	shareable = true;
+	return e;
+    }
+
+    ExprNode *args[10] = {NULL};
+    bool changed = false;
+    shareable = cse.pure( name );
+    for (int i = 0; i < 10 && para_list[i] != NULL; i++)
+    {
+	bool a;
+	args[i] = para_list[i]->eliminate( cse, a );
+	changed = changed || args[i] != para_list[i];
+	shareable = shareable && a;
+    }
+    e = this;
+    if (changed)
+	e = new (cse.nodes()) Functional( name, args, funcs );
+    return shareable ? cse.record( this, e ) : e;
+}
@@ -0,0 +1,99 @@
+// Common Subexpression Header File
+// An expression such as  (a*b+c) * (a*b+c)  need not compute its
+// operand twice:  the first occurrence may save its value in a
+// temporary variable, and the second simply use that variable.
+//
+// Only a subexpression known to have the same value both times
+// may be shared.  It may not contain an assignment or a call to
+// an impure function (see memo.h), and the first occurrence must
+// certainly be evaluated before the other:
+// -- operands are evaluated left to right, so a subexpression
+//    evaluated earlier is available afterwards,
+// -- only one case of a conditional is evaluated, so what either
+//    case evaluates is not available once the conditional is done,
+// -- and after any assignment, nothing evaluated earlier is
+//    available (it might depend on the variable assigned).
+//
+// Temporaries are named #0, #1, ... so as not to be mistaken for
+// any variable the user may name.
+#ifndef CSE
+#define CSE
+
+#include <string>
+#include <vector>
+#include "funmap.h"
+using namespace std;
+
+class ExprNode;
+class Arena;
+
+class Subexpressions
+{
+    private:
+	struct Entry
+	{
+	    ExprNode *node;		// first occurrence (as parsed)
+	    size_t    shape;		// and its shape
+	    int	      uses;		// later occurrences found
+	    int	      generation;	// when it was evaluated
+	    int	      temp;		// where its value is kept
+	    int	      chain;		// next evaluated in the same bucket
+	};
+	struct Region			// cases of a conditional
+	{
+	    int	 size;			// evaluated before the conditional
+	    int	 generation;		// and when
+	    bool assigned;		// whether either case assigns
+	};
+	vector<Entry> entries;		// every subexpression, in order
+	vector<int>   evaluated;	// those in the current region
+	vector<int>   buckets;		// latest evaluated entry, by shape
+	vector<Region> regions;		// conditionals entered
+	int	generation,		// advances at each assignment
+		generations;		// number ever used
+	int	recorded;		// entries seen in this walk
+	bool	rewriting;		// whether this is the second walk
+	int	temps;			// temporaries named so far
+	FunctionDef *funs;
+	Arena	*arena;
+
+	int  find( const ExprNode *e ) const;
+	void truncate( int size );
+	void restart();
+    public:
+	Subexpressions();
+
+	// start
+	// Prepare to walk a new expression (the storage is kept)
+	void start( FunctionDef &fs, Arena &a );
+
+	// Each walk visits the nodes in the order they are evaluated.
+	// A node first asks whether it was evaluated before, and if
+	// not, records itself once its children have been visited.
+	ExprNode *reuse( ExprNode *e );
+	ExprNode *record( ExprNode *original, ExprNode *result );
+	void assigned();		// an assignment was evaluated
+	bool pure( const string &name ) const;
+	Arena &nodes()			// where new nodes are allocated
+	{
+	    return *arena;
+	}
+
+	// Only one case of a conditional is evaluated
+	void beginCase();
+	void nextCase();
+	void endCases();
+
+	bool startRewriting();		// whether any were shared
+};
+
+// eliminateCommon
+// Share the repeated subexpressions of an expression
+// Parameters:
+//	root	(input ExprNode)	expression, not yet resolved
+//	funs	(input FunctionDef)	functions it may call
+//	arena	(modified Arena)	where new nodes are allocated
+// Returns:				an equivalent expression
+ExprNode *eliminateCommon( ExprNode *root, FunctionDef &funs, Arena &arena );
+
+#endif
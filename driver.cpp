@@ -1,13 +1,155 @@
 #include <iostream>
-#include "evaluate.h"
+#include <fstream>
+#include <thread>
+#include <stdlib.h>
+#include "interpreter.h"
+#include "memo.h"
+#include "arena.h"
+#include "batch.h"
+#include "exprcache.h"
+#include "simplify.h"
+#include "jit.h"
+#include "profile.h"
+#include "server.h"
+#include "snapshot.h"
+#include "builtins.h"
+#include "heapcount.h"
 using namespace std;
 
-int main()
+// The functions every session begins with, besides those built in
+// (see builtins.h)
+static const char *builtins[] =
 {
-	VarTree vars;		// initially empty tree
-	FunctionDef funs;
+    "deffn mod(a,b) = a % b",
+    "deffn cube(x) = x * x * x",
+    "deffn sum3(x,y,z) = x + y + z",
+    "deffn avg5(x,y,z,a,b) = (x + y + z + a + b)/5",
+    "deffn odd(x) = x%2?1:0",
+    "deffn even(x) = x%2?0:1",
+    "deffn neg(x) = -x"
+};
+
+// writeStacks
+// Write the stacks the profiler sampled to a file (see profile.h)
+static void writeStacks(const char path[])
+{
+	ofstream file(path);
+	if (profiler == NULL)
+		cerr << "profiling is off" << endl;
+	else if (!file)
+		cerr << "cannot write " << path << endl;
+	else
+		profiler->writeFolded(file);
+}
+
+// save
+// Write the session to a snapshot (see snapshot.h)
+static void save(const char path[], Interpreter &interp)
+{
+	if (!saveSnapshot(path, interp.variables(), interp.functions(), interp.workspace()))
+		cerr << "cannot write " << path << endl;
+}
+
+// batch
+// Evaluate a whole file without prompting, writing only the results,
+// and report the rate to the standard error
+static int batch(const char path[], Interpreter &interp, int threads,
+				 const char stacks[], const char load[], const char snapshot[])
+{
+	ostream quiet(NULL);		// the definitions are not displayed
+	if (load == NULL)		// (a snapshot holds its own)
+		for (const char *b : builtins)
+			interp.evaluate(b, quiet);
+
+	BatchStats stats;
+	bool ok;
+	{
+		OutputBuffer buffer(1);
+		ostream out(&buffer);
+		ok = runBatch(path, interp.variables(), interp.functions(), interp.engine(),
+					  out, stats, interp.workspace(), threads);
+	}
+	if (!ok)
+	{
+		cerr << "cannot read " << path << endl;
+		return 1;
+	}
+	cerr << stats.expressions << " expressions in " << stats.seconds
+		 << " seconds (" << (stats.seconds > 0 ? stats.expressions / stats.seconds : 0)
+		 << " expressions/sec)" << endl;
+	interp.workspace().cache.report(cerr);
+	if (profiler != NULL)
+		profiler->report(cerr);
+	if (stacks != NULL)
+		writeStacks(stacks);
+	if (snapshot != NULL)
+		save(snapshot, interp);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	EvalMode mode = TREE;	// "-vm" selects the bytecode machine
+	const char *script = NULL;	// "-batch file" evaluates a whole file
+	int threads = 1;		// "-threads n" shares it among n threads
+	bool profiling = false;		// "-profile" starts the profiler
+	const char *stacks = NULL;	// "-folded file" writes its samples
+	const char *socket = NULL;	// "-serve path" answers clients there
+	const char *library = NULL;	// "-library file" for them to share
+	const char *load = NULL;	// "-load file" starts from a snapshot
+	const char *snapshot = NULL;	// "-save file" writes one at the end
+	for (int i = 1; i < argc; i++)
+	{
+		if (string(argv[i]) == "-vm")
+			mode = MACHINE;
+		else if (string(argv[i]) == "-batch" && i + 1 < argc)
+			script = argv[++i];
+		else if (string(argv[i]) == "-threads" && i + 1 < argc)
+		{
+			threads = atoi(argv[++i]);
+			if (threads <= 0)		// as many as there are cores
+				threads = thread::hardware_concurrency();
+		}
+		else if (string(argv[i]) == "-profile")
+			profiling = true;
+		else if (string(argv[i]) == "-folded" && i + 1 < argc)
+		{
+			stacks = argv[++i];		// and write the samples here
+			profiling = true;
+		}
+		else if (string(argv[i]) == "-jit" && i + 1 < argc)
+			nativeThreshold = atol(argv[++i]);	// 0 never translates
+		else if (string(argv[i]) == "-serve" && i + 1 < argc)
+			socket = argv[++i];
+		else if (string(argv[i]) == "-library" && i + 1 < argc)
+			library = argv[++i];
+		else if (string(argv[i]) == "-load" && i + 1 < argc)
+			load = argv[++i];
+		else if (string(argv[i]) == "-save" && i + 1 < argc)
+			snapshot = argv[++i];
+	}
+	if (socket != NULL)
+	{
+		Server server(socket, builtins, sizeof builtins / sizeof builtins[0],
+					  library, threads, mode);
+		if (server.ok())
+			server.run();
+		return 1;
+	}
+	if (profiling)
+	{
+		profiler = new Profiler();
+		threads = 1;		// (it follows only one thread)
+	}
+	Interpreter interp(mode);
+	VarTree &vars = interp.variables();	// initially empty tree
+	FunctionDef &funs = interp.functions();
+	defineBuiltins(funs);
+	if (load != NULL && !loadSnapshot(load, vars, funs, interp.workspace()))
+		return 1;
+	if (script != NULL)
+		return batch(script, interp, threads, stacks, load, snapshot);
 	int cnt = 1;
-	char userInput[80];
 	string input;
 
 	cout << "******************************\n"
@@ -15,38 +157,37 @@ int main()
 		 << "******************************\n"
 		 << "Here are some functions that are already defined for you.\n\n";
     
-    evaluate("deffn gcf(a,b) = (rem = a%b) == 0?b:gcf(b,rem)", vars, funs);
-    cout << endl;
-    evaluate("deffn lcm(a,b) = a*b/gcf(a,b)", vars, funs);
-    cout << endl;
-    evaluate("deffn mod(a,b) = a % b", vars, funs);
-    cout << endl;
-    evaluate("deffn sqr(s) = s*s", vars, funs);
-    cout << endl;
-    evaluate("deffn abs(x) = x > 0 ? x : -x", vars, funs);
-    cout << endl;
-    evaluate("deffn cube(x) = x * x * x", vars, funs);
-    cout << endl;
-    evaluate("deffn sum3(x,y,z) = x + y + z", vars, funs);
-    cout << endl;
-    evaluate("deffn avg5(x,y,z,a,b) = (x + y + z + a + b)/5", vars, funs);
-    cout << endl;
-    evaluate("deffn odd(x) = x%2?1:0", vars, funs);
-    cout << endl;
-    evaluate("deffn even(x) = x%2?0:1", vars, funs);
-    cout << endl;
-    evaluate("deffn neg(x) = -x", vars, funs);
-    cout << endl;
-    evaluate("deffn fact(n) = n <= 1 ? 1 : n * fact(n-1)", vars, funs);
-    cout << endl;
-    evaluate("deffn pow(a,b)= b==0?1:a*pow(a,b-1)", vars, funs);
-    cout << endl;
-    evaluate("deffn fib(n) = n <2?n:fib(n-1)+fib(n-2)", vars, funs);
-    cout << endl;
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+        if (f->second.builtin != NULL)
+            cout << "Built in " << signature(f->second) << endl;
+    if (load != NULL)
+        cout << funs.size() << " functions and " << vars.size()
+             << " variables, as saved in " << load << endl;
+    else
+        for (const char *b : builtins)
+        {
+            interp.evaluate(b);
+            cout << endl;
+        }
     cout << endl;
     
 	cout << "You may define more functions in the following format.\n\n"
-		 << "deffn sqr(s) = s*s\n\n"
+		 << "deffn square(s) = s*s\n\n"
+		 << "A built-in function is only replaced in this format.\n\n"
+		 << "deffn shadow gcf(a,b) = b == 0 ? a : gcf(b, a%b)\n\n"
+		 << "A variable may be bound to a formula, which is evaluated again\n"
+		 << "whenever the variables it uses change, in this format.\n\n"
+		 << "total := price * count\n\n"
+		 << "You may type ':memo' to see how often function results were reused,\n"
+		 << "':memory' to see how much memory expressions are using,\n"
+		 << "':cache' to see how often parsed expressions were reused,\n"
+		 << "':simplify' to see how function bodies were simplified,\n"
+		 << "':native' to see which functions run as machine code,\n"
+		 << "':profile on' or ':profile off' to profile function calls,\n"
+		 << "':profile' to see the profile, ':stacks file' to save its samples,\n"
+		 << "':save file' to save the variables and functions for next time,\n"
+		 << "':formulas' to see which variables are bound to formulas,\n"
+		 << "or ':allocs' to see how many allocations the last one made.\n"
 		 << "You may type 'exit' to exit the program.\n"
 		 << "Good luck.\n\n";
 
@@ -54,17 +195,58 @@ int main()
 	{
 		cout << cnt++ << ": ";
 		getline(cin, input);
-		strcpy(userInput, input.c_str());
-		if (!input.empty() && input != "exit")
+		if (input == ":memo")
+			memoReport(cout, funs);
+		else if (input == ":memory")
+			Arena::report(cout);
+		else if (input == ":simplify")
+			simplifyReport(cout, funs);
+		else if (input == ":cache")
+			interp.workspace().cache.report(cout);
+		else if (input == ":native")
+			nativeReport(cout, funs);
+		else if (input == ":profile on")
+		{
+			if (profiler == NULL)
+				profiler = new Profiler();
+		}
+		else if (input == ":profile off")
+		{
+			delete profiler;
+			profiler = NULL;
+		}
+		else if (input == ":profile")
+		{
+			if (profiler == NULL)
+				cout << "profiling is off\n";
+			else
+				profiler->report(cout);
+		}
+		else if (input.compare(0, 8, ":stacks ") == 0)
+			writeStacks(input.c_str() + 8);
+		else if (input.compare(0, 6, ":save ") == 0)
+			save(input.c_str() + 6, interp);
+		else if (input == ":formulas")
+			interp.workspace().formulas.report(cout, vars);
+		else if (input == ":allocs")
+		{
+			if (countingAllocations())
+				cout << interp.workspace().allocations << " heap allocations\n";
+			else
+				cout << "allocations are only counted when built with -DCOUNT_ALLOCATIONS\n";
+		}
+		else if (!input.empty() && input != "exit")
 		{
 			cout << cnt++ << ": ";
-			evaluate(userInput, vars, funs);
+			interp.evaluate(input.c_str());
 			cout << endl;
 		}
 	}
     
     cout << vars << endl;
-    
-    system("pause");
+    if (stacks != NULL)
+        writeStacks(stacks);
+    if (snapshot != NULL)
+        save(snapshot, interp);
     return 0;
 }
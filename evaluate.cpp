@@ -1,8 +1,8 @@
 // Simple Expression Evaluation
 // This program will evaluate simple arithmetic expressions
-// represented as a linked-list of tokens.  Keyboard input
+// represented as an array of tokens.  Keyboard input
 // will be accepted into a string, which will be converted
-// into that linked list.
+// into that array, and traversed with a pointer.
 //
 // If the first symbol in the input string is an operator,
 // then the value of the previous expression will be taken
@@ -13,244 +13,744 @@
 // -- simple arithmetic operators ( +, -, *, /, % )
 // -- matched parentheses for grouping
 
-// This implementation consists of a set of mutually-recursive
-// functions. which will track the structure of the expression.
+// The structure of the expression is found by precedence climbing,
+// driven by a table of the binary operators (see expression below).
 //
 // A sum expression is the sum or difference of one or more products.
 // A product expression is the product or quotient of one or more factors.
 // A factor may be a number or a parenthesized sum expression.
 
+#include <algorithm>
+#include <string.h>
+#include <ctype.h>
 #include "tokenlist.h"
 #include "exprtree.h"
 #include "evaluate.h"
 #include "vartree.h"
 #include "funmap.h"
+#include "bytecode.h"
+#include "builtins.h"
+#include "memo.h"
+#include "arena.h"
+#include "callstack.h"
+#include "heapcount.h"
+#include "exprcache.h"
+#include "cse.h"
+#include "jit.h"
+#include "profile.h"
 
-void define	   (ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs);
-void assign	   (ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs);
-void condition (ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs);
-void compare   (ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs);
-void sum	   (ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs);
-void product   (ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs);
-void factor	   (ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs);
-void funcs	   (ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs);
+void define	   (ExprNode *&root, const Token *&IFX_iter, const Token *IFX_end, FunctionDef &funs, Arena &arena, ExprCache &cache, ostream &out);
+int  expression(ExprNode *&root, const Token *&IFX_iter, const Token *IFX_end, FunctionDef &funs, Arena &arena);
+void bindFormula(const Token *&IFX_iter, const Token *IFX_end, VarTree &vars, FunctionDef &funs, Workspace &space, ostream &out);
 
-int evaluate(const char str[], VarTree &vars, FunctionDef &funs)
+// tooDeep
+// Whether a tree is nested more deeply than MaxDepth, saying so if it is
+static bool tooDeep(int depth, ostream &out)
+{
+    if (depth <= MaxDepth)
+        return false;
+    out << "expression nested too deeply (more than " << MaxDepth << " levels)";
+    return true;
+}
+
+// currentOper
+// The kind of operator at the current position (NO_OP at the end)
+static inline OpKind currentOper(const Token *IFX_iter, const Token *IFX_end)
+{
+    if (IFX_iter != IFX_end)
+        return IFX_iter->operKind();
+    return NO_OP;
+}
+
+// advance
+// Move on to the next token, but never past the end
+static inline void advance(const Token *&IFX_iter, const Token *IFX_end)
+{
+    if (IFX_iter != IFX_end)
+        IFX_iter++;
+}
+
+// bindsFormula
+// Whether the tokens bind a variable to a formula (see formula.h)
+static inline bool bindsFormula(const Token *IFX_iter, const Token *IFX_end)
+{
+    return IFX_iter != IFX_end && IFX_iter->isVariable() &&
+        currentOper(IFX_iter + 1, IFX_end) == BIND;
+}
+
+// abandon
+// Recover from an evaluation that divided by zero, whatever it was
+// in the midst of, and say so in place of its value
+static void abandon(Workspace &space, ostream &out)
+{
+    space.calls.clear();
+    nativeSuspended = 0;
+    if (profiler != NULL)
+        profiler->abandon();
+    out << "division by zero";
+}
+
+// implicitOperand
+// Whether the expression starts with an operator, so that the
+// previous value must be supplied as its first operand
+bool implicitOperand(const char str[])
+{
+    while (isspace(*str))
+        str++;
+    return !isdigit(*str) && !isalpha(*str) && *str != '(';
+}
+
+bool definesFunction(const char str[])
+{
+    while (isspace(*str))
+        str++;
+    return strncmp(str, "deffn", 5) == 0 && !isalnum(str[5]);
+}
+
+bool callsUndefined(const char str[], const FunctionDef &funs)
 {
-    static int num = 0;
     TokenList IFX(str);
-    ListIterator IFX_iter = IFX.begin();
-    const ListIterator IFX_end = IFX.end();
+    set<string> seen;
+    vector<const FunDef *> pending;		// defined, callees not yet checked
+    for (const Token *t = IFX.begin(); t != IFX.end(); t++)
+    {
+        if (!t->isVariable() || t + 1 == IFX.end() || t[1].operKind() != LEFT_PAREN)
+            continue;
+        string name(t->variableName());
+        if (!seen.insert(name).second)
+            continue;
+        FunctionDef::const_iterator f = funs.find(name);
+        if (f == funs.end())
+            return true;
+        pending.push_back(&f->second);
+    }
+    while (!pending.empty())
+    {
+        const FunDef *def = pending.back();
+        pending.pop_back();
+        for (set<string>::const_iterator c = def->callees.begin(); c != def->callees.end(); c++)
+            if (seen.insert(*c).second)
+            {
+                FunctionDef::const_iterator f = funs.find(*c);
+                if (f == funs.end())
+                    return true;
+                pending.push_back(&f->second);
+            }
+    }
+    return false;
+}
+
+// releaseDefinition
+// Free what one function definition holds, but its cache of results
+static void releaseDefinition(FunDef &def)
+{
+    delete def.code;
+    delete def.locals;
+    delete def.native;
+    if (def.arena != NULL)		// (NULL if loaded and never called)
+        def.arena->release();
+}
+
+void releaseFunctions(FunctionDef &funs)
+{
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+    {
+        releaseDefinition(f->second);
+        delete f->second.memo;
+    }
+    funs.clear();
+}
+
+Integer evaluate(const char str[], VarTree &vars, FunctionDef &funs, EvalMode mode, ostream &out, Workspace &space)
+{
+    ExprCache &cache = space.cache;
+    string &key = space.key;
     ExprNode *root = NULL;
+    Arena *arena = NULL;
+    CachedExpr *cached = NULL;
+    set<int> assigning;
+    const set<int> *assigned = &assigning;	// variables root assigns
     
-    // Store the previous value if starting with operator
-    if (!IFX_iter.token().isInteger() && !IFX_iter.token().isVariable() &&
-        IFX_iter.token().tokenChar() != "(" && IFX_iter.token().variableName() != "deffn")
-        IFX.push_front(Token(num));
+    // An expression using the previous value cannot be reused,
+    // and a definition is never kept
+    bool implicit = implicitOperand(str);
+    space.answered = false;
+    if (!implicit)
+    {
+        ExprCache::normalize(str, key);
+        if (key.compare(0, 6, "deffn ") != 0)
+            cached = cache.find(key, vars);
+    }
     
-    define(root, IFX_iter, IFX_end, funs);		// generate expression tree
+    if (cached != NULL)
+    {
+        root = cached->root;
+        assigned = &cached->assigned;
+    }
+    else
+    {
+        TokenList IFX(str);
+        
+        // Store the previous value if starting with operator
+        if (implicit)
+            IFX.push_front(Token(space.previous));
+        const Token *IFX_iter = IFX.begin();
+        const Token *IFX_end = IFX.end();
+        
+        if (bindsFormula(IFX_iter, IFX_end))		// (kept by the workspace)
+            bindFormula(IFX_iter, IFX_end, vars, funs, space, out);
+        else
+        {
+            arena = new Arena();		// holds this expression's tree
+            define(root, IFX_iter, IFX_end, funs, *arena, cache, out);		// generate expression tree
+        }
+        if (root != NULL)
+        {
+            // Sharing subexpressions only pays for itself
+            // if the expression will be evaluated again
+            bool keep = !implicit && cache.admit(key);
+            if (keep)
+                root = eliminateCommon(root, funs, *arena);
+            root->resolve(vars);
+            if (keep)
+            {
+                cached = cache.insert(key, root, *arena, vars);
+                assigned = &cached->assigned;
+            }
+            else
+            {
+                set<int> used;
+                root->findVariables(used, assigning);
+            }
+        }
+    }
     
-    if (root != NULL)
-        cout << (num = root->evaluate(vars));
+    Program prog;
+    const Program *code = &prog;
+    if (root != NULL && mode == MACHINE)
+    {
+        if (cached != NULL)
+        {
+            cache.compile(*cached);
+            code = cached->code;
+        }
+        else
+        {
+            root->compile(prog);
+            prog.emit(RETURN);
+        }
+    }
     
-    return num;
+    long before = heapAllocations();
+    try
+    {
+        Integer result;
+        if (root != NULL && mode == MACHINE)
+            result = execute(*code, vars, funs);
+        else if (root != NULL)
+            result = root->evaluate(vars.slots(), space.calls);
+        if (root != NULL)
+        {
+            if (!space.formulas.empty())
+                space.formulas.update(*assigned, vars, space.calls);
+            space.remember(result);
+            space.answered = true;
+            out << space.previous;
+        }
+    }
+    catch (DivisionByZero &)
+    {
+        abandon(space, out);
+    }
+    space.allocations = heapAllocations() - before;
+    
+    // A variable may have been assigned a large value held by the tree
+    // (a literal), so copies are kept before the arena is released
+    for (set<int>::const_iterator a = assigned->begin(); a != assigned->end(); a++)
+        vars.settle(*a);		// before the values it holds are freed
+    if (arena != NULL)
+        arena->release();		// the cache or a function body may keep it
+    Integer::releaseTemporaries();
+    return space.previous;
+}
+
+ExprNode *parseExpression(const char str[], VarTree &vars, FunctionDef &funs, Arena &arena)
+{
+    TokenList IFX(str);
+    return parseExpression(IFX, vars, funs, arena);
+}
+
+ExprNode *parseExpression(const TokenList &IFX, VarTree &vars, FunctionDef &funs, Arena &arena)
+{
+    ExprNode *root = NULL;
+    const Token *IFX_iter = IFX.begin();
+    
+    if (expression(root, IFX_iter, IFX.end(), funs, arena) > MaxDepth)
+        return NULL;
+    root = root->simplify(arena);
+    root = eliminateCommon(root, funs, arena);
+    root->resolve(vars);
+    return root;
 }
 
 // define
 // Initialize a function for future use
-void define(ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs)
+void define(ExprNode *&root, const Token *&IFX_iter, const Token *IFX_end, FunctionDef &funs, Arena &arena, ExprCache &cache, ostream &out)
 {
-    if (IFX_iter.token().variableName() == "deffn")
+    if (IFX_iter->variableName() == "deffn")
     {
         FunDef func;
         func.locals = new VarTree();
-        IFX_iter.advance();		// go pass deffn
-        func.name = IFX_iter.token().variableName();
-        IFX_iter.advance();		// go pass function name
-        IFX_iter.advance();		// go pass (
-        for (int pos = 0; IFX_iter.token().tokenChar() != ")" && pos < 10; pos++)
+        advance(IFX_iter, IFX_end);		// go pass deffn
+        bool shadow = IFX_iter->variableName() == "shadow" &&
+            currentOper(IFX_iter + 1, IFX_end) != LEFT_PAREN;
+        if (shadow)
+            advance(IFX_iter, IFX_end);		// go pass shadow
+        func.name = string(IFX_iter->variableName());
+        
+        // A built-in function is only replaced on purpose
+        FunctionDef::iterator builtin = funs.find(func.name);
+        if (!shadow && builtin != funs.end() && builtin->second.builtin != NULL)
+        {
+            out << func.name << " is built in ('deffn shadow " << func.name
+                << "(...) = ...' replaces it)";
+            delete func.locals;
+            root = NULL;
+            return;
+        }
+        advance(IFX_iter, IFX_end);		// go pass function name
+        advance(IFX_iter, IFX_end);		// go pass (
+        for (int pos = 0; IFX_iter->operKind() != RIGHT_PAREN && pos < 10; pos++)
+        {
+            if (IFX_iter->operKind() == COMMA)
+                advance(IFX_iter, IFX_end);
+            func.parameter[pos] = string(IFX_iter->variableName());
+            func.locals->intern(func.parameter[pos]);
+            advance(IFX_iter, IFX_end);		// go pass parameter name
+        }
+        advance(IFX_iter, IFX_end);		// go pass )
+        advance(IFX_iter, IFX_end);		// go pass =
+        if (tooDeep(expression(func.parsedBody, IFX_iter, IFX_end, funs, arena), out))
         {
-            if (IFX_iter.token().tokenChar() == ",")
-                IFX_iter.advance();
-            func.parameter[pos] = IFX_iter.token().variableName();
-            func.locals->assign(func.parameter[pos], 0);
-            IFX_iter.advance();		// go pass parameter name
+            delete func.locals;
+            root = NULL;
+            return;
         }
-        IFX_iter.advance();		// go pass )
-        IFX_iter.advance();		// go pass =
-        assign(func.functionBody, IFX_iter, IFX_end, funs);
+        func.functionBody = func.parsedBody->simplify(arena);
+        func.code = NULL;		// (compiled below)
+        func.arena = &arena;
+        arena.retain();
+        func.pure = false;		// decided by analyzeFunction
+        func.native = NULL;		// (until it is called often)
+        func.calls = 0;
+        func.stored = NULL;
+        func.builtin = NULL;
         
-        if (funs.find(func.name) == funs.end())
-            funs.insert({func.name, func});
+        FunctionDef::iterator old = funs.find(func.name);
+        if (old == funs.end())
+        {
+            func.number = funs.size();
+            func.memo = NULL;		// (until it is first called)
+        }
         else
-            funs[func.name].functionBody = func.functionBody;
-        root = NULL;
-        
-        // Print the function
-        string print = "Define " + func.name + "(";
-        for (int i = 0; func.parameter[i] != ""; i++)
         {
-            if (i != 0)
-                print += ",";
-            print += func.parameter[i];
+            func.number = old->second.number;
+            releaseDefinition(old->second);	// the old body is gone
+            func.memo = old->second.memo;	// will be cleared below
         }
-        cout << print << ")";
+        funs[func.name] = func;
+        set<string> changed = analyzeFunction(funs, func.name);
+        cache.invalidate(changed);
+        discardNative(funs, changed);
+        
+        // Which calls may be shared depends on which functions are pure
+        FunDef &def = funs[func.name];
+        def.functionBody = eliminateCommon(def.functionBody, funs, arena);
+        def.functionBody->resolve(*def.locals);	// after the parameters
+        def.code = new Program();
+        def.functionBody->compileTail(*def.code);
+        root = NULL;
+        
+        out << "Define " << signature(func);	// print the function
     }
-    else
-        assign(root, IFX_iter, IFX_end, funs);
+    else if (tooDeep(expression(root, IFX_iter, IFX_end, funs, arena), out))
+        root = NULL;
 }
 
-// equal
-// Generate expression for assignment
-void assign(ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs)
+// bindFormula
+// Bind a variable to the formula that follows it, and print its value
+void bindFormula(const Token *&IFX_iter, const Token *IFX_end, VarTree &vars, FunctionDef &funs, Workspace &space, ostream &out)
 {
-    condition(root, IFX_iter, IFX_end, funs);
+    int id = vars.intern(string(IFX_iter->variableName()));
+    advance(IFX_iter, IFX_end);		// go pass the variable
+    advance(IFX_iter, IFX_end);		// go pass :=
     
-    // If the assignment operation happens
-    while (IFX_iter != IFX_end &&
-           IFX_iter.token().tokenChar() == "=")
+    ExprNode *root = NULL;
+    Arena &arena = space.formulas.arena();
+    if (tooDeep(expression(root, IFX_iter, IFX_end, funs, arena), out))
+        return;
+    root = root->simplify(arena);
+    root->resolve(vars);
+    string why;
+    try
     {
-        ExprNode *tempLeftNode = root,
-        *tempRightNode = NULL;
-        IFX_iter.advance();     // go pass =
-        condition(tempRightNode, IFX_iter, IFX_end, funs);
-        root = new Operation(tempLeftNode, "=", tempRightNode);
+        if (space.formulas.bind(id, root, vars, space.calls, why))
+        {
+            space.remember(vars.value(id));
+            space.answered = true;
+            out << space.previous;
+        }
+        else
+            out << why;
+    }
+    catch (DivisionByZero &)
+    {
+        abandon(space, out);
     }
 }
 
-// condition
-// Generate expression fo condition
-void condition(ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs)
+// The binary operators, as the parser sees them.  A higher
+// precedence binds more tightly; any token not listed here
+// (precedence 0) ends the expression.  The conditional ? : is
+// parsed specially (see below), but takes its place among them.
+struct Precedence
 {
-    compare(root, IFX_iter, IFX_end, funs);
-    
-    while (IFX_iter != IFX_end &&
-           IFX_iter.token().tokenChar() == "?")
+    int  level;			// 0 if not a binary operator
+    bool rightToLeft;		// how a chain of them associates
+};
+
+static const Precedence operators[] =
+{
+    { 0, false },					// NO_OP
+    { 4, false }, { 4, false },				// + -
+    { 5, false }, { 5, false }, { 5, false },		// * / %
+    { 3, false }, { 3, false }, { 3, false },		// <= >= <
+    { 3, false }, { 3, false }, { 3, false },		// > == !=
+    { 1, false },					// =
+    { 0, false }, { 0, false },				// ( )
+    { 2, false },					// ?
+    { 0, false }, { 0, false },				// : ,
+    { 0, false }					// :=
+};
+
+static const int Lowest = 1,		// a whole expression
+		 Negated = 5;		// what a leading - applies to
+
+// Pending
+// An operand whose parsing is interrupted while a nested one
+// is parsed -- what would be a native stack frame in a
+// recursive descent parser, kept instead on a stack of its own
+// so that parsing is only limited by memory (though the tree it
+// produces is refused if nested more than MaxDepth, see evaluate.h).
+struct Pending
+{
+    enum Step
+    {
+	OPERAND,		// about to parse its first operand
+	OPERATOR,		// has an operand, may extend it
+	PAREN,			// awaits a parenthesized expression
+	NEGATE,			// awaits what a leading - applies to
+	RIGHT,			// awaits the right operand of oper
+	TRUE_CASE,		// awaits what follows ?
+	FALSE_CASE,		// awaits what follows :
+	ARGUMENT		// awaits an argument of a call
+    } step;
+    int lowest;			// lowest precedence it may take in
+    ExprNode *left;		// the operand so far
+    int depth;			// how deeply left is nested
+    OpKind oper;		// the operator awaiting its right side
+    ExprNode *trueCase;		// for a conditional (left is the test)
+    const Token *name;		// for a call
+    size_t base;		// where its arguments begin (see below)
+    bool chaining;		// whether left is a chain of terms so far,
+    size_t chain;		// which begins here (see below)
+
+    Pending(int prec)
     {
-        ExprNode *test = root,
-        *trueCase, *falseCase;
-        IFX_iter.advance();		// go past the ?
-        assign(trueCase, IFX_iter, IFX_end, funs);
-        IFX_iter.advance();		// go past the :
-        assign(falseCase, IFX_iter, IFX_end, funs);
-        root = new Conditional(test, trueCase, falseCase);
+	step = OPERAND;
+	lowest = prec;
+	depth = 0;
+	chaining = false;
     }
+};
+
+// leaf
+// Whether the token is an operand all by itself -- an integer or
+// a variable (a name not followed by a call's parenthesis)
+static inline bool leaf(const Token *t, const Token *IFX_end)
+{
+    return t->isInteger() ||
+        (t->isVariable() && currentOper(t + 1, IFX_end) != LEFT_PAREN);
 }
 
-// compare
-// Generate expression for comparison
-void compare(ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs)
+// leafNode
+// The tree for such an operand, moving past it
+static inline ExprNode *leafNode(const Token *&IFX_iter, const Token *IFX_end, Arena &arena)
 {
-    sum(root, IFX_iter, IFX_end, funs);
-    
-    // If the operator is conditional operator
-    while (IFX_iter != IFX_end &&
-           (IFX_iter.token().tokenChar() == "<" || IFX_iter.token().tokenChar() == "<=" ||
-            IFX_iter.token().tokenChar() == ">" || IFX_iter.token().tokenChar() == ">=" ||
-            IFX_iter.token().tokenChar() == "==" || IFX_iter.token().tokenChar() == "!="))
+    ExprNode *node;
+    if (IFX_iter->isInteger())
+        node = new (arena) Value(IFX_iter->integerValue());
+    else
+        node = new (arena) Variable(string(IFX_iter->variableName()));
+    advance(IFX_iter, IFX_end);
+    return node;
+}
+
+// nextArgument
+// Whether a call has another argument to parse (skipping the
+// comma that introduces it), or else the call itself
+static bool nextArgument(Pending &p, vector<ExprNode *> &arguments, const Token *&IFX_iter, const Token *IFX_end, FunctionDef &funs, Arena &arena)
+{
+    size_t count = arguments.size() - p.base;
+    if (IFX_iter != IFX_end && IFX_iter->operKind() != RIGHT_PAREN && count < 10)
     {
-        Token oper = IFX_iter.token();
-        ExprNode *tempLeftNode = root,
-        *tempRightNode = NULL;
-        IFX_iter.advance();		// go past the operator
-        sum(tempRightNode, IFX_iter, IFX_end, funs);
-        root = new Operation(tempLeftNode, oper.tokenChar(), tempRightNode);
+        if (IFX_iter->operKind() == COMMA)
+            advance(IFX_iter, IFX_end);
+        return true;
     }
+    ExprNode *para_list[10] = {NULL};
+    for (size_t i = 0; i < count; i++)
+        para_list[i] = arguments[p.base + i];
+    arguments.resize(p.base);
+    p.left = new (arena) Functional(string(p.name->variableName()), para_list, &funs);
+    p.depth++;				// (deeper than every argument)
+    advance(IFX_iter, IFX_end);		// go past the )
+    return false;
 }
 
-// sum
-// Generate a sum expression: the sum or difference of one or more products
-// There may be the possibility of a leading - that would be implicitly
-// subtracting the first product from zero.
-void sum(ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs)
+// Term
+// One operand of a chain of additions and subtractions (or of
+// multiplications), with the operator before it
+struct Term
 {
-    product(root, IFX_iter, IFX_end, funs);
-    
-    while (IFX_iter != IFX_end &&
-           (IFX_iter.token().tokenChar() == "+" ||
-            IFX_iter.token().tokenChar() == "-"))
+    OpKind oper;		// (PLUS or TIMES for the first)
+    ExprNode *operand;
+    int depth;			// how deeply it is nested
+};
+
+static const int Balance = 64;	// terms in the longest chain built as written
+
+// chainKind
+// Which chain an operator may extend (0 if none)
+static inline int chainKind(OpKind oper)
+{
+    return oper == PLUS || oper == MINUS ? 1 : oper == TIMES ? 2 : 0;
+}
+
+// balanced
+// The tree for terms lo..hi of a chain, each taken with its sign
+// relative to the first, so that  a - b - c - d  is built as
+// (a - b) - (c + d);  its terms are still evaluated in order
+static ExprNode *balanced(const Term terms[], int lo, int hi, int &depth, Arena &arena)
+{
+    if (lo == hi)
     {
-        Token oper = IFX_iter.token();
-        ExprNode *tempLeftNode = root,
-        *tempRightNode = NULL;
-        IFX_iter.advance();     // get past the operator
-        product(tempRightNode, IFX_iter, IFX_end, funs);
-        root = new Operation(tempLeftNode, oper.tokenChar(), tempRightNode);
+        depth = terms[lo].depth;
+        return terms[lo].operand;
     }
+    int mid = (lo + hi) / 2, rightDepth;
+    ExprNode *l = balanced(terms, lo, mid, depth, arena);
+    ExprNode *r = balanced(terms, mid + 1, hi, rightDepth, arena);
+    OpKind oper = terms[mid + 1].oper != terms[lo].oper ? MINUS :
+        terms[lo].oper == TIMES ? TIMES : PLUS;
+    depth = max(depth, rightDepth) + 1;
+    return Operation::make(arena, l, oper, r);
 }
 
-// product
-// Generate a product expression: the product or quotient of factors
-void product(ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs)
+// endChain
+// Build the chain of terms an operand has so far, if any
+static void endChain(Pending &p, vector<Term> &chain, Arena &arena)
 {
-    factor(root, IFX_iter, IFX_end, funs);
-    
-    while (IFX_iter != IFX_end &&
-           (IFX_iter.token().tokenChar() == "*" ||
-            IFX_iter.token().tokenChar() == "/" ||
-            IFX_iter.token().tokenChar() == "%"))
+    if (!p.chaining)
+        return;
+    p.chaining = false;
+    const Term *terms = &chain[p.chain];
+    int count = chain.size() - p.chain;
+    if (count > Balance)
+        p.left = balanced(terms, 0, count - 1, p.depth, arena);
+    else
     {
-        Token oper = IFX_iter.token();
-        ExprNode *tempLeftNode = root,
-        *tempRightNode = NULL;
-        IFX_iter.advance();     // get past the operator
-        factor(tempRightNode, IFX_iter, IFX_end, funs);
-        root = new Operation(tempLeftNode, oper.tokenChar(), tempRightNode);
+        p.left = terms[0].operand;
+        p.depth = terms[0].depth;
+        for (int i = 1; i < count; i++)
+        {
+            p.left = Operation::make(arena, p.left, terms[i].oper, terms[i].operand);
+            p.depth = max(p.depth, terms[i].depth) + 1;
+        }
     }
+    chain.resize(p.chain);
 }
 
-// factor
-// A factor may either be a single-digit number
-// or a parenthsized expression.
-void factor(ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs)
+// extend
+// Apply a binary operator to an operand and the one to its right
+// (as a term of a chain, if it may be)
+static void extend(Pending &p, OpKind oper, ExprNode *right, int depth, vector<Term> &chain, Arena &arena)
 {
-    if (IFX_iter.token().isInteger())
+    int kind = chainKind(oper);
+    if (p.chaining && chainKind(chain[p.chain].oper) != kind)
+        endChain(p, chain, arena);
+    if (kind == 0)
     {
-        root = new Value(IFX_iter.token().integerValue());
-        IFX_iter.advance();		// get past the digit
+        p.left = Operation::make(arena, p.left, oper, right);
+        p.depth = max(p.depth, depth) + 1;
+        return;
     }
-    else
+    if (!p.chaining)
     {
-        if (IFX_iter.token().tokenChar() == "(")
+        p.chaining = true;
+        p.chain = chain.size();
+        chain.push_back(Term{kind == 2 ? TIMES : PLUS, p.left, p.depth});
+    }
+    chain.push_back(Term{oper, right, depth});
+}
+
+// expression
+// Generate the tree for an expression, by precedence climbing.
+// Each binary operator's right side is an expression taking only
+// operators of higher precedence; every operator groups left to
+// right, so that
+//	a = b			assigns the value of b to a
+//	t ? x : y		selects x or y, which are whole expressions
+//	a < b			compares sums, which add or subtract products
+//	- p			subtracts a product p from zero
+//	f( e, ... )		calls a function with whole expressions
+// Instead of recursing for each nested operand, the operands in
+// progress are kept on a stack (which keeps its storage between
+// expressions).  A chain of more than Balance additions and
+// subtractions (or multiplications) is built as a balanced tree
+// instead, which gives the same value, so that even a sum of a great
+// many terms is not nested deeply.
+// Returns:	how deeply the tree is nested (see MaxDepth in evaluate.h)
+int expression(ExprNode *&root, const Token *&IFX_iter, const Token *IFX_end, FunctionDef &funs, Arena &arena)
+{
+    static thread_local vector<Pending> stack;
+    static thread_local vector<ExprNode *> arguments;	// of calls in progress
+    static thread_local vector<Term> chain;		// of chains in progress
+    size_t bottom = stack.size();
+    ExprNode *done;			// an operand just completed
+    int depth;				// and how deeply it is nested
+    
+    stack.push_back(Pending(Lowest));
+    for (;;)
+    {
+        Pending &p = stack.back();
+        if (p.step == Pending::OPERAND)
         {
-            IFX_iter.advance();		// go past assumed (
-            assign(root, IFX_iter, IFX_end, funs);
-            IFX_iter.advance();		// go past assumed )
+            if (leaf(IFX_iter, IFX_end))
+            {
+                p.left = leafNode(IFX_iter, IFX_end, arena);
+                p.depth = 1;
+                p.step = Pending::OPERATOR;
+            }
+            else if (IFX_iter->operKind() == LEFT_PAREN)
+            {
+                advance(IFX_iter, IFX_end);
+                p.step = Pending::PAREN;
+                stack.push_back(Pending(Lowest));
+            }
+            else if (IFX_iter->operKind() == MINUS)
+            {
+                advance(IFX_iter, IFX_end);
+                p.step = Pending::NEGATE;
+                stack.push_back(Pending(Negated));
+            }
+            else if (IFX_iter != IFX_end && currentOper(IFX_iter + 1, IFX_end) == LEFT_PAREN)
+            {
+                p.name = IFX_iter;
+                p.base = arguments.size();
+                advance(IFX_iter, IFX_end);	// go past the name
+                advance(IFX_iter, IFX_end);	// go past the (
+                if (nextArgument(p, arguments, IFX_iter, IFX_end, funs, arena))
+                {
+                    p.step = Pending::ARGUMENT;
+                    stack.push_back(Pending(Lowest));
+                }
+                else
+                    p.step = Pending::OPERATOR;
+            }
+            else
+            {
+                p.left = new (arena) Variable(string(IFX_iter->variableName()));
+                p.depth = 1;
+                advance(IFX_iter, IFX_end);
+                p.step = Pending::OPERATOR;
+            }
+            continue;
         }
-        else if (IFX_iter.token().tokenChar() == "-")
+        
+        OpKind oper = currentOper(IFX_iter, IFX_end);
+        const Precedence &prec = operators[oper];
+        if (prec.level >= p.lowest && prec.level > 0)
         {
-            ExprNode *tempLeftNode = new Value(0),
-            *tempRightNode = NULL;
-            IFX_iter.advance();
-            product(tempRightNode, IFX_iter, IFX_end, funs);
-            root = new Operation(tempLeftNode, "-", tempRightNode);
+            advance(IFX_iter, IFX_end);	// go past the operator
+            if (oper == QUESTION)
+            {
+                endChain(p, chain, arena);		// (the test)
+                p.step = Pending::TRUE_CASE;
+                stack.push_back(Pending(Lowest));
+                continue;
+            }
+            int right = prec.rightToLeft ? prec.level : prec.level + 1;
+            if (leaf(IFX_iter, IFX_end) &&
+                operators[currentOper(IFX_iter + 1, IFX_end)].level < right)
+            {				// (the right side is just that)
+                ExprNode *r = leafNode(IFX_iter, IFX_end, arena);
+                extend(p, oper, r, 1, chain, arena);
+                continue;
+            }
+            p.oper = oper;
+            p.step = Pending::RIGHT;
+            stack.push_back(Pending(right));
+            continue;
         }
-        else
+        
+        // This operand is complete:  hand it to the one awaiting it
+        endChain(p, chain, arena);
+        done = p.left;
+        depth = p.depth;
+        stack.pop_back();
+        if (stack.size() == bottom)
+            break;
+        Pending &q = stack.back();
+        switch (q.step)
         {
-            ListIterator temp_iter = IFX_iter;
-            temp_iter.advance();
-            if (temp_iter != IFX_end && temp_iter.token().tokenChar() == "(")
-                funcs(root, IFX_iter, IFX_end, funs);
-            else
-                root = new Variable(IFX_iter.token().variableName());
-            IFX_iter.advance();
+        case Pending::PAREN:
+            q.left = done;
+            q.depth = depth;
+            advance(IFX_iter, IFX_end);		// go past assumed )
+            break;
+        case Pending::NEGATE:
+            q.left = new (arena) BinaryOp<MINUS>(new (arena) Value(0), done);
+            q.depth = depth + 1;
+            break;
+        case Pending::RIGHT:
+            extend(q, q.oper, done, depth, chain, arena);
+            break;
+        case Pending::TRUE_CASE:
+            q.trueCase = done;
+            q.depth = max(q.depth, depth);
+            advance(IFX_iter, IFX_end);		// go past the :
+            q.step = Pending::FALSE_CASE;
+            stack.push_back(Pending(Lowest));
+            continue;
+        case Pending::FALSE_CASE:
+            q.left = new (arena) Conditional(q.left, q.trueCase, done);
+            q.depth = max(q.depth, depth) + 1;
+            break;
+        case Pending::ARGUMENT:
+            arguments.push_back(done);
+            q.depth = max(q.depth, depth);
+            if (nextArgument(q, arguments, IFX_iter, IFX_end, funs, arena))
+            {
+                stack.push_back(Pending(Lowest));
+                continue;
+            }
+            break;
+        default:
+            break;
         }
+        q.step = Pending::OPERATOR;
     }
-}
-
-// funcs
-// Generate functional exprnode for function call, supports recursion
-void funcs(ExprNode *&root, ListIterator &IFX_iter, const ListIterator IFX_end, FunctionDef &funs)
-{
-    string name = IFX_iter.token().variableName();
-    IFX_iter.advance();		// go pass function name;
-    IFX_iter.advance();		// go pass (
-    ExprNode *para_list[10] = {NULL};
-    for (int pos = 0; IFX_iter != IFX_end && IFX_iter.token().tokenChar() != ")" && pos < 10; pos++)
-    {
-        if (IFX_iter.token().tokenChar() == ",")
-            IFX_iter.advance();
-        assign(para_list[pos], IFX_iter, IFX_end, funs);
-    }
-    root = new Functional(name, para_list, &funs);
+    root = done;
+    return depth;
 }
@@ -14,14 +14,128 @@
 // All expressions are expected to have valid syntax.
 // There is no specification on the length of any expression.
 
+#ifndef EVALUATE
+#define EVALUATE
+
+#include <string>
 #include "vartree.h"
 #include "funmap.h"
+#include "exprcache.h"
+#include "callstack.h"
+#include "formula.h"
+
+// There are two ways to evaluate a parsed expression:
+// walking the expression tree directly, or compiling it to
+// bytecode for the stack machine.  Both give the same results.
+enum EvalMode
+{
+    TREE,		// ExprNode::evaluate
+    MACHINE		// compile to bytecode, then execute
+};
+
+// Workspace
+// What is kept from one expression to the next, besides the
+// variables and functions:  the previous value, the expressions
+// parsed before, the call stack, and the formulas bound to the
+// variables.  Every context evaluating expressions has a workspace of
+// its own (see interpreter.h), as does every thread evaluating
+// alongside others.
+struct Workspace
+{
+    Integer   previous;		// value of the last expression (kept)
+    long      allocations;	// made by the last evaluation
+    bool      answered;		// whether it had a value (and not a message)
+    ExprCache cache;		// expressions parsed before
+    CallStack calls;		// frames for function calls
+    Formulas  formulas;		// (see formula.h)
+    string    key;		// reused to avoid reallocating
+
+    Workspace()
+    {
+	allocations = 0;
+	answered = false;
+    }
+    Workspace( const Workspace & ) = delete;
+    ~Workspace()
+    {
+	previous.discard();
+    }
+
+    // remember
+    // Make a new value the previous one
+    void remember( Integer value )
+    {
+	Integer old = previous;
+	previous = value.keep();
+	old.discard();
+    }
+};
 
 // Evaluate
 // Evaluate the given expression, with the given variables defined
 // New variables may be defined when this function is called
+// An expression that divides by zero is abandoned where it was,
+// displaying "division by zero" instead of a value, and leaving the
+// previous value as it was (any variables it assigned before then
+// keep what they were assigned)
 // Parameters:
 //	expr	(input char array)	expression to evaluate
 //	vars	(modified VarTree)	variables to work with
 //	funs	(modified FunctionDef)	functions to define or call
-int evaluate( const char expr[], VarTree &vars, FunctionDef &funs );
+//	mode	(input EvalMode)	which engine to evaluate with
+//	out	(output stream)		where the result is displayed
+//	space	(modified Workspace)	what is kept for the next one
+// Returns:				its value, which remains valid
+//					until the next evaluation
+Integer evaluate( const char expr[], VarTree &vars, FunctionDef &funs,
+		  EvalMode mode, ostream &out, Workspace &space );
+
+// implicitOperand
+// Whether an expression starts with an operator, and so takes
+// the previous value as its first operand
+bool implicitOperand( const char expr[] );
+
+// definesFunction
+// Whether an expression is a function definition
+bool definesFunction( const char expr[] );
+
+// callsUndefined
+// Whether an expression (not a definition) would call a function
+// that is not defined, directly or through the functions it calls,
+// and so cannot be evaluated
+bool callsUndefined( const char expr[], const FunctionDef &funs );
+
+// releaseFunctions
+// Forget every function definition, releasing what each one holds
+// (the expressions that call them must have been released first)
+void releaseFunctions( FunctionDef &funs );
+
+// MaxDepth
+// How deeply an expression's tree may be nested.  The parser keeps
+// its own stack, but simplifying, resolving, evaluating and the other
+// passes over a tree recurse, a native stack frame for each level; so
+// an expression nested more deeply (such as one with more parentheses
+// within parentheses than this) is refused instead, with a message.
+// A long sum or product is not nested deeply, however many terms it
+// has (see expression in evaluate.cpp).
+const int MaxDepth = 10000;
+
+// parseExpression
+// Parse an expression (not a definition), simplify it, and resolve
+// it in the given variables, without evaluating it
+// Parameters:
+//	expr	(input char array)	expression to parse
+//	vars	(modified VarTree)	variables to resolve it in
+//	funs	(input FunctionDef)	functions it may call
+//	arena	(modified Arena)	where the tree is allocated
+// Returns:				the expression tree, or NULL if
+//					nested more deeply than MaxDepth
+class ExprNode;
+class Arena;
+class TokenList;
+ExprNode *parseExpression( const char expr[], VarTree &vars, FunctionDef &funs,
+			   Arena &arena );
+ExprNode *parseExpression( const TokenList &tokens, VarTree &vars,
+			   FunctionDef &funs, Arena &arena );	// already tokenized
+
+#endif
@@ -0,0 +1,167 @@
+// Expression Cache Implementation File
+// Each entry keeps a reference to the arena holding its tree,
+// so the tree lives exactly as long as the entry does.
+#include <ctype.h>
+#include <string.h>
+#include "exprcache.h"
+#include "exprtree.h"
+#include "bytecode.h"
+#include "arena.h"
+
+ExprCache::ExprCache( size_t size )
+{
+    capacity = size;
+    size_t slots = 16;
+    while (slots < 4 * size)
+	slots *= 2;
+    seen.assign( slots, 0 );
+    hits = misses = 0;
+    bytes = 0;
+}
+
+ExprCache::~ExprCache()
+{
+    clear();
+}
+
+void ExprCache::normalize( const char str[], string &key )
+{
+    size_t length = strlen( str ), n = 0;
+    key.resize( length );		// the key is never longer
+    char prev = '\0';
+    for (size_t i = 0; i < length; i++)
+    {
+	char ch = str[i];
+	if (isspace( ch ))
+	{
+	    while (i + 1 < length && isspace( str[i + 1] ))
+		i++;
+	    char next = str[i + 1];
+	    if (n > 0 && next != '\0' &&
+		((isalnum( prev ) && isalnum( next )) ||
+		 (!isalnum( prev ) && prev != ')' && next == '=')))
+		key[n++] = ' ';
+	}
+	else
+	    key[n++] = prev = ch;
+    }
+    key.resize( n );
+}
+
+//  find
+//  Look for an expression, making it the most recently used
+//  Returns:		the expression, or NULL if it must be parsed
+CachedExpr *ExprCache::find( const string &key, const VarTree &vars )
+{
+    unordered_map<string, Order::iterator>::iterator i = index.find( key );
+    if (i == index.end() || i->second->vars != &vars)
+    {
+	misses++;
+	return NULL;
+    }
+    if (i->second != order.begin())
+	order.splice( order.begin(), order, i->second );
+    hits++;
+    return &*i->second;
+}
+
+//  admit
+//  Decide whether a newly parsed expression is worth keeping:
+//  only if it was seen recently
+bool ExprCache::admit( const string &key )
+{
+    size_t h = hash<string>()( key ), &slot = seen[h & (seen.size() - 1)];
+    if (slot == h)
+	return capacity > 0;
+    slot = h;				// only remember it for now
+    return false;
+}
+
+//  insert
+//  Keep a newly parsed expression, discarding the least recently
+//  used one if there is no room.  An entry for the same text that
+//  was resolved against other variables is replaced.
+CachedExpr *ExprCache::insert( const string &key, ExprNode *root,
+			       Arena &arena, VarTree &vars )
+{
+    unordered_map<string, Order::iterator>::iterator i = index.find( key );
+    if (i != index.end())
+	discard( i->second );
+    if (order.size() >= capacity)
+	discard( --order.end() );
+
+    order.push_front( CachedExpr() );
+    CachedExpr &e = order.front();
+    e.key = key;
+    e.root = root;
+    e.arena = &arena;
+    e.vars = &vars;
+    e.code = NULL;
+    root->findCalls( e.callees );
+    set<int> used;
+    root->findVariables( used, e.assigned );
+    arena.retain();
+    e.bytes = sizeof(CachedExpr) + 2 * e.key.capacity() + arena.bytes();
+    bytes += e.bytes;
+    index[e.key] = order.begin();
+    return &e;
+}
+
+//  compile
+//  Translate an expression to bytecode the first time it is needed
+void ExprCache::compile( CachedExpr &e )
+{
+    if (e.code != NULL)
+	return;
+    e.code = new Program();
+    e.root->compile( *e.code );
+    e.code->emit( RETURN );
+    size_t more = e.code->code.capacity() * sizeof(Instruction);
+    e.bytes += more;
+    bytes += more;
+}
+
+void ExprCache::discard( Order::iterator e )
+{
+    bytes -= e->bytes;
+    index.erase( e->key );
+    delete e->code;
+    e->arena->release();
+    order.erase( e );
+}
+
+//  invalidate
+//  Discard every expression calling one of the given functions
+void ExprCache::invalidate( const set<string> &changed )
+{
+    Order::iterator e = order.begin();
+    while (e != order.end())
+    {
+	Order::iterator next = e;
+	next++;
+	for (set<string>::iterator c = e->callees.begin();
+	     c != e->callees.end(); c++)
+	    if (changed.count( *c ))
+	    {
+		discard( e );
+		break;
+	    }
+	e = next;
+    }
+}
+
+void ExprCache::clear()
+{
+    while (!order.empty())
+	discard( order.begin() );
+}
+
+void ExprCache::report( ostream &out ) const
+{
+    long lookups = hits + misses;
+    out << order.size() << " expressions cached in " << bytes << " bytes, "
+	<< hits << " hits, " << misses << " misses";
+    if (lookups > 0)
+	out << " (" << 100.0 * hits / lookups << "% hit rate)";
+    out << endl;
+}
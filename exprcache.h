@@ -0,0 +1,84 @@
+// Expression Cache Header File
+// The same expression is often evaluated many times over, with
+// only the values of its variables changing in between.  Rather
+// than tokenize and parse it again each time, the resolved tree
+// (and its bytecode, once needed) is kept, keyed by the source text.
+// The text is first normalized, so that spacing does not matter.
+//
+// The cache holds a bounded number of expressions; when it is full,
+// the one least recently used is discarded.  So that expressions
+// seen only once do not push out the ones in use, an expression is
+// only admitted the second time it is parsed (as far as a small
+// table of recently seen hash values can tell).  An expression calling
+// a function that is redefined is discarded as well, since whatever
+// was derived from the old definition may no longer apply.
+#ifndef EXPRCACHE
+#define EXPRCACHE
+
+#include <iostream>
+#include <list>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+class ExprNode;
+class VarTree;
+class Program;
+class Arena;
+
+// CachedExpr
+// One parsed expression, ready to evaluate
+struct CachedExpr
+{
+    string	key;			// normalized source text
+    ExprNode   *root;			// resolved expression tree
+    Arena      *arena;			// where root was allocated
+    VarTree    *vars;			// what root was resolved against
+    Program    *code;			// compiled form (NULL until needed)
+    set<string> callees;		// functions the expression calls
+    set<int>	assigned;		// variables it assigns
+    size_t	bytes;			// memory held for this entry
+};
+
+class ExprCache
+{
+    private:
+	typedef list<CachedExpr> Order;	// most recently used first
+	Order	order;
+	unordered_map<string, Order::iterator> index;
+	size_t	capacity;		// most expressions to hold
+	vector<size_t> seen;		// hash values of recent misses
+
+	void discard( Order::iterator e );
+    public:
+	long	hits,			// lookups that found an expression
+		misses;			// lookups that did not
+	size_t	bytes;			// memory held by all entries
+
+	ExprCache( size_t size = 1024 );
+	ExprCache( const ExprCache & ) = delete;
+	~ExprCache();
+
+	// normalize
+	// Produce the key for some source text:  spaces are dropped
+	// except where they separate two tokens that would otherwise run
+	// together, and a space remains only as a single blank
+	static void normalize( const char str[], string &key );
+
+	CachedExpr *find( const string &key, const VarTree &vars );
+	bool admit( const string &key );
+	CachedExpr *insert( const string &key, ExprNode *root, Arena &arena,
+			    VarTree &vars );
+	void compile( CachedExpr &e );	// fill in e.code
+	void invalidate( const set<string> &changed );
+	void clear();
+	size_t size() const
+	{
+	    return order.size();
+	}
+	void report( ostream &out ) const;
+};
+
+#endif
@@ -8,6 +8,12 @@
 #include "exprtree.h"
 #include "tokenlist.h"
 #include "vartree.h"
+#include "bytecode.h"
+#include "memo.h"
+#include "jit.h"
+#include "profile.h"
+#include "snapshot.h"
+#include "builtins.h"
 
 // Outputting any tree node will simply output its string version
 ostream& operator<<( ostream &stream, const ExprNode &e )
@@ -15,6 +21,13 @@ ostream& operator<<( ostream &stream, const ExprNode &e )
     return stream << e.toString();
 }
 
+// Most nodes simply compute their value and return it
+void ExprNode::compileTail( Program &p ) const
+{
+    compile( p );
+    p.emit( RETURN );
+}
+
 // A Value is just an integer value -- easy to evaluate
 // Unfortunately, the string class does not have a constructor for it
 string Value::toString() const
@@ -31,11 +44,19 @@ string Value::toLispString() const
     return convert.str();	// and extract its string equivalent
 }
 
-int Value::evaluate( VarTree &v ) const
+Integer Value::evaluate( Integer *, CallStack & ) const
 {
     return value;
 }
 
+void Value::compile( Program &p ) const
+{
+    if (value.fitsInt())
+	p.emit( PUSH, value.small() );
+    else
+	p.emit( CONST, p.addConstant( value ) );
+}
+
 //  A variable is just an alphabetic string -- easy to display
 //  TO evaluate, would need to look it up in the data structure
 string Variable::toString() const
@@ -48,58 +69,119 @@ string Variable::toLispString() const
     return name;
 }
 
-int Variable::evaluate( VarTree &v ) const
+Integer Variable::evaluate( Integer *v, CallStack & ) const
+{
+    return v[slot];
+}
+
+void Variable::resolve( VarTree &scope )
+{
+    slot = scope.intern( name );
+}
+
+void Variable::findVariables( set<int> &used, set<int> & ) const
+{
+    used.insert( slot );
+}
+
+void Variable::compile( Program &p ) const
 {
-    return v.lookup( name );
+    p.emit( LOAD, slot );
 }
 
-//  An operator is a string
-//  TO evaluate, would need to evaluate left and right and either assign
-//  or calculate or compare
+//  An operator is identified by its kind
+//  TO evaluate, the derived class for that operator will evaluate
+//  left and right and either assign or calculate or compare
 string Operation::toString() const
 {
-    return "(" + left->toString() + " " + oper + " " + right->toString() + ")";
+    return "(" + left->toString() + " " + operSymbol(oper) + " " + right->toString() + ")";
 }
 
 string Operation::toLispString() const
 {
-    if (oper == "=")
-        return "(setq " + left->toLispString() + " " + right->toLispString() + ")";
-    return "(" + oper + " " + left->toLispString() + " " + right->toLispString() + ")";
-}
-
-int Operation::evaluate( VarTree &v ) const
-{
-    if (oper == "+")
-        return left->evaluate(v) + right->evaluate(v);
-    else if (oper == "-")
-        return left->evaluate(v) - right->evaluate(v);
-    else if (oper == "*")
-        return left->evaluate(v) * right->evaluate(v);
-    else if (oper == "/")
-        return left->evaluate(v) / right->evaluate(v);
-    else if (oper == "%")
-        return left->evaluate(v) % right->evaluate(v);
-    else if (oper == "<=")
-        return left->evaluate(v) <= right->evaluate(v);
-    else if (oper == ">=")
-        return left->evaluate(v) >= right->evaluate(v);
-    else if (oper == "<")
-        return left->evaluate(v) < right->evaluate(v);
-    else if (oper == ">")
-        return left->evaluate(v) > right->evaluate(v);
-    else if (oper == "==")
-        return left->evaluate(v) == right->evaluate(v);
-    else if (oper == "!=")
-        return left->evaluate(v) != right->evaluate(v);
-    else if (oper == "=")
+    return "(" + string(operSymbol(oper)) + " " + left->toLispString() + " " + right->toLispString() + ")";
+}
+
+Operation *Operation::make( Arena &a, ExprNode *l, OpKind o, ExprNode *r )
+{
+    switch (o)
     {
-        int temp = right->evaluate(v);
-        v.assign(left->toString(), temp);
-        return temp;
+    case PLUS:		return new (a) BinaryOp<PLUS>( l, r );
+    case MINUS:		return new (a) BinaryOp<MINUS>( l, r );
+    case TIMES:		return new (a) BinaryOp<TIMES>( l, r );
+    case DIVIDE:	return new (a) BinaryOp<DIVIDE>( l, r );
+    case MODULO:	return new (a) BinaryOp<MODULO>( l, r );
+    case LESS_EQ:	return new (a) BinaryOp<LESS_EQ>( l, r );
+    case GREATER_EQ:	return new (a) BinaryOp<GREATER_EQ>( l, r );
+    case LESS:		return new (a) BinaryOp<LESS>( l, r );
+    case GREATER:	return new (a) BinaryOp<GREATER>( l, r );
+    case EQUAL:		return new (a) BinaryOp<EQUAL>( l, r );
+    case NOT_EQUAL:	return new (a) BinaryOp<NOT_EQUAL>( l, r );
+    case ASSIGN:	return new (a) Assignment( l, r );
+    default:		return NULL;	// not a binary operator
     }
-    
-    return 0;
+}
+
+//  To compile, push both operands and then apply the operator
+void Operation::compile( Program &p ) const
+{
+    static const OpCode codes[] = { RETURN,
+	ADD, SUB, MUL, DIV, MOD,
+	LE, GE, LT, GT, EQ, NE };
+
+    left->compile( p );
+    right->compile( p );
+    p.emit( codes[oper] );
+}
+
+void Operation::findCalls( set<string> &names ) const
+{
+    left->findCalls( names );
+    right->findCalls( names );
+}
+
+void Operation::resolve( VarTree &scope )
+{
+    left->resolve( scope );
+    right->resolve( scope );
+}
+
+void Operation::findVariables( set<int> &used, set<int> &assigned ) const
+{
+    left->findVariables( used, assigned );
+    right->findVariables( used, assigned );
+}
+
+string Assignment::toLispString() const
+{
+    return "(setq " + left->toLispString() + " " + right->toLispString() + ")";
+}
+
+Integer Assignment::evaluate( Integer *v, CallStack &calls ) const
+{
+    return v[slot] = right->evaluate(v, calls);
+}
+
+//  An assignment only needs its right side and the target slot
+void Assignment::compile( Program &p ) const
+{
+    right->compile( p );
+    p.emit( STORE, slot );
+}
+
+//  The target is named by the text of the left side,
+//  which is not itself evaluated
+void Assignment::resolve( VarTree &scope )
+{
+    slot = scope.intern( left->toString() );
+    right->resolve( scope );
+}
+
+//  The variable assigned is not used by the assignment
+void Assignment::findVariables( set<int> &used, set<int> &assigned ) const
+{
+    assigned.insert( slot );
+    right->findVariables( used, assigned );
 }
 
 //  An condition is a collection of string
@@ -115,12 +197,65 @@ string Conditional::toLispString() const
     return "(if " + test->toLispString() + " " + trueCase->toLispString() + " " + falseCase->toLispString() + ")";
 }
 
-int Conditional::evaluate( VarTree &v ) const
+Integer Conditional::evaluate( Integer *v, CallStack &calls ) const
+{
+    if (test->evaluate(v, calls) != 0)
+        return trueCase->evaluate(v, calls);
+    else
+        return falseCase->evaluate(v, calls);
+}
+
+//  Compiles to a conditional jump around the true case
+//  and an unconditional jump around the false case
+void Conditional::compile( Program &p ) const
 {
-    if (test->evaluate(v) != 0)
-        return trueCase->evaluate(v);
+    test->compile( p );
+    int toFalse = p.emit( JUMPF );
+    trueCase->compile( p );
+    int toEnd = p.emit( JUMP );
+    p.patch( toFalse, p.size() );
+    falseCase->compile( p );
+    p.patch( toEnd, p.size() );
+}
+
+//  Either case is in tail position if the conditional is
+Integer Conditional::evaluateTail( Integer *v, CallStack &calls, const Functional *&call ) const
+{
+    if (test->evaluate(v, calls) != 0)
+        return trueCase->evaluateTail(v, calls, call);
     else
-        return falseCase->evaluate(v);
+        return falseCase->evaluateTail(v, calls, call);
+}
+
+//  Each case returns on its own, so no jump is needed past the false case
+void Conditional::compileTail( Program &p ) const
+{
+    test->compile( p );
+    int toFalse = p.emit( JUMPF );
+    trueCase->compileTail( p );
+    p.patch( toFalse, p.size() );
+    falseCase->compileTail( p );
+}
+
+void Conditional::findCalls( set<string> &names ) const
+{
+    test->findCalls( names );
+    trueCase->findCalls( names );
+    falseCase->findCalls( names );
+}
+
+void Conditional::resolve( VarTree &scope )
+{
+    test->resolve( scope );
+    trueCase->resolve( scope );
+    falseCase->resolve( scope );
+}
+
+void Conditional::findVariables( set<int> &used, set<int> &assigned ) const
+{
+    test->findVariables( used, assigned );
+    trueCase->findVariables( used, assigned );
+    falseCase->findVariables( used, assigned );
 }
 
 string Functional::toString() const
@@ -149,18 +284,192 @@ string Functional::toLispString() const
     return print;
 }
 
-int Functional::evaluate( VarTree &v ) const
+//  bindArguments
+//  Evaluate the arguments for a call, in the caller's variables
+//  Parameters:
+//	v	(modified VarTree)	caller's variables
+//	f	(input FunDef)		function being called
+//	args	(output Integer array)	one value per parameter
+//  Returns:				number of parameters
+int Functional::bindArguments( Integer *v, CallStack &calls, FunDef *f, Integer args[] ) const
 {
-    FunDef *temp_func = &funcs->find(name)->second;
-    VarTree temp_var;
-    
-	for (int i = 0; temp_func->parameter[i] != "" && i < 10; i++)
+    int count;
+	for (count = 0; count < 10 && f->parameter[count] != ""; count++)
     {
-		if (para_list[i] == NULL)
-			temp_var.assign(temp_func->parameter[i], 0);
+		if (para_list[count] == NULL)
+			args[count] = Integer();
 		else
-			temp_var.assign(temp_func->parameter[i], para_list[i]->evaluate(v));
+			args[count] = para_list[count]->evaluate(v, calls);
+    }
+    return count;
+}
+
+//  The arguments are bound to the parameters in a new frame,
+//  laid out as described by the function's locals.
+//  A pure function first checks whether it has seen them before.
+//  Whenever the body ends in another call, that call replaces
+//  this frame rather than nesting deeper, so that tail recursion
+//  runs in constant space.
+Integer Functional::evaluate( Integer *v, CallStack &calls ) const
+{
+    FunDef *f = &funcs->find(name)->second;
+    Integer *args = calls.push(10);	// (not on the native stack, either)
+    Integer result;
+    int count;
+    
+    count = bindArguments(v, calls, f, args);
+    if (profiler != NULL)
+        result = invoke<true>(f, args, count, calls);
+    else
+        result = invoke<false>(f, args, count, calls);
+    calls.pop(args);
+    return result;
+}
+
+//  callWith
+//  Call the function with arguments that have already been
+//  evaluated (one per argument expression, in order)
+Integer Functional::callWith( const Integer values[], CallStack &calls ) const
+{
+    FunDef *f = &funcs->find(name)->second;
+    Integer args[10];
+    int count;
+    
+    for (count = 0; count < 10 && f->parameter[count] != ""; count++)
+        args[count] = para_list[count] == NULL ? Integer() : values[count];
+    if (profiler != NULL)
+        return invoke<true>(f, args, count, calls);
+    return invoke<false>(f, args, count, calls);
+}
+
+//  invoke
+//  Evaluate the body of a function for the given arguments
+template <bool Profiled>
+Integer Functional::invoke( FunDef *f, Integer args[], int count, CallStack &calls ) const
+{
+    FunDef *temp_func = f;
+    const Functional *call;
+    Integer result;
+    
+    if (f->builtin != NULL)
+        return f->builtin->compute(args);	// (neither cached nor profiled)
+    decoded(*f);			// (if loaded, and not called before)
+    if (Profiled)
+        profiler->enter(*f);
+    if (f->pure && memoFor(f)->find(args, count, result))
+    {
+        if (Profiled)
+            profiler->leave();
+        return result;
+    }
+    // The arguments are remembered for the cache on the call stack,
+    // leaving the native stack all the room it can have for recursion
+    Integer *first = NULL;
+    int firstCount = count;
+    if (temp_func->pure)
+    {
+        first = calls.push(count);
+        for (int i = 0; i < count; i++)
+            first[i] = args[i];
+    }
+    
+    Integer *frame = calls.push(f->locals->size());
+    bool abandoned = false;
+    for (;;)
+    {
+        if (!Profiled && nativeReady(*f, *funcs))
+        {
+            if (f->native->run(args, count, calls, result))
+                break;
+            abandoned = true;		// walk the rest of it instead
+            nativeSuspended++;
+        }
+        for (int i = 0; i < count; i++)
+            frame[i] = args[i];		// parameters come first
+        if (Profiled)
+            profiler->evaluating(*f);
+        result = f->functionBody->evaluateTail(frame, calls, call);
+        if (call == NULL)
+            break;
+        f = &funcs->find(call->name)->second;
+        decoded(*f);
+        count = call->bindArguments(frame, calls, f, args);
+        if (f->builtin != NULL)
+        {
+            result = f->builtin->compute(args);
+            break;
+        }
+        if (Profiled)
+        {
+            profiler->leave();		// the call replaces this one
+            profiler->enter(*f);
+        }
+        if (f->pure && memoFor(f)->find(args, count, result))
+            break;
+        calls.pop(frame);
+        frame = calls.push(f->locals->size());
     }
+    calls.pop(frame);
+    if (abandoned)
+        nativeSuspended--;
     
-    return temp_func->functionBody->evaluate(temp_var);
+    if (temp_func->pure)
+    {
+        memoFor(temp_func)->insert(first, firstCount, result);
+        calls.pop(first);
+    }
+    if (Profiled)
+        profiler->leave();
+    return result;
+}
+
+//  Arguments are pushed in order, and the machine will bind
+//  them to the parameters when the call is made
+void Functional::compile( Program &p ) const
+{
+    int count = 0;
+    for (int i = 0; i < 10 && para_list[i] != NULL; i++)
+    {
+	para_list[i]->compile( p );
+	count++;
+    }
+    p.emit( CALL, p.addName( name ), count );
+}
+
+void Functional::findCalls( set<string> &names ) const
+{
+    names.insert( name );
+    for (int i = 0; i < 10 && para_list[i] != NULL; i++)
+	para_list[i]->findCalls( names );
+}
+
+Integer Functional::evaluateTail( Integer *, CallStack &, const Functional *&call ) const
+{
+    call = this;
+    return Integer();
+}
+
+//  The machine will reuse the current call for this one
+void Functional::compileTail( Program &p ) const
+{
+    int count = 0;
+    for (int i = 0; i < 10 && para_list[i] != NULL; i++)
+    {
+	para_list[i]->compile( p );
+	count++;
+    }
+    p.emit( TAILCALL, p.addName( name ), count );
+}
+
+void Functional::resolve( VarTree &scope )
+{
+    for (int i = 0; i < 10 && para_list[i] != NULL; i++)
+	para_list[i]->resolve( scope );
+}
+
+//  (whatever the function itself does is in variables of its own)
+void Functional::findVariables( set<int> &used, set<int> &assigned ) const
+{
+    for (int i = 0; i < 10 && para_list[i] != NULL; i++)
+	para_list[i]->findVariables( used, assigned );
 }
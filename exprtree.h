@@ -2,34 +2,161 @@
 //  Describes the elements of an expression tree, using
 //  derived classes to represent polymorphism.
 //  All objects in this structure are immutable --
-//  once constructed, they are never changed.
+//  once constructed and resolved, they are never changed.
 //  They only be displayed or evaluated.
+//
+//  Resolving binds every variable to a slot: its id within the
+//  VarTree describing the scope it appears in.  At evaluation,
+//  the variables of that scope are just an array indexed by slot,
+//  and function calls obtain their own arrays from a CallStack.
+//
+//  Every node is allocated within an Arena (see arena.h),
+//  with the expression  new (arena) Value(1),  and is destroyed
+//  only when that arena is released.
+//
+//  Every pass over a tree recurses from a node into its operands,
+//  which is why no tree is nested more deeply than MaxDepth
+//  (see evaluate.h).
 #ifndef EXPRTREE
 #define EXPRTREE
 
 #include "vartree.h"
 #include "funmap.h"
+#include "token.h"
+#include "arena.h"
+#include "callstack.h"
+
+class Program;				// bytecode, see bytecode.h
+class Functional;
+class Subexpressions;			// see cse.h
+class ColumnPlan;			// see columns.h
+class NativeBuilder;			// see jit.h
+class SnapshotWriter;			// see snapshot.h
 
 class ExprNode
 {
+    protected:
+    size_t shape;			// equal for trees that are the same
+
+    // mix
+    // Combine one more item into a shape
+    static size_t mix( size_t h, size_t item )
+    {
+	return (h ^ item) * 0x100000001b3ULL + (h >> 29);
+    }
+    static size_t shapeOf( const ExprNode *e )
+    {
+	return e == NULL ? 0 : e->shape;
+    }
+
     public:
+    void *operator new( size_t size, Arena &a )
+    {
+	return a.allocate( size );
+    }
+    void operator delete( void *, Arena & )	// only if a constructor fails
+    {
+    }
+    void operator delete( void * )		// the arena owns the memory
+    {
+    }
+    virtual ~ExprNode()
+    {
+    }
+
     friend ostream& operator<<( ostream&, const ExprNode & );
     virtual string toLispString() const = 0;
     virtual string toString() const = 0;	// facilitates << operator
-    virtual int evaluate( VarTree &v ) const = 0;  // evaluate this node
+    virtual Integer evaluate( Integer *v, CallStack &calls ) const = 0;  // evaluate this node
+    virtual void compile( Program &p ) const = 0;  // append bytecode for this node
+    virtual int vectorize( ColumnPlan &plan ) const = 0;  // add to a columnar plan
+    virtual void findCalls( set<string> & /*names*/ ) const	// names of functions called
+    {
+    }
+    virtual void findVariables( set<int> & /*used*/, set<int> & /*assigned*/ ) const
+    {						// (by slot, once resolved)
+    }
+    virtual void resolve( VarTree & /*scope*/ )	// bind variables to slots
+    {
+    }
+
+    // Simplifying produces an equivalent tree that does less work
+    // (see simplify.cpp).  Nodes are not changed; any that differ
+    // are rebuilt in the given arena.
+    virtual ExprNode *simplify( Arena & /*a*/ )
+    {
+	return this;
+    }
+    virtual bool constant( Integer & /*value*/ ) const	// whether known before evaluating
+    {
+	return false;
+    }
+    virtual bool sideEffectFree() const		// whether it may go unevaluated
+    {
+	return false;
+    }
+    virtual int nodeCount() const		// size of the tree
+    {
+	return 1;
+    }
+
+    // Subexpressions that are evaluated more than once are found
+    // by their shape, and compared node for node (see cse.cpp).
+    // Eliminating one replaces it by a temporary variable.
+    size_t shapeHash() const
+    {
+	return shape;
+    }
+    virtual bool same( const ExprNode &e ) const = 0;
+    virtual ExprNode *eliminate( Subexpressions & /*cse*/, bool &shareable )
+    {
+	shareable = true;		// for a value or a variable
+	return this;
+    }
+
+    // A function call in tail position need not be evaluated here --
+    // it is handed back to the caller, which can reuse its own
+    // variables for it instead of nesting another call.
+    virtual Integer evaluateTail( Integer *v, CallStack &calls, const Functional *&call ) const
+    {
+	call = NULL;
+	return evaluate( v, calls );
+    }
+    virtual void compileTail( Program &p ) const;	// compile, then return
+
+    // A hot function body is translated to machine code (see jit.cpp);
+    // this fails for anything that cannot be translated
+    virtual bool native( NativeBuilder &b ) const = 0;
+    virtual bool nativeTail( NativeBuilder &b ) const;	// translate, then return
+
+    // A function body is saved in a snapshot node by node
+    // (see snapshot.cpp), and decoded again when first called
+    virtual void save( SnapshotWriter &w ) const = 0;
 };
 
 class Value: public ExprNode
 {
     private:
-	int value;
+	Integer value;			// (a copy of its own, if large)
     public:
 	string toString() const;	// facilitates << operator
     string toLispString() const;
-	int evaluate( VarTree &v ) const;
-	Value(int v)
+	Integer evaluate( Integer *v, CallStack &calls ) const;
+	void compile( Program &p ) const;
+	int vectorize( ColumnPlan &plan ) const;
+	bool native( NativeBuilder &b ) const;
+	void save( SnapshotWriter &w ) const;
+	bool constant( Integer &v ) const;
+	bool sideEffectFree() const;
+	bool same( const ExprNode &e ) const;
+	Value(Integer v)
+	{
+	    value = v.keep();
+	    shape = mix( 1, v.hash() );
+	}
+	~Value()
 	{
-	    value = v;
+	    value.discard();
 	}
 };
 
@@ -37,30 +164,116 @@ class Variable: public ExprNode
 {
     private:
 	string name;
+	int slot;			// where its value is kept
     public:
 	string toString() const ;	// facilitates << operator
     string toLispString() const;
-	int evaluate( VarTree &v ) const;
+	Integer evaluate( Integer *v, CallStack &calls ) const;
+	void compile( Program &p ) const;
+	int vectorize( ColumnPlan &plan ) const;
+	bool native( NativeBuilder &b ) const;
+	void save( SnapshotWriter &w ) const;
+	void findVariables( set<int> &used, set<int> &assigned ) const;
+	void resolve( VarTree &scope );
+	bool sideEffectFree() const;
+	bool same( const ExprNode &e ) const;
 	Variable(string var)
 	{
 	    name = var;
+	    slot = -1;
+	    shape = mix( 2, hash<string>()( var ) );
 	}
 };
 
+// An operation applies a binary operator to two operands.
+// Each operator has its own derived class (below), so that
+// evaluating a node never has to ask which operator it holds.
 class Operation: public ExprNode
 {
-    private:
-	string oper;
+    protected:
+	OpKind oper;
 	ExprNode *left, *right;	 // operands
+
+	static ExprNode *combine( Arena &a, ExprNode *l, OpKind o, ExprNode *r );
     public:
 	string toString() const;	// facilitates << operator
     string toLispString() const;
-	int evaluate( VarTree &v ) const;
-	Operation( ExprNode *l, string o, ExprNode *r )
+	void compile( Program &p ) const;
+	int vectorize( ColumnPlan &plan ) const;
+	bool native( NativeBuilder &b ) const;
+	void save( SnapshotWriter &w ) const;
+	void findCalls( set<string> &names ) const;
+	void findVariables( set<int> &used, set<int> &assigned ) const;
+	void resolve( VarTree &scope );
+	ExprNode *simplify( Arena &a );
+	bool sideEffectFree() const;
+	int nodeCount() const;
+	bool same( const ExprNode &e ) const;
+	ExprNode *eliminate( Subexpressions &cse, bool &shareable );
+	Operation( ExprNode *l, OpKind o, ExprNode *r )
 	{
 	    left = l;
 	    right = r;
 	    oper = o;
+	    shape = mix( mix( mix( 3, o ), shapeOf( l ) ), shapeOf( r ) );
+	}
+
+	// make
+	// Construct the node class appropriate to the operator
+	static Operation *make( Arena &a, ExprNode *l, OpKind o, ExprNode *r );
+};
+
+// apply
+// The arithmetic or comparison performed by one operator
+template <OpKind K> inline Integer apply( Integer l, Integer r );
+template <> inline Integer apply<PLUS>( Integer l, Integer r )	{ return l + r; }
+template <> inline Integer apply<MINUS>( Integer l, Integer r )	{ return l - r; }
+template <> inline Integer apply<TIMES>( Integer l, Integer r )	{ return l * r; }
+template <> inline Integer apply<DIVIDE>( Integer l, Integer r )	{ return l / r; }
+template <> inline Integer apply<MODULO>( Integer l, Integer r )	{ return l % r; }
+template <> inline Integer apply<LESS_EQ>( Integer l, Integer r )	{ return Integer( l <= r ); }
+template <> inline Integer apply<GREATER_EQ>( Integer l, Integer r ) { return Integer( l >= r ); }
+template <> inline Integer apply<LESS>( Integer l, Integer r )	{ return Integer( l < r ); }
+template <> inline Integer apply<GREATER>( Integer l, Integer r )	{ return Integer( l > r ); }
+template <> inline Integer apply<EQUAL>( Integer l, Integer r )	{ return Integer( l == r ); }
+template <> inline Integer apply<NOT_EQUAL>( Integer l, Integer r ) { return Integer( l != r ); }
+
+// An arithmetic or comparison operation, specialized by operator.
+// The left operand is always evaluated before the right.
+template <OpKind K>
+class BinaryOp: public Operation
+{
+    public:
+	Integer evaluate( Integer *v, CallStack &calls ) const
+	{
+	    Integer l = left->evaluate(v, calls);
+	    return apply<K>( l, right->evaluate(v, calls) );
+	}
+	BinaryOp( ExprNode *l, ExprNode *r ) : Operation( l, K, r )
+	{
+	}
+};
+
+// An assignment evaluates only its right side, and stores
+// the result in the variable named by its left side.
+class Assignment: public Operation
+{
+    private:
+	int slot;			// where the result is stored
+    public:
+    string toLispString() const;
+	Integer evaluate( Integer *v, CallStack &calls ) const;
+	void compile( Program &p ) const;
+	int vectorize( ColumnPlan &plan ) const;
+	bool native( NativeBuilder &b ) const;
+	void findVariables( set<int> &used, set<int> &assigned ) const;
+	void resolve( VarTree &scope );
+	ExprNode *simplify( Arena &a );
+	bool sideEffectFree() const;
+	ExprNode *eliminate( Subexpressions &cse, bool &shareable );
+	Assignment( ExprNode *l, ExprNode *r ) : Operation( l, ASSIGN, r )
+	{
+	    slot = -1;
 	}
 };
 
@@ -71,12 +284,28 @@ class Conditional: public ExprNode
     public:
 	string toString() const;	// facilitates << operator
     string toLispString() const;
-	int evaluate( VarTree &v ) const;
+	Integer evaluate( Integer *v, CallStack &calls ) const;
+	void compile( Program &p ) const;
+	int vectorize( ColumnPlan &plan ) const;
+	void findCalls( set<string> &names ) const;
+	void findVariables( set<int> &used, set<int> &assigned ) const;
+	Integer evaluateTail( Integer *v, CallStack &calls, const Functional *&call ) const;
+	void compileTail( Program &p ) const;
+	bool native( NativeBuilder &b ) const;
+	bool nativeTail( NativeBuilder &b ) const;
+	void save( SnapshotWriter &w ) const;
+	void resolve( VarTree &scope );
+	ExprNode *simplify( Arena &a );
+	bool sideEffectFree() const;
+	int nodeCount() const;
+	bool same( const ExprNode &e ) const;
+	ExprNode *eliminate( Subexpressions &cse, bool &shareable );
 	Conditional( ExprNode *b, ExprNode *t, ExprNode *f)
 	{
 	    test = b;
 	    trueCase = t;
 	    falseCase = f;
+	    shape = mix( mix( mix( 4, shapeOf( b ) ), shapeOf( t ) ), shapeOf( f ) );
 	}
 };
 
@@ -86,15 +315,38 @@ class Functional: public ExprNode
 	string name;
     ExprNode *para_list[10];
     FunctionDef *funcs;
+	int bindArguments( Integer *v, CallStack &calls, FunDef *f, Integer args[] ) const;
+	template <bool Profiled>	// (see profile.h)
+	Integer invoke( FunDef *f, Integer args[], int count, CallStack &calls ) const;
+	FunDef *pushArguments( NativeBuilder &b ) const;
 	public:
 	string toString() const;	// faciliatates << operator
 	string toLispString() const;
-	int evaluate( VarTree &v ) const;
+	Integer evaluate( Integer *v, CallStack &calls ) const;
+	Integer callWith( const Integer values[], CallStack &calls ) const;
+	void compile( Program &p ) const;
+	int vectorize( ColumnPlan &plan ) const;
+	void findCalls( set<string> &names ) const;
+	void findVariables( set<int> &used, set<int> &assigned ) const;
+	Integer evaluateTail( Integer *v, CallStack &calls, const Functional *&call ) const;
+	void compileTail( Program &p ) const;
+	bool native( NativeBuilder &b ) const;
+	bool nativeTail( NativeBuilder &b ) const;
+	void save( SnapshotWriter &w ) const;
+	void resolve( VarTree &scope );
+	ExprNode *simplify( Arena &a );
+	int nodeCount() const;
+	bool same( const ExprNode &e ) const;
+	ExprNode *eliminate( Subexpressions &cse, bool &shareable );
 	Functional(string n, ExprNode *p[10], FunctionDef *fs)
 	{
 		name = n;
+        shape = mix( 5, hash<string>()( n ) );
         for (int i = 0; i < 10; i++)
+        {
             para_list[i] = p[i];
+            shape = mix( shape, shapeOf( p[i] ) );
+        }
         funcs = fs;
 	}
 };
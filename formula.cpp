@@ -0,0 +1,225 @@
+// Formula Implementation File
+// The graph is kept as two lists for each variable:  the variables
+// its formula uses, and the formulas that use it.
+//
+// Searching depth first from the variables that changed, following
+// the formulas that use each, lists every formula reached only after
+// everything reached from it.  Read backwards, then, the list has
+// each formula before any formula using it, which is the order to
+// evaluate them in.  The search keeps a stack of its own, so that a
+// long chain of formulas cannot exhaust the native stack.
+//
+// New formulas are allocated together in an arena until it grows
+// large, and then in a new one; each formula holds a reference to
+// its arena, so an arena is released once none of its formulas are
+// still bound.
+#include <algorithm>
+#include "formula.h"
+#include "exprtree.h"
+#include "vartree.h"
+#include "arena.h"
+
+const size_t ArenaBytes = 1 << 16;	// for formulas, before another arena
+
+Formulas::Formulas()
+{
+    count = 0;
+    current = NULL;
+}
+
+Formulas::~Formulas()
+{
+    for (unsigned id = 0; id < bound.size(); id++)
+	if (bound[id].root != NULL)
+	    bound[id].arena->release();
+    if (current != NULL)
+	current->release();
+}
+
+//  grow
+//  Make room for a variable of the given id
+//  (a new entry is value-initialized, and so bound to nothing)
+void Formulas::grow( int id )
+{
+    if (id < (int) bound.size())
+	return;
+    bound.resize( id + 1 );
+    dependents.resize( id + 1 );
+    visited.resize( id + 1, 0 );
+    changed.resize( id + 1, 0 );
+}
+
+Arena &Formulas::arena()
+{
+    if (current == NULL || current->bytes() >= ArenaBytes)
+    {
+	if (current != NULL)
+	    current->release();
+	current = new Arena();
+    }
+    return *current;
+}
+
+//  downstream
+//  List everything reached from some variables, through the formulas
+//  using them, each after everything reached from it, and mark them
+//  visited (which the caller clears again)
+void Formulas::downstream( const vector<int> &from )
+{
+    order.clear();
+    for (unsigned i = 0; i < from.size(); i++)
+    {
+	if (visited[from[i]])
+	    continue;
+	visited[from[i]] = 1;
+	stack.push_back( from[i] );
+	next.push_back( 0 );
+	while (!stack.empty())
+	{
+	    const vector<int> &users = dependents[stack.back()];
+	    if (next.back() < users.size())
+	    {
+		int user = users[next.back()++];
+		if (!visited[user])
+		{
+		    visited[user] = 1;
+		    stack.push_back( user );
+		    next.push_back( 0 );
+		}
+	    }
+	    else
+	    {
+		order.push_back( stack.back() );
+		stack.pop_back();
+		next.pop_back();
+	    }
+	}
+    }
+}
+
+//  unbind
+//  Forget the formula a variable is bound to, leaving its value
+void Formulas::unbind( int id )
+{
+    Formula &f = bound[id];
+    for (unsigned i = 0; i < f.inputs.size(); i++)
+    {
+	vector<int> &users = dependents[f.inputs[i]];
+	vector<int>::iterator u = find( users.begin(), users.end(), id );
+	*u = users.back();
+	users.pop_back();
+    }
+    f.inputs.clear();
+    f.arena->release();
+    f.root = NULL;
+    f.arena = NULL;
+    count--;
+}
+
+//  recompute
+//  Evaluate again, in order, every formula downstream of variables
+//  that have changed, if anything it uses has changed its value
+void Formulas::recompute( const vector<int> &from, VarTree &vars, CallStack &calls )
+{
+    for (unsigned i = 0; i < from.size(); i++)
+	changed[from[i]] = 1;
+    downstream( from );
+    try
+    {
+	for (size_t i = order.size(); i-- > 0; )
+	{
+	    int id = order[i];
+	    Formula &f = bound[id];
+	    if (f.root == NULL || changed[id])
+		continue;			// (one that changed to begin with)
+	    bool dirty = false;
+	    for (unsigned j = 0; j < f.inputs.size() && !dirty; j++)
+		dirty = changed[f.inputs[j]];
+	    if (!dirty)
+		continue;
+	    Integer value = f.root->evaluate( vars.slots(), calls );
+	    if (value != vars.value( id ))
+	    {
+		vars.value( id ) = value;
+		vars.settle( id );
+		changed[id] = 1;
+	    }
+	}
+    }
+    catch (DivisionByZero &)
+    {
+	for (unsigned i = 0; i < order.size(); i++)
+	    visited[order[i]] = changed[order[i]] = 0;
+	throw;
+    }
+    for (unsigned i = 0; i < order.size(); i++)
+	visited[order[i]] = changed[order[i]] = 0;
+}
+
+bool Formulas::bind( int id, ExprNode *root, VarTree &vars, CallStack &calls,
+		     string &why )
+{
+    set<int> used, assigned;
+    root->findVariables( used, assigned );
+    if (!assigned.empty())
+    {
+	why = "a formula may not assign variables";
+	return false;
+    }
+    grow( used.empty() ? id : max( id, *used.rbegin() ) );
+
+    // Nothing downstream of the variable may be used by its formula
+    vector<int> from( 1, id );
+    downstream( from );
+    bool circular = false;
+    for (set<int>::iterator u = used.begin(); u != used.end(); u++)
+	circular = circular || visited[*u];
+    for (unsigned i = 0; i < order.size(); i++)
+	visited[order[i]] = 0;
+    if (circular)
+    {
+	why = "a formula may not depend on its own variable";
+	return false;
+    }
+
+    Integer value = root->evaluate( vars.slots(), calls );	// (before binding)
+    if (bound[id].root != NULL)
+	unbind( id );
+    Formula &f = bound[id];
+    f.root = root;
+    f.arena = current;
+    current->retain();
+    f.inputs.assign( used.begin(), used.end() );
+    for (unsigned i = 0; i < f.inputs.size(); i++)
+	dependents[f.inputs[i]].push_back( id );
+    count++;
+
+    vars.value( id ) = value;
+    vars.settle( id );
+    recompute( from, vars, calls );
+    return true;
+}
+
+void Formulas::update( const set<int> &assigned, VarTree &vars, CallStack &calls )
+{
+    vector<int> from;
+    for (set<int>::const_iterator a = assigned.begin(); a != assigned.end(); a++)
+	if (*a < (int) bound.size())	// (nothing uses any others)
+	{
+	    if (bound[*a].root != NULL)
+		unbind( *a );		// it holds a value of its own now
+	    from.push_back( *a );
+	}
+    if (!from.empty())
+	recompute( from, vars, calls );
+}
+
+void Formulas::report( ostream &out, VarTree &vars ) const
+{
+    if (count == 0)
+	out << "no formulas" << endl;
+    for (unsigned id = 0; id < bound.size(); id++)
+	if (bound[id].root != NULL)
+	    out << vars.name( id ) << " := " << *bound[id].root
+		<< " = " << vars.value( id ) << endl;
+}
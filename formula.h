@@ -0,0 +1,98 @@
+// Formula Header File
+// A variable may be bound to a formula rather than to a value,
+// as a spreadsheet cell is:
+//	total := price * count
+// The variable then always holds the value of its formula.  Whenever
+// an expression assigns a variable that formulas use, those formulas
+// are evaluated again, and so on for the formulas using theirs, each
+// only after every formula it uses (in topological order).  Only the
+// formulas downstream of what changed are ever visited, and one is
+// not evaluated again unless something it uses changed its value,
+// so the work follows the part of the graph affected, not its size.
+//
+// A formula may not assign variables, nor use its own variable,
+// however indirectly.  Assigning a value to a variable bound to a
+// formula unbinds it.  Formulas are evaluated by walking the tree;
+// redefining a function they call does not evaluate them again.
+//
+// A formula that divides by zero as it is bound is not bound.  One
+// that divides by zero when evaluated again abandons the expression
+// that changed what it uses (see evaluate.h); it, and the formulas
+// after it, keep their old values until something they use changes.
+#ifndef FORMULA
+#define FORMULA
+
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+class ExprNode;
+class VarTree;
+class CallStack;
+class Arena;
+
+class Formulas
+{
+    private:
+	struct Formula
+	{
+	    ExprNode   *root;		// NULL if the variable is not bound
+	    Arena      *arena;		// where root was allocated
+	    vector<int> inputs;		// the variables it uses
+	};
+	vector<Formula>	    bound;	// by variable id
+	vector<vector<int>> dependents;	// formulas using each variable, by id
+	int		    count;	// variables bound
+	Arena		   *current;	// where new formulas are allocated
+
+	// For finding what is downstream (see formula.cpp)
+	vector<char>	    visited, changed;	// by variable id
+	vector<int>	    order, stack;
+	vector<size_t>	    next;
+
+	void grow( int id );
+	void downstream( const vector<int> &from );
+	void unbind( int id );
+	void recompute( const vector<int> &from, VarTree &vars, CallStack &calls );
+    public:
+	Formulas();
+	Formulas( const Formulas & ) = delete;
+	~Formulas();
+
+	bool empty() const		// whether nothing is bound
+	{
+	    return count == 0;
+	}
+
+	// arena
+	// Where a formula about to be bound is to be allocated
+	Arena &arena();
+
+	// bind
+	// Bind a variable to a formula, and evaluate it (and everything
+	// using the variable)
+	// Parameters:
+	//	id	(input int)		variable to bind
+	//	root	(input ExprNode)	formula, resolved in vars and
+	//					allocated in arena()
+	//	vars	(modified VarTree)	variables it uses
+	//	calls	(modified CallStack)	for evaluating it
+	//	why	(output string)		if it cannot be bound, why not
+	// Returns:				whether it was bound
+	bool bind( int id, ExprNode *root, VarTree &vars, CallStack &calls,
+		   string &why );
+
+	// update
+	// After an expression has assigned some variables, unbind any of
+	// them bound to formulas, and evaluate again every formula that
+	// depends on them
+	void update( const set<int> &assigned, VarTree &vars, CallStack &calls );
+
+	// report
+	// Display every variable bound to a formula
+	void report( ostream &out, VarTree &vars ) const;
+};
+
+#endif
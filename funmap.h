@@ -7,15 +7,35 @@
 #define FUNMAP
 
 #include <map>
+#include <set>
+#include <string>
+using namespace std;
 
 class ExprNode;				// declaring class names
 class VarTree;				// for use below
+class Program;
+class MemoCache;
+class Arena;
+class NativeCode;
+struct StoredBody;
+struct BuiltinFunction;
 struct FunDef
 {
     string	name;			// name of the function
     string	parameter[10];		// parameter list
-    VarTree    *locals;			// parameters and local variables
+    VarTree    *locals;			// slots for parameters, then local variables
     ExprNode   *functionBody;		// code for the function
+    ExprNode   *parsedBody;		// the body before simplifying
+    Arena      *arena;			// where functionBody was allocated
+    Program    *code;			// function body compiled to bytecode
+    set<string> callees;		// functions called by the body
+    bool	pure;			// whether results may be cached
+    MemoCache  *memo;			// previous results, NULL until called (see memo.h)
+    int		number;			// order of first definition
+    NativeCode *native;			// machine code, once hot (see jit.h)
+    long	calls;			// body evaluations until then (-1 if never)
+    StoredBody *stored;			// body as loaded, NULL if never (see snapshot.h)
+    const BuiltinFunction *builtin;	// computed instead, NULL if not (see builtins.h)
 };
 
 typedef map<string, struct FunDef> FunctionDef;
@@ -0,0 +1,61 @@
+// Heap Allocation Counter Implementation File
+// When counting, replaces the global allocation functions with
+// versions that count before passing the request on to malloc.
+// Each thread counts its own, so that threads never contend for
+// the count.
+#include <new>
+#include <stdlib.h>
+#include "heapcount.h"
+using namespace std;
+
+#ifndef COUNT_ALLOCATIONS
+
+long heapAllocations()
+{
+    return 0;
+}
+
+#else
+
+static thread_local long allocations = 0;
+
+long heapAllocations()
+{
+    return allocations;
+}
+
+void *operator new( size_t size )
+{
+    allocations++;
+    void *p = malloc( size == 0 ? 1 : size );
+    if (p == NULL)
+	throw bad_alloc();
+    return p;
+}
+
+void *operator new[]( size_t size )
+{
+    return operator new( size );
+}
+
+void operator delete( void *p ) noexcept
+{
+    free( p );
+}
+
+void operator delete[]( void *p ) noexcept
+{
+    free( p );
+}
+
+void operator delete( void *p, size_t ) noexcept
+{
+    free( p );
+}
+
+void operator delete[]( void *p, size_t ) noexcept
+{
+    free( p );
+}
+
+#endif
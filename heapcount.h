@@ -0,0 +1,30 @@
+// Heap Allocation Counter Header File
+// In a build with COUNT_ALLOCATIONS defined (the test program is one),
+// every allocation made through operator new, anywhere in the
+// program, is counted.  The number of allocations made by some
+// piece of work is then the difference between the count before
+// and the count after (on the same thread).
+//
+// Counting means replacing the global allocation functions, which a
+// program merely using the interpreter (a server, say) should not
+// have done to it; so any other build counts nothing.
+#ifndef HEAPCOUNT
+#define HEAPCOUNT
+
+// countingAllocations
+// Whether allocations are counted in this build
+inline bool countingAllocations()
+{
+#ifdef COUNT_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+// heapAllocations
+// The number of heap allocations made so far by the running thread
+// (always 0 unless they are counted)
+long heapAllocations();
+
+#endif
@@ -0,0 +1,492 @@
+// Integer Implementation File
+// A large value is a sign and a magnitude:  an array of 32-bit limbs,
+// least significant first, whose most significant limb is not zero.
+// The general operations work on magnitudes in vectors of limbs, and
+// then make the result into an Integer, which is small if it fits.
+//
+// Multiplication is done the schoolbook way for short operands, and
+// by Karatsuba's method for long ones:  splitting each operand in
+// halves, three half-length products take the place of four.
+// Division is Knuth's Algorithm D, a limb of the quotient at a time.
+#include <algorithm>
+#include <vector>
+#include <new>
+#include <stddef.h>
+#include "integer.h"
+
+struct Bignum
+{
+    bool     negative;
+    int	     size;		// number of limbs
+    uint32_t limb[1];		// (actually size of them)
+};
+
+typedef vector<uint32_t> Limbs;
+
+const int KaratsubaThreshold = 32;	// limbs in the shorter operand
+
+// The temporaries made by each thread, freed all at once
+struct Temporaries
+{
+    vector<Bignum *> made;
+
+    ~Temporaries()
+    {
+	for (size_t i = 0; i < made.size(); i++)
+	    ::operator delete( made[i] );
+    }
+};
+static thread_local Temporaries temporaries;
+
+//  allocate
+//  Room for a large value of the given size
+static Bignum *allocate( int size, bool kept )
+{
+    Bignum *b = (Bignum *) ::operator new( offsetof( Bignum, limb ) +
+					   size * sizeof(uint32_t) );
+    b->size = size;
+    if (!kept)
+	temporaries.made.push_back( b );
+    return b;
+}
+
+void Integer::releaseTemporaries()
+{
+    vector<Bignum *> &made = temporaries.made;
+    for (size_t i = 0; i < made.size(); i++)
+	::operator delete( made[i] );
+    made.clear();
+}
+
+Integer Integer::copy( bool kept ) const
+{
+    const Bignum *from = big();
+    Bignum *b = allocate( from->size, kept );
+    b->negative = from->negative;
+    copy_n( from->limb, from->size, b->limb );
+    return fromWord( (intptr_t) b + 1 );
+}
+
+void Integer::release() const
+{
+    ::operator delete( (void *) big() );
+}
+
+// Operand
+// The sign and magnitude of any Integer, without copying a large one
+struct Operand
+{
+    const uint32_t *limb;
+    int		    size;
+    bool	    negative;
+    uint32_t	    own[2];		// the limbs of a small value
+
+    Operand( Integer i )
+    {
+	if (i.isSmall())
+	{
+	    long v = i.small();
+	    negative = v < 0;
+	    unsigned long m = negative ? -(unsigned long) v : v;
+	    own[0] = (uint32_t) m;
+	    own[1] = (uint32_t) (m >> 32);
+	    size = own[1] != 0 ? 2 : own[0] != 0 ? 1 : 0;
+	    limb = own;
+	}
+	else
+	{
+	    const Bignum *b = i.big();
+	    negative = b->negative;
+	    size = b->size;
+	    limb = b->limb;
+	}
+    }
+    Operand( const Operand & ) = delete;
+};
+
+Integer Integer::make( bool negative, Limbs &m )
+{
+    while (!m.empty() && m.back() == 0)
+	m.pop_back();
+    if (m.size() <= 2)
+    {
+	unsigned long v = m.empty() ? 0 : m[0] | (m.size() > 1 ? (unsigned long) m[1] << 32 : 0);
+	if (v <= (unsigned long) SmallMax)
+	    return Integer( negative ? -(long) v : (long) v );
+	if (negative && v == (unsigned long) SmallMax + 1)
+	    return Integer( SmallMin );
+    }
+    Bignum *b = allocate( m.size(), false );
+    b->negative = negative;
+    std::copy( m.begin(), m.end(), b->limb );
+    return fromWord( (intptr_t) b + 1 );
+}
+
+//  compareMagnitudes
+//  Negative, zero or positive as a is less than, equal to,
+//  or greater than b
+static int compareMagnitudes( const uint32_t *a, int n, const uint32_t *b, int m )
+{
+    if (n != m)
+	return n < m ? -1 : 1;
+    for (int i = n - 1; i >= 0; i--)
+	if (a[i] != b[i])
+	    return a[i] < b[i] ? -1 : 1;
+    return 0;
+}
+
+//  addMagnitudes, subtractMagnitudes
+//  The sum, or the difference (a must be at least b)
+static Limbs addMagnitudes( const uint32_t *a, int n, const uint32_t *b, int m )
+{
+    if (n < m)
+    {
+	swap( a, b );
+	swap( n, m );
+    }
+    Limbs sum( n + 1 );
+    uint64_t carry = 0;
+    for (int i = 0; i < n; i++)
+    {
+	carry += (uint64_t) a[i] + (i < m ? b[i] : 0);
+	sum[i] = (uint32_t) carry;
+	carry >>= 32;
+    }
+    sum[n] = (uint32_t) carry;
+    return sum;
+}
+
+static Limbs subtractMagnitudes( const uint32_t *a, int n, const uint32_t *b, int m )
+{
+    Limbs difference( n );
+    int64_t borrow = 0;
+    for (int i = 0; i < n; i++)
+    {
+	int64_t t = (int64_t) a[i] - (i < m ? b[i] : 0) - borrow;
+	borrow = t < 0;
+	difference[i] = (uint32_t) (t + (borrow << 32));
+    }
+    return difference;
+}
+
+//  addInto, subtractFrom
+//  out += a, or out -= a, within out's n limbs
+static void addInto( uint32_t *out, int n, const uint32_t *a, int m )
+{
+    while (m > 0 && a[m - 1] == 0)
+	m--;
+    uint64_t carry = 0;
+    for (int i = 0; i < n && (i < m || carry != 0); i++)
+    {
+	carry += (uint64_t) out[i] + (i < m ? a[i] : 0);
+	out[i] = (uint32_t) carry;
+	carry >>= 32;
+    }
+}
+
+static void subtractFrom( uint32_t *out, int n, const uint32_t *a, int m )
+{
+    while (m > 0 && a[m - 1] == 0)
+	m--;
+    int64_t borrow = 0;
+    for (int i = 0; i < n && (i < m || borrow != 0); i++)
+    {
+	int64_t t = (int64_t) out[i] - (i < m ? a[i] : 0) - borrow;
+	borrow = t < 0;
+	out[i] = (uint32_t) (t + (borrow << 32));
+    }
+}
+
+//  multiplyInto
+//  out (n + m limbs, initially zero) = a * b
+static void multiplyInto( const uint32_t *a, int n, const uint32_t *b, int m,
+			  uint32_t *out )
+{
+    if (n < m)
+    {
+	swap( a, b );
+	swap( n, m );
+    }
+    if (m < KaratsubaThreshold)
+    {
+	for (int j = 0; j < m; j++)
+	{
+	    uint64_t carry = 0;
+	    for (int i = 0; i < n; i++)
+	    {
+		carry += (uint64_t) a[i] * b[j] + out[i + j];
+		out[i + j] = (uint32_t) carry;
+		carry >>= 32;
+	    }
+	    out[j + n] = (uint32_t) carry;
+	}
+	return;
+    }
+
+    // A much longer a is multiplied a piece at a time
+    if (2 * m <= n)
+    {
+	Limbs piece( 2 * m );
+	for (int i = 0; i < n; i += m)
+	{
+	    int length = min( m, n - i );
+	    fill( piece.begin(), piece.end(), 0 );
+	    multiplyInto( a + i, length, b, m, piece.data() );
+	    addInto( out + i, n + m - i, piece.data(), length + m );
+	}
+	return;
+    }
+
+    // a = a1 * B^h + a0,  b = b1 * B^h + b0,  and then
+    // a * b = z2 * B^2h + z1 * B^h + z0,  where
+    // z1 = (a1 + a0) * (b1 + b0) - z2 - z0
+    int h = n / 2;
+    Limbs z0( 2 * h ), z2( (n - h) + (m - h) );
+    multiplyInto( a, h, b, h, z0.data() );
+    multiplyInto( a + h, n - h, b + h, m - h, z2.data() );
+    Limbs sa = addMagnitudes( a, h, a + h, n - h ),
+	  sb = addMagnitudes( b, h, b + h, m - h ),
+	  z1( sa.size() + sb.size() );
+    multiplyInto( sa.data(), sa.size(), sb.data(), sb.size(), z1.data() );
+    subtractFrom( z1.data(), z1.size(), z0.data(), z0.size() );
+    subtractFrom( z1.data(), z1.size(), z2.data(), z2.size() );
+
+    addInto( out, n + m, z0.data(), z0.size() );
+    addInto( out + h, n + m - h, z1.data(), z1.size() );
+    addInto( out + 2 * h, n + m - 2 * h, z2.data(), z2.size() );
+}
+
+//  divideMagnitudes
+//  quotient and remainder of u (m limbs) by v (n limbs, the
+//  most significant not zero), by Knuth's Algorithm D
+static void divideMagnitudes( const uint32_t *u, int m, const uint32_t *v, int n,
+			      Limbs &quotient, Limbs &remainder )
+{
+    const uint64_t base = (uint64_t) 1 << 32;
+    if (m < n)
+    {
+	quotient.clear();
+	remainder.assign( u, u + m );
+	return;
+    }
+    if (n == 1)				// short division
+    {
+	quotient.assign( m, 0 );
+	uint64_t r = 0;
+	for (int i = m - 1; i >= 0; i--)
+	{
+	    uint64_t t = (r << 32) | u[i];
+	    quotient[i] = (uint32_t) (t / v[0]);
+	    r = t % v[0];
+	}
+	remainder.assign( 1, (uint32_t) r );
+	return;
+    }
+
+    // Normalize, so that the divisor's leading limb has its top bit set
+    int s = __builtin_clz( v[n - 1] );
+    Limbs vn( n ), un( m + 1 );
+    for (int i = n - 1; i > 0; i--)
+	vn[i] = (v[i] << s) | (uint32_t) ((uint64_t) v[i - 1] >> (32 - s));
+    vn[0] = v[0] << s;
+    un[m] = (uint32_t) ((uint64_t) u[m - 1] >> (32 - s));
+    for (int i = m - 1; i > 0; i--)
+	un[i] = (u[i] << s) | (uint32_t) ((uint64_t) u[i - 1] >> (32 - s));
+    un[0] = u[0] << s;
+
+    quotient.assign( m - n + 1, 0 );
+    for (int j = m - n; j >= 0; j--)
+    {
+	// Estimate this limb of the quotient, then correct it
+	uint64_t top = ((uint64_t) un[j + n] << 32) | un[j + n - 1],
+		 qhat = top / vn[n - 1],
+		 rhat = top % vn[n - 1];
+	while (qhat >= base || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2]))
+	{
+	    qhat--;
+	    rhat += vn[n - 1];
+	    if (rhat >= base)
+		break;
+	}
+
+	// Multiply and subtract
+	int64_t k = 0, t;
+	for (int i = 0; i < n; i++)
+	{
+	    uint64_t p = qhat * vn[i];
+	    t = (int64_t) un[i + j] - k - (int64_t) (p & 0xffffffff);
+	    un[i + j] = (uint32_t) t;
+	    k = (int64_t) (p >> 32) - (t >> 32);
+	}
+	t = (int64_t) un[j + n] - k;
+	un[j + n] = (uint32_t) t;
+
+	quotient[j] = (uint32_t) qhat;
+	if (t < 0)			// subtracted too much:  add back
+	{
+	    quotient[j]--;
+	    uint64_t carry = 0;
+	    for (int i = 0; i < n; i++)
+	    {
+		carry += (uint64_t) un[i + j] + vn[i];
+		un[i + j] = (uint32_t) carry;
+		carry >>= 32;
+	    }
+	    un[j + n] += (uint32_t) carry;
+	}
+    }
+
+    remainder.assign( n, 0 );
+    for (int i = 0; i < n - 1; i++)
+	remainder[i] = (un[i] >> s) | (uint32_t) ((uint64_t) un[i + 1] << (32 - s));
+    remainder[n - 1] = un[n - 1] >> s;
+}
+
+Integer Integer::fromLong( long v )
+{
+    unsigned long m = v < 0 ? -(unsigned long) v : v;
+    Limbs limbs = { (uint32_t) m, (uint32_t) (m >> 32) };
+    return make( v < 0, limbs );
+}
+
+Integer Integer::add( Integer a, Integer b, bool negateB )
+{
+    Operand x( a );
+    Operand y( b );
+    bool yNegative = y.negative != negateB;
+    Limbs m;
+    if (x.negative == yNegative)
+	return make( x.negative, m = addMagnitudes( x.limb, x.size, y.limb, y.size ) );
+    if (compareMagnitudes( x.limb, x.size, y.limb, y.size ) >= 0)
+	return make( x.negative, m = subtractMagnitudes( x.limb, x.size, y.limb, y.size ) );
+    return make( yNegative, m = subtractMagnitudes( y.limb, y.size, x.limb, x.size ) );
+}
+
+Integer Integer::multiply( Integer a, Integer b )
+{
+    Operand x( a );
+    Operand y( b );
+    Limbs m( x.size + y.size );
+    multiplyInto( x.limb, x.size, y.limb, y.size, m.data() );
+    return make( x.negative != y.negative, m );
+}
+
+Integer Integer::divide( Integer a, Integer b, bool remainder )
+{
+    Operand x( a );
+    Operand y( b );
+    if (y.size == 0)
+	throw DivisionByZero();
+    Limbs q, r;
+    divideMagnitudes( x.limb, x.size, y.limb, y.size, q, r );
+    if (remainder)
+	return make( x.negative, r );	// (it has the dividend's sign)
+    return make( x.negative != y.negative, q );
+}
+
+int Integer::compare( Integer a, Integer b )
+{
+    Operand x( a );
+    Operand y( b );
+    if (x.negative != y.negative)
+	return x.negative ? -1 : 1;	// (zero is never negative)
+    int c = compareMagnitudes( x.limb, x.size, y.limb, y.size );
+    return x.negative ? -c : c;
+}
+
+unsigned Integer::bigHash() const
+{
+    const Bignum *b = big();
+    unsigned h = b->negative ? 2166136261u : 84696351u;
+    for (int i = 0; i < b->size; i++)
+	h = (h ^ b->limb[i]) * 16777619u;
+    return h;
+}
+
+//  parse
+//  Nine digits are taken at a time, as one limb holds them
+Integer Integer::parse( const char digits[], int length )
+{
+    if (length <= 18)
+    {
+	long v = 0;
+	for (int i = 0; i < length; i++)
+	    v = 10 * v + digits[i] - '0';
+	return Integer( v );
+    }
+    Limbs m;
+    for (int i = 0; i < length; )
+    {
+	int count = min( 9, length - i );
+	uint32_t chunk = 0, scale = 1;
+	for (int j = 0; j < count; j++)
+	{
+	    chunk = 10 * chunk + digits[i + j] - '0';
+	    scale *= 10;
+	}
+	i += count;
+	uint64_t carry = chunk;
+	for (size_t k = 0; k < m.size(); k++)
+	{
+	    carry += (uint64_t) m[k] * scale;
+	    m[k] = (uint32_t) carry;
+	    carry >>= 32;
+	}
+	if (carry != 0)
+	    m.push_back( (uint32_t) carry );
+    }
+    return make( false, m );
+}
+
+//  toString
+//  A large value is divided by 10^9 repeatedly, for nine digits
+//  at a time from the least significant
+string Integer::toString() const
+{
+    if (isSmall())
+	return to_string( small() );
+    const Bignum *b = big();
+    Limbs m( b->limb, b->limb + b->size );
+    vector<uint32_t> chunks;
+    while (!m.empty())
+    {
+	uint64_t r = 0;
+	for (int i = m.size() - 1; i >= 0; i--)
+	{
+	    uint64_t t = (r << 32) | m[i];
+	    m[i] = (uint32_t) (t / 1000000000);
+	    r = t % 1000000000;
+	}
+	chunks.push_back( (uint32_t) r );
+	while (!m.empty() && m.back() == 0)
+	    m.pop_back();
+    }
+    string text = b->negative ? "-" : "";
+    text += to_string( chunks.back() );
+    for (int i = chunks.size() - 2; i >= 0; i--)
+    {
+	string digits = to_string( chunks[i] );
+	text += string( 9 - digits.size(), '0' ) + digits;
+    }
+    return text;
+}
+
+bool Integer::magnitude( Limbs &limbs ) const
+{
+    Operand x( *this );
+    limbs.assign( x.limb, x.limb + x.size );
+    return x.negative;
+}
+
+Integer Integer::fromMagnitude( bool negative, const uint32_t limbs[], int count )
+{
+    Limbs m( limbs, limbs + count );
+    return make( negative, m );
+}
+
+ostream &operator<<( ostream &out, Integer i )
+{
+    if (i.isSmall())
+	return out << i.small();
+    return out << i.toString();
+}
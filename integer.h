@@ -0,0 +1,217 @@
+// Integer Header File
+// The values of expressions are integers of any size.  Almost all
+// of them are small, so an Integer is a single machine word:
+// -- a small value (one that fits in all but one bit of a word) is
+//    kept in the word itself, doubled, so that its lowest bit is 0;
+// -- any other value is a Bignum (see integer.cpp) allocated on the
+//    heap, whose address is kept plus 1, so that its lowest bit is 1.
+// Every value has exactly one form, so two Integers are equal just
+// when their words are, unless both are large.
+//
+// Arithmetic on small values is done inline, with the compiler's
+// checked arithmetic telling when the result would not be small;
+// only then (or when an operand is large) is a function called.
+//
+// An Integer is plain data, freely copied, and never owns anything.
+// A large value made by arithmetic is a temporary, which belongs to
+// the running thread until it next calls releaseTemporaries (which
+// the evaluator does after every expression).  Anything that holds
+// on to a value longer -- a variable, a cached result, a constant in
+// a tree -- must keep its own copy, and discard it when done.
+//
+// Dividing by zero throws DivisionByZero, which abandons whatever
+// expression was being evaluated (see evaluate.h).
+#ifndef INTEGER
+#define INTEGER
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdint.h>
+using namespace std;
+
+static_assert( sizeof(intptr_t) == 8, "a word must hold 64 bits" );
+
+struct Bignum;
+
+// What dividing by zero throws
+struct DivisionByZero
+{
+};
+
+class Integer
+{
+    private:
+	intptr_t word;		// twice a small value, or a Bignum's address + 1
+
+	static Integer fromWord( intptr_t w )
+	{
+	    Integer i;
+	    i.word = w;
+	    return i;
+	}
+	const Bignum *big() const
+	{
+	    return (const Bignum *) (word - 1);
+	}
+	friend struct Operand;
+
+	// make
+	// The Integer with the given sign and magnitude (in 32-bit
+	// limbs, least significant first), small if it fits
+	static Integer make( bool negative, vector<uint32_t> &magnitude );
+
+	// The general cases, for large operands or results
+	static Integer add( Integer a, Integer b, bool negateB );
+	static Integer multiply( Integer a, Integer b );
+	static Integer divide( Integer a, Integer b, bool remainder );
+	static int compare( Integer a, Integer b );
+	static Integer fromLong( long v );
+	unsigned bigHash() const;
+	Integer copy( bool kept ) const;
+	void release() const;
+    public:
+	static const long SmallMax = INTPTR_MAX >> 1,
+			  SmallMin = INTPTR_MIN >> 1;
+
+	Integer()
+	{
+	    word = 0;
+	}
+	Integer( int v )
+	{
+	    word = (intptr_t) v * 2;
+	}
+	Integer( long v )
+	{
+	    if (v >= SmallMin && v <= SmallMax)
+		word = v * 2;
+	    else
+		*this = fromLong( v );
+	}
+
+	bool isSmall() const
+	{
+	    return (word & 1) == 0;
+	}
+	long small() const		// (only for a small value)
+	{
+	    return word >> 1;
+	}
+	bool fitsInt() const
+	{
+	    return isSmall() && small() == (int) small();
+	}
+	bool isZero() const
+	{
+	    return word == 0;
+	}
+	bool identical( Integer other ) const	// the very same word
+	{
+	    return word == other.word;
+	}
+	unsigned hash() const
+	{
+	    if (isSmall())
+		return (unsigned) small() ^ (unsigned) (word >> 33);
+	    return bigHash();
+	}
+
+	// Arithmetic, truncating division as C++ does
+	// (dividing by zero is left to divide, which throws)
+	friend Integer operator+( Integer a, Integer b )
+	{
+	    intptr_t w;
+	    if (((a.word | b.word) & 1) == 0 && !__builtin_add_overflow( a.word, b.word, &w ))
+		return fromWord( w );
+	    return add( a, b, false );
+	}
+	friend Integer operator-( Integer a, Integer b )
+	{
+	    intptr_t w;
+	    if (((a.word | b.word) & 1) == 0 && !__builtin_sub_overflow( a.word, b.word, &w ))
+		return fromWord( w );
+	    return add( a, b, true );
+	}
+	friend Integer operator*( Integer a, Integer b )
+	{
+	    intptr_t w;
+	    if (((a.word | b.word) & 1) == 0 && !__builtin_mul_overflow( a.word, b.word >> 1, &w ))
+		return fromWord( w );
+	    return multiply( a, b );
+	}
+	friend Integer operator/( Integer a, Integer b )
+	{
+	    if (((a.word | b.word) & 1) == 0 && b.word != 0)
+		return Integer( a.small() / b.small() );
+	    return divide( a, b, false );
+	}
+	friend Integer operator%( Integer a, Integer b )
+	{
+	    if (((a.word | b.word) & 1) == 0 && b.word != 0)
+		return fromWord( a.small() % b.small() * 2 );
+	    return divide( a, b, true );
+	}
+
+	// Comparisons (a small word compares just as its value does)
+	friend bool operator==( Integer a, Integer b )
+	{
+	    return a.word == b.word || ((a.word & b.word & 1) != 0 && compare( a, b ) == 0);
+	}
+	friend bool operator!=( Integer a, Integer b )
+	{
+	    return !(a == b);
+	}
+	friend bool operator<( Integer a, Integer b )
+	{
+	    if (((a.word | b.word) & 1) == 0)
+		return a.word < b.word;
+	    return compare( a, b ) < 0;
+	}
+	friend bool operator>( Integer a, Integer b )
+	{
+	    return b < a;
+	}
+	friend bool operator<=( Integer a, Integer b )
+	{
+	    return !(b < a);
+	}
+	friend bool operator>=( Integer a, Integer b )
+	{
+	    return !(a < b);
+	}
+
+	// Holding on to values
+	Integer keep() const		// a copy belonging to the caller
+	{
+	    return isSmall() ? *this : copy( true );
+	}
+	void discard() const		// give up a copy from keep
+	{
+	    if (!isSmall())
+		release();
+	}
+	Integer temporary() const	// a temporary copy (see above)
+	{
+	    return isSmall() ? *this : copy( false );
+	}
+
+	// releaseTemporaries
+	// Free every temporary this thread has made, which must no
+	// longer be in use anywhere
+	static void releaseTemporaries();
+
+	// Text
+	// parse reads a string of decimal digits (a temporary if large)
+	static Integer parse( const char digits[], int length );
+	string toString() const;
+	friend ostream &operator<<( ostream &out, Integer i );
+
+	// Binary form (see snapshot.cpp):  the sign, and the magnitude
+	// in 32-bit limbs, least significant first
+	bool magnitude( vector<uint32_t> &limbs ) const;	// (whether negative)
+	static Integer fromMagnitude( bool negative, const uint32_t limbs[],
+				      int count );	// (a temporary if large)
+};
+
+#endif
@@ -0,0 +1,43 @@
+// Interpreter Implementation File
+// While it shares a library, an interpreter looks up results of the
+// library's functions in caches of its own, installed for the running
+// thread only for as long as it evaluates (and so, as for any thread
+// with caches of its own, no function is translated to machine code
+// meanwhile; see jit.h).  With its own functions, it uses their caches.
+#include "interpreter.h"
+
+Interpreter::Interpreter( EvalMode m )
+{
+    funs = &own;
+    mode = m;
+}
+
+Interpreter::~Interpreter()
+{
+    space.cache.clear();		// (before the functions they call)
+    releaseFunctions( own );
+}
+
+void Interpreter::share( FunctionDef &library )
+{
+    funs = &library;
+    space.cache.clear();		// (resolved against the old ones)
+    memos.clear();
+}
+
+Integer Interpreter::evaluate( const char expr[], ostream &out )
+{
+    if (!sharing())
+	return ::evaluate( expr, vars, own, mode, out, space );
+    if (definesFunction( expr ))
+    {
+	out << "cannot define functions while sharing the library";
+	return space.previous;
+    }
+
+    MemoTable *before = threadMemos;
+    threadMemos = &memos;
+    Integer result = ::evaluate( expr, vars, *funs, mode, out, space );
+    threadMemos = before;
+    return result;
+}
@@ -0,0 +1,94 @@
+// Interpreter Header File
+// An interpreter is one self-contained context for evaluating
+// expressions.  It owns everything one evaluation depends upon:
+// -- its variables (and the formulas bound to them),
+// -- its functions, or else a library of functions shared with
+//    other interpreters,
+// -- the previous value, the expressions parsed before, the call
+//    stack, and the counts of allocations and cache lookups (its
+//    Workspace, see evaluate.h),
+// -- and, while it shares a library, the caches of results of the
+//    library's functions (see memo.h).
+// The trees it parses refer to its own functions, and are only ever
+// evaluated by it.
+//
+// An interpreter may be used by only one thread at a time.  Any number
+// of interpreters may evaluate at once on different threads, for
+// nothing they change is shared between them, provided that a library
+// they share is not changed meanwhile:  an interpreter sharing one
+// may not define functions, and nothing else may define any in it
+// until they are all done with it.  Besides the library, all that is
+// common to every interpreter is
+// -- nativeThreshold (see jit.h), a setting made once, before any
+//    interpreter evaluates, and only read after that,
+// -- and the counts of arena memory (see arena.h), which are locked.
+// The profiler (see profile.h) is not common to them:  each thread
+// has its own, if any, profiling whichever interpreter it runs.
+#ifndef INTERPRETER
+#define INTERPRETER
+
+#include <iostream>
+#include "evaluate.h"
+#include "memo.h"
+using namespace std;
+
+class Interpreter
+{
+    private:
+	VarTree	     vars;
+	FunctionDef  own;		// its functions, unless shared
+	FunctionDef *funs;		// the ones it calls
+	Workspace    space;
+	MemoTable    memos;		// results of a library's functions
+	EvalMode     mode;
+    public:
+	// mode	(input EvalMode)	which engine to evaluate with
+	// (it begins with no functions at all, not even those built in)
+	Interpreter( EvalMode mode = TREE );
+	Interpreter( const Interpreter & ) = delete;
+	~Interpreter();
+
+	// share
+	// Call the functions of a library from now on, instead of its
+	// own (which remain, but are no longer called), and forget
+	// what was parsed for or computed by those before
+	// Parameters:
+	//	library	(input FunctionDef)	functions to share, which
+	//					must not change while it does
+	void share( FunctionDef &library );
+
+	bool sharing() const		// whether it calls a library's functions
+	{
+	    return funs != &own;
+	}
+
+	// evaluate
+	// Evaluate one expression, or define a function (unless sharing
+	// a library, when a definition is refused with a message)
+	// Parameters:
+	//	expr	(input char array)	expression to evaluate
+	//	out	(output stream)		where the result is displayed
+	// Returns:				its value, which remains valid
+	//					until the next evaluation
+	Integer evaluate( const char expr[], ostream &out = cout );
+
+	// What it holds, for the reports and snapshots that work on them
+	VarTree &variables()
+	{
+	    return vars;
+	}
+	FunctionDef &functions()	// those it calls
+	{
+	    return *funs;
+	}
+	Workspace &workspace()
+	{
+	    return space;
+	}
+	EvalMode engine() const
+	{
+	    return mode;
+	}
+};
+
+#endif
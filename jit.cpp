@@ -0,0 +1,798 @@
+// Native Code Implementation File
+// The machine code for a function has three parts:
+// -- an entry following the C calling convention, which saves the
+//    registers the code uses, places the arguments in registers,
+//    and calls the body (an abandoned call returns from here too,
+//    by restoring the stack pointer saved on entry),
+// -- for a pure function, a second entry for calls from the function
+//    to itself, which looks in the function's cache before calling
+//    the body and records the result afterwards,
+// -- and the body, which takes its arguments in the registers the
+//    C calling convention would, and returns its result in eax.
+//
+// Within the body, the parameters and the first few local variables
+// live in registers the C calling convention preserves, and the rest
+// in the stack frame.  Each operand being computed lives in a register
+// chosen by its depth on the operand stack, so that both cases of a
+// conditional leave their value in the same place.  Since those
+// registers do not survive a call, every operand is stored in the
+// frame before one, and reloaded after.
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "jit.h"
+#include "exprtree.h"
+#include "memo.h"
+#include "callstack.h"
+
+long nativeThreshold = 1000;
+thread_local int nativeSuspended = 0;
+
+const int DepthLimit = 10000;		// nested calls before giving up
+
+// Registers, numbered as in the instruction encoding
+enum Register
+{
+    RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+    R8, R9, R10, R11, R12, R13, R14, R15
+};
+static const int operandRegs[] = { RCX, RSI, RDI, R8, R9, R10, R11 };
+static const int localRegs[] = { RBX, RBP, R12, R13, R14 };
+static const int argumentRegs[] = { RDI, RSI, RDX, RCX, R8, R9 };
+const int Operands = sizeof operandRegs / sizeof operandRegs[0],
+	  LocalRegs = sizeof localRegs / sizeof localRegs[0],
+	  ArgumentRegs = sizeof argumentRegs / sizeof argumentRegs[0];
+const int Context = R15;		// holds the NativeContext throughout
+
+//  parameterCount
+//  The number of parameters a function takes
+static int parameterCount( const FunDef &f )
+{
+    int count = 0;
+    while (count < 10 && f.parameter[count] != "")
+	count++;
+    return count;
+}
+
+// What the machine code calls upon
+// (a result too large for an int is never found in the cache, since
+// the machine code could never have computed it anyway)
+static int nativeProbe( FunDef *f, const int args[], int count, int *result )
+{
+    Integer found;
+    if (!memoFor( f )->find( args, count, found ) || !found.fitsInt())
+	return 0;
+    *result = found.small();
+    return 1;
+}
+
+static void nativeRecord( FunDef *f, const int args[], int count, int result )
+{
+    memoFor( f )->insert( args, count, result );
+}
+
+static int nativeCall( const Functional *call, const int args[],
+		       NativeContext *context )
+{
+    Integer values[10];
+    for (int i = 0; i < 10; i++)
+	values[i] = args[i];
+    Integer result;
+    try
+    {
+	result = call->callWith( values, *context->calls );
+    }
+    catch (DivisionByZero &)
+    {
+	context->failed = 1;		// (walked again, to divide by zero there)
+	return 0;
+    }
+    if (!result.fitsInt())
+    {
+	context->failed = 1;		// (the caller abandons the call)
+	return 0;
+    }
+    return result.small();
+}
+
+NativeBuilder::NativeBuilder( FunDef &f, FunctionDef &fs )
+{
+    function = &f;
+    funs = &fs;
+    locals = f.locals->size();
+    depth = 0;
+    int bytes = 4 * Operands;		// where operands are saved
+    if (locals > LocalRegs)
+	bytes += 4 * (locals - LocalRegs);
+    frame = (bytes + 15) & ~15;
+    ok = true;
+    bodyEntry = label();
+    bodyStart = label();
+    epilogue = label();
+    abandon = label();
+    memoEntry = label();
+}
+
+FunDef *NativeBuilder::find( const string &name ) const
+{
+    FunctionDef::iterator f = funs->find( name );
+    return f == funs->end() ? NULL : &f->second;
+}
+
+void NativeBuilder::word( int w )
+{
+    for (int i = 0; i < 4; i++)
+	byte( (unsigned) w >> (8 * i) );
+}
+
+//  rex
+//  The prefix selecting 64-bit operands or the upper registers
+void NativeBuilder::rex( bool wide, int reg, int rm )
+{
+    int prefix = 0x40 | (wide ? 8 : 0) | (reg >= 8 ? 4 : 0) | (rm >= 8 ? 1 : 0);
+    if (prefix != 0x40)
+	byte( prefix );
+}
+
+//  direct
+//  An instruction between two registers (op may be two bytes)
+void NativeBuilder::direct( int op, int reg, int rm, bool wide )
+{
+    rex( wide, reg, rm );
+    if (op > 0xff)
+	byte( op >> 8 );
+    byte( op );
+    byte( 0xc0 | (reg & 7) << 3 | (rm & 7) );
+}
+
+//  onStack
+//  An instruction between a register and a word of the stack frame
+void NativeBuilder::onStack( int op, int reg, int offset )
+{
+    rex( false, reg, 0 );
+    byte( op );
+    byte( 0x84 | (reg & 7) << 3 );	// [rsp + disp32]
+    byte( 0x24 );
+    word( offset );
+}
+
+void NativeBuilder::moveImmediate( int reg, int value )
+{
+    rex( false, 0, reg );
+    byte( 0xb8 + (reg & 7) );
+    word( value );
+}
+
+void NativeBuilder::move( int to, int from )
+{
+    if (to != from)
+	direct( 0x89, from, to );
+}
+
+//  jumpTo
+//  A jump or call (op may be two bytes) to a label, filled in later
+void NativeBuilder::jumpTo( int op, int label )
+{
+    if (op > 0xff)
+	byte( op >> 8 );
+    byte( op );
+    fixups.push_back( make_pair( (int) code.size(), label ) );
+    word( 0 );
+}
+
+void NativeBuilder::loadAddress( int reg, const void *address )
+{
+    rex( true, 0, reg );
+    byte( 0xb8 + (reg & 7) );
+    unsigned long a = (unsigned long) address;
+    for (int i = 0; i < 8; i++)
+	byte( a >> (8 * i) );
+}
+
+void NativeBuilder::callAddress( const void *address )
+{
+    loadAddress( RAX, address );
+    byte( 0xff );			// call rax
+    byte( 0xd0 );
+}
+
+int NativeBuilder::label()
+{
+    labels.push_back( -1 );
+    return labels.size() - 1;
+}
+
+void NativeBuilder::bind( int label )
+{
+    labels[label] = code.size();
+}
+
+//  operand
+//  The register holding the operand at some depth
+int NativeBuilder::operand( int d )
+{
+    if (d >= Operands)
+    {
+	ok = false;			// too many to keep in registers
+	return RAX;
+    }
+    return operandRegs[d];
+}
+
+int NativeBuilder::spillOffset( int d )
+{
+    return 4 * d;
+}
+
+//  spill, reload
+//  Save operands from..to-1 in the frame, or restore them
+void NativeBuilder::spill( int from, int to )
+{
+    for (int d = from; d < to; d++)
+	onStack( 0x89, operand( d ), spillOffset( d ) );
+}
+
+void NativeBuilder::reload( int from, int to )
+{
+    for (int d = from; d < to; d++)
+	onStack( 0x8b, operand( d ), spillOffset( d ) );
+}
+
+void NativeBuilder::loadLocal( int reg, int slot )
+{
+    if (slot < LocalRegs)
+	move( reg, localRegs[slot] );
+    else
+	onStack( 0x8b, reg, 4 * Operands + 4 * (slot - LocalRegs) );
+}
+
+void NativeBuilder::storeLocal( int slot, int reg )
+{
+    if (slot < LocalRegs)
+	move( localRegs[slot], reg );
+    else
+	onStack( 0x89, reg, 4 * Operands + 4 * (slot - LocalRegs) );
+}
+
+//  placeArguments
+//  Move the arguments from where the caller left them
+void NativeBuilder::placeArguments( int count )
+{
+    for (int i = 0; i < count; i++)
+	storeLocal( i, argumentRegs[i] );
+}
+
+//  zeroLocals
+//  Local variables start out 0 in every call
+void NativeBuilder::zeroLocals( int from )
+{
+    for (int slot = from; slot < locals; slot++)
+	if (slot < LocalRegs)
+	    direct( 0x31, localRegs[slot], localRegs[slot] );	// xor
+	else
+	{
+	    byte( 0xc7 );		// mov dword [rsp + disp32], 0
+	    byte( 0x84 );
+	    byte( 0x24 );
+	    word( 4 * Operands + 4 * (slot - LocalRegs) );
+	    word( 0 );
+	}
+}
+
+void NativeBuilder::constant( int value )
+{
+    moveImmediate( operand( depth++ ), value );
+}
+
+void NativeBuilder::load( int slot )
+{
+    loadLocal( operand( depth++ ), slot );
+}
+
+void NativeBuilder::store( int slot )
+{
+    storeLocal( slot, operand( depth - 1 ) );
+}
+
+void NativeBuilder::binary( OpKind oper )
+{
+    int a = operand( depth - 2 ), b = operand( depth - 1 );
+    depth--;
+    switch (oper)
+    {
+    case PLUS:
+	direct( 0x01, b, a );
+	jumpTo( 0x0f80, abandon );		// jo
+	break;
+    case MINUS:
+	direct( 0x29, b, a );
+	jumpTo( 0x0f80, abandon );
+	break;
+    case TIMES:
+	direct( 0x0faf, a, b );			// imul
+	jumpTo( 0x0f80, abandon );
+	break;
+    case DIVIDE:
+    case MODULO:
+    {
+	int divides = label();
+	direct( 0x85, b, b );			// test b, b
+	jumpTo( 0x0f84, abandon );		// jz
+	rex( false, 0, b );			// cmp b, -1
+	byte( 0x83 );
+	byte( 0xf8 | (b & 7) );
+	byte( 0xff );
+	jumpTo( 0x0f85, divides );		// jne
+	rex( false, 0, a );			// cmp a, INT_MIN
+	byte( 0x81 );
+	byte( 0xf8 | (a & 7) );
+	word( INT_MIN );
+	jumpTo( 0x0f84, abandon );		// je
+	bind( divides );
+	move( RAX, a );
+	byte( 0x99 );				// cdq
+	rex( false, 0, b );			// idiv b
+	byte( 0xf7 );
+	byte( 0xf8 | (b & 7) );
+	move( a, oper == DIVIDE ? RAX : RDX );
+	break;
+    }
+    default:
+    {
+	int set;
+	switch (oper)
+	{
+	case LESS:	 set = 0x0f9c;	break;
+	case LESS_EQ:	 set = 0x0f9e;	break;
+	case GREATER:	 set = 0x0f9f;	break;
+	case GREATER_EQ: set = 0x0f9d;	break;
+	case EQUAL:	 set = 0x0f94;	break;
+	case NOT_EQUAL:	 set = 0x0f95;	break;
+	default:	 ok = false;	return;
+	}
+	direct( 0x39, b, a );			// cmp a, b
+	direct( set, 0, RAX );			// setcc al
+	direct( 0x0fb6, RAX, RAX );		// movzx eax, al
+	move( a, RAX );
+    }
+    }
+}
+
+void NativeBuilder::jumpIfZero( int label )
+{
+    int r = operand( --depth );
+    direct( 0x85, r, r );			// test r, r
+    jumpTo( 0x0f84, label );		// jz
+}
+
+void NativeBuilder::jump( int label )
+{
+    jumpTo( 0xe9, label );
+}
+
+//  call
+//  Call a function with the top count operands as its arguments
+void NativeBuilder::call( const Functional *call, FunDef *callee, int count )
+{
+    int base = depth - count;
+    spill( 0, depth );
+    if (callee == function)
+    {
+	for (int i = 0; i < count; i++)
+	    onStack( 0x8b, argumentRegs[i], spillOffset( base + i ) );
+	jumpTo( 0xe8, function->pure ? memoEntry : bodyEntry );
+    }
+    else
+    {
+	loadAddress( RDI, call );
+	rex( true, RSI, 0 );			// lea rsi, [rsp + disp32]
+	byte( 0x8d );
+	byte( 0x84 | (RSI & 7) << 3 );
+	byte( 0x24 );
+	word( spillOffset( base ) );
+	direct( 0x89, Context, RDX, true );	// mov rdx, r15
+	callAddress( (const void *) nativeCall );
+	byte( 0x41 );				// cmp dword [r15 + failed], 0
+	byte( 0x83 );
+	byte( 0x7f );
+	byte( offsetof( NativeContext, failed ) );
+	byte( 0 );
+	jumpTo( 0x0f85, abandon );		// jne
+    }
+    depth = base;
+    reload( 0, depth );
+    move( operand( depth++ ), RAX );
+}
+
+//  tailCall
+//  Call a function as the last thing the body does:  a call to
+//  the function itself just starts the body over
+//  Returns:		whether it could (a call to any other function
+//			could not, see jit.h, unless it is built in)
+bool NativeBuilder::tailCall( const Functional *call, FunDef *callee, int count )
+{
+    if (callee->builtin != NULL)
+    {
+	this->call( call, callee, count );
+	ret();
+	return true;
+    }
+    if (callee != function)
+	return false;
+    int base = depth - count;
+    for (int i = 0; i < count; i++)
+	storeLocal( i, operand( base + i ) );
+    zeroLocals( count );
+    depth = base;
+    jumpTo( 0xe9, bodyStart );
+    return true;
+}
+
+void NativeBuilder::ret()
+{
+    move( RAX, operand( --depth ) );
+    jumpTo( 0xe9, epilogue );
+}
+
+//  prologue
+//  The entry points, and the start of the body
+void NativeBuilder::prologue()
+{
+    int count = parameterCount( *function ),
+	exit = label(), miss = label();
+    static const int saved[] = { RBX, RBP, R12, R13, R14, R15 };
+
+    // The entry from C:  int entry( const int args[], NativeContext * )
+    for (int i = 0; i < 6; i++)
+    {
+	rex( false, 0, saved[i] );
+	byte( 0x50 + (saved[i] & 7) );		// push
+    }
+    direct( 0x81, 5, RSP, true );		// sub rsp, 8
+    word( 8 );
+    direct( 0x89, RSI, Context, true );		// mov r15, rsi
+    byte( 0x49 );				// mov [r15], rsp
+    byte( 0x89 );
+    byte( 0x27 );
+    for (int i = count - 1; i >= 0; i--)	// rdi last, as it is the array
+    {
+	rex( false, argumentRegs[i], RDI );	// mov reg, [rdi + disp8]
+	byte( 0x8b );
+	byte( 0x40 | (argumentRegs[i] & 7) << 3 | (RDI & 7) );
+	byte( 4 * i );
+    }
+    jumpTo( 0xe8, bodyEntry );
+    bind( exit );
+    direct( 0x81, 0, RSP, true );		// add rsp, 8
+    word( 8 );
+    for (int i = 5; i >= 0; i--)
+    {
+	rex( false, 0, saved[i] );
+	byte( 0x58 + (saved[i] & 7) );		// pop
+    }
+    byte( 0xc3 );
+
+    // Abandoning the call returns through the entry from C
+    bind( abandon );
+    byte( 0x49 );				// mov rsp, [r15]
+    byte( 0x8b );
+    byte( 0x27 );
+    byte( 0x41 );				// mov dword [r15 + failed], 1
+    byte( 0xc7 );
+    byte( 0x47 );
+    byte( offsetof( NativeContext, failed ) );
+    word( 1 );
+    jumpTo( 0xe9, exit );
+
+    // The entry for a pure function calling itself
+    if (function->pure)
+    {
+	const int args = 0, result = 40, size = 56;
+	bind( memoEntry );
+	direct( 0x81, 5, RSP, true );		// sub rsp, size
+	word( size );
+	for (int i = 0; i < count; i++)
+	    onStack( 0x89, argumentRegs[i], args + 4 * i );
+	loadAddress( RDI, function );
+	rex( true, RSI, 0 );			// lea rsi, [rsp + args]
+	byte( 0x8d );
+	byte( 0x84 | (RSI & 7) << 3 );
+	byte( 0x24 );
+	word( args );
+	moveImmediate( RDX, count );
+	rex( true, RCX, 0 );			// lea rcx, [rsp + result]
+	byte( 0x8d );
+	byte( 0x84 | (RCX & 7) << 3 );
+	byte( 0x24 );
+	word( result );
+	callAddress( (const void *) nativeProbe );
+	direct( 0x85, RAX, RAX );		// test eax, eax
+	jumpTo( 0x0f84, miss );			// jz
+	onStack( 0x8b, RAX, result );
+	direct( 0x81, 0, RSP, true );		// add rsp, size
+	word( size );
+	byte( 0xc3 );
+
+	bind( miss );
+	for (int i = 0; i < count; i++)
+	    onStack( 0x8b, argumentRegs[i], args + 4 * i );
+	jumpTo( 0xe8, bodyEntry );
+	onStack( 0x89, RAX, result );
+	loadAddress( RDI, function );
+	rex( true, RSI, 0 );			// lea rsi, [rsp + args]
+	byte( 0x8d );
+	byte( 0x84 | (RSI & 7) << 3 );
+	byte( 0x24 );
+	word( args );
+	moveImmediate( RDX, count );
+	move( RCX, RAX );
+	callAddress( (const void *) nativeRecord );
+	onStack( 0x8b, RAX, result );
+	direct( 0x81, 0, RSP, true );		// add rsp, size
+	word( size );
+	byte( 0xc3 );
+    }
+
+    // The body, which may be called recursively
+    bind( bodyEntry );
+    for (int i = 0; i < LocalRegs; i++)
+    {
+	rex( false, 0, localRegs[i] );
+	byte( 0x50 + (localRegs[i] & 7) );	// push
+    }
+    direct( 0x81, 5, RSP, true );		// sub rsp, frame
+    word( frame );
+    byte( 0x41 );				// add dword [r15 + depth], 1
+    byte( 0x83 );
+    byte( 0x47 );
+    byte( offsetof( NativeContext, depth ) );
+    byte( 1 );
+    byte( 0x41 );				// cmp dword [r15 + depth], limit
+    byte( 0x81 );
+    byte( 0x7f );
+    byte( offsetof( NativeContext, depth ) );
+    word( DepthLimit );
+    jumpTo( 0x0f8f, abandon );			// jg
+    placeArguments( count );
+    zeroLocals( count );
+    bind( bodyStart );
+}
+
+//  finish
+//  The return from the body, and the jumps filled in
+void NativeBuilder::finish()
+{
+    bind( epilogue );
+    byte( 0x41 );				// sub dword [r15 + depth], 1
+    byte( 0x83 );
+    byte( 0x6f );
+    byte( offsetof( NativeContext, depth ) );
+    byte( 1 );
+    direct( 0x81, 0, RSP, true );		// add rsp, frame
+    word( frame );
+    for (int i = LocalRegs - 1; i >= 0; i--)
+    {
+	rex( false, 0, localRegs[i] );
+	byte( 0x58 + (localRegs[i] & 7) );	// pop
+    }
+    byte( 0xc3 );
+
+    for (unsigned i = 0; i < fixups.size(); i++)
+    {
+	int at = fixups[i].first, target = labels[fixups[i].second];
+	int offset = target - (at + 4);
+	memcpy( &code[at], &offset, 4 );
+    }
+}
+
+bool NativeBuilder::assemble( const ExprNode *body )
+{
+    prologue();
+    if (!body->nativeTail( *this ))
+	return false;
+    finish();
+    return ok;
+}
+
+NativeCode::~NativeCode()
+{
+    munmap( memory, size );
+}
+
+NativeCode *NativeCode::translate( FunDef &f, FunctionDef &funs )
+{
+#if defined(__x86_64__)
+    if (parameterCount( f ) > ArgumentRegs)
+	return NULL;			// (decided before anything is built)
+    NativeBuilder b( f, funs );
+    if (!b.assemble( f.functionBody ))
+	return NULL;
+
+    // The pages are only made executable once they are written
+    const vector<unsigned char> &code = b.machineCode();
+    size_t page = sysconf( _SC_PAGESIZE ),
+	   size = (code.size() + page - 1) / page * page;
+    void *memory = mmap( NULL, size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if (memory == MAP_FAILED)
+	return NULL;
+    memcpy( memory, code.data(), code.size() );
+    if (mprotect( memory, size, PROT_READ | PROT_EXEC ) != 0)
+    {
+	munmap( memory, size );
+	return NULL;
+    }
+    NativeCode *n = new NativeCode();
+    n->memory = memory;
+    n->size = size;
+    n->used = code.size();
+    n->entry = (int (*)( const int[], NativeContext * )) memory;
+    return n;
+#else
+    return NULL;			// no other processor is supported
+#endif
+}
+
+//  run
+//  Out of line, so that the room it takes on the native stack is
+//  not taken by every call the tree walker nests
+bool NativeCode::run( const Integer args[], int count, CallStack &calls,
+		      Integer &result ) const
+{
+    int values[10];
+    for (int i = 0; i < count; i++)
+    {
+	if (!args[i].fitsInt())
+	    return false;
+	values[i] = args[i].small();
+    }
+    NativeContext context = { NULL, 0, 0, &calls };
+    result = Integer( entry( values, &context ) );
+    return !context.failed;
+}
+
+bool translateNative( FunDef &f, FunctionDef &funs )
+{
+    f.native = NativeCode::translate( f, funs );
+    if (f.native == NULL)
+	f.calls = -1;			// not until it is redefined
+    return f.native != NULL;
+}
+
+void discardNative( FunctionDef &funs, const set<string> &changed )
+{
+    for (set<string>::const_iterator c = changed.begin(); c != changed.end(); c++)
+    {
+	FunctionDef::iterator f = funs.find( *c );
+	if (f == funs.end())
+	    continue;
+	delete f->second.native;
+	f->second.native = NULL;
+	f->second.calls = 0;
+    }
+}
+
+void nativeReport( ostream &out, FunctionDef &funs )
+{
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+    {
+	out << f->first << ": ";
+	if (f->second.builtin != NULL)
+	    out << "built in";
+	else if (f->second.native != NULL)
+	    out << "machine code, " << f->second.native->bytes() << " bytes";
+	else if (f->second.calls < 0)
+	    out << "cannot be translated";
+	else
+	    out << f->second.calls << " evaluations";
+	out << endl;
+    }
+}
+
+//  Most nodes simply compute their value and return it
+bool ExprNode::nativeTail( NativeBuilder &b ) const
+{
+    if (!native( b ))
+	return false;
+    b.ret();
+    return true;
+}
+
+bool Value::native( NativeBuilder &b ) const
+{
+    if (!value.fitsInt())
+	return false;
+    b.constant( value.small() );
+    return true;
+}
+
+bool Variable::native( NativeBuilder &b ) const
+{
+    b.load( slot );
+    return true;
+}
+
+bool Operation::native( NativeBuilder &b ) const
+{
+    if (!left->native( b ) || !right->native( b ))
+	return false;
+    b.binary( oper );
+    return true;
+}
+
+bool Assignment::native( NativeBuilder &b ) const
+{
+    if (!right->native( b ))
+	return false;
+    b.store( slot );
+    return true;
+}
+
+bool Conditional::native( NativeBuilder &b ) const
+{
+    if (!test->native( b ))
+	return false;
+    int otherwise = b.label(), end = b.label();
+    b.jumpIfZero( otherwise );
+    int depth = b.stackDepth();
+    if (!trueCase->native( b ))
+	return false;
+    b.jump( end );
+    b.bind( otherwise );
+    b.setDepth( depth );
+    if (!falseCase->native( b ))
+	return false;
+    b.bind( end );
+    return true;
+}
+
+bool Conditional::nativeTail( NativeBuilder &b ) const
+{
+    if (!test->native( b ))
+	return false;
+    int otherwise = b.label();
+    b.jumpIfZero( otherwise );
+    int depth = b.stackDepth();
+    if (!trueCase->nativeTail( b ))
+	return false;
+    b.bind( otherwise );
+    b.setDepth( depth );
+    return falseCase->nativeTail( b );
+}
+
+//  pushArguments
+//  Evaluate the arguments as the tree walker would:  one for each
+//  parameter of the function (0 where none was given)
+//  Returns:		the function, or NULL if it is not defined
+FunDef *Functional::pushArguments( NativeBuilder &b ) const
+{
+    FunDef *callee = b.find( name );
+    if (callee == NULL)
+	return NULL;			// evaluating the call would fail
+    int count = parameterCount( *callee );
+    for (int i = 0; i < count; i++)
+	if (para_list[i] == NULL)
+	    b.constant( 0 );
+	else if (!para_list[i]->native( b ))
+	    return NULL;
+    return callee;
+}
+
+bool Functional::native( NativeBuilder &b ) const
+{
+    FunDef *callee = pushArguments( b );
+    if (callee == NULL)
+	return false;
+    b.call( this, callee, parameterCount( *callee ) );
+    return true;
+}
+
+bool Functional::nativeTail( NativeBuilder &b ) const
+{
+    FunDef *callee = pushArguments( b );
+    if (callee == NULL)
+	return false;
+    return b.tailCall( this, callee, parameterCount( *callee ) );
+}
@@ -0,0 +1,221 @@
+// Native Code Header File
+// A function that is called very often may be translated into
+// x86-64 machine code, which runs directly on the processor instead
+// of being walked as a tree.  A function is translated once its body
+// has been evaluated enough times to be worth the trouble; until
+// then, and whenever translation is not possible, the tree walker
+// evaluates it as always.
+//
+// In the machine code, the parameters and local variables are kept
+// in registers (as many as there are registers for), and a function
+// calls itself directly; any other function is called through
+// Functional::callWith, just as the tree walker would.  Results of
+// a pure function are still looked up and recorded in its cache.
+// A function whose body ends in a call to another function is never
+// translated:  the tree walker has that call take the place of the
+// caller's frame (see Functional::evaluate), but the machine code
+// would nest it on the native stack, and so recursion through two
+// or more functions could exhaust it.
+//
+// The machine code computes with plain ints.  Anything it cannot do
+// exactly as the tree walker does -- a division by zero or of the
+// least int by -1, any value too large for an int, or recursion too
+// deep for the native stack -- abandons the whole call, which is then
+// evaluated again by walking the tree.  (Nothing a function does is
+// visible outside it, apart from its result.)
+//
+// Only a thread evaluating on its own (one without a MemoTable, see
+// memo.h) counts calls and translates functions; threads working
+// alongside others only run whatever was translated before.
+#ifndef JIT
+#define JIT
+
+#include <iostream>
+#include <vector>
+#include "funmap.h"
+#include "token.h"
+#include "memo.h"
+using namespace std;
+
+class CallStack;
+class ExprNode;
+class Functional;
+
+// What the machine code needs while it runs
+struct NativeContext
+{
+    void      *stack;		// stack pointer on entry, to abandon a call
+    int	       failed;		// whether the call was abandoned
+    int	       depth;		// nested calls to the function itself
+    CallStack *calls;		// for calling other functions
+};
+
+// NativeCode
+// The machine code for one function
+class NativeCode
+{
+    private:
+	void  *memory;			// executable pages
+	size_t size;			// bytes mapped
+	size_t used;			// bytes of code
+	int  (*entry)( const int args[], NativeContext *context );
+
+	NativeCode()
+	{
+	}
+    public:
+	NativeCode( const NativeCode & ) = delete;
+	~NativeCode();
+
+	// translate
+	// Produce the machine code for a function's body
+	// Returns:		the code, or NULL if it cannot be translated
+	static NativeCode *translate( FunDef &f, FunctionDef &funs );
+
+	// run
+	// Evaluate the function for the given arguments
+	// Returns:		false if the call was abandoned (or
+	//			an argument is too large for an int)
+	bool run( const Integer args[], int count, CallStack &calls,
+		  Integer &result ) const;
+
+	size_t bytes() const
+	{
+	    return used;
+	}
+};
+
+// NativeBuilder
+// Assembles the machine code for one function, as its body is
+// traversed (see ExprNode::native).  The operands being computed
+// form a stack, whose entries are kept in registers by depth.
+class NativeBuilder
+{
+    private:
+	vector<unsigned char> code;
+	vector<int>  labels;		// position of each label, or -1
+	vector<pair<int, int> > fixups;	// (where, label) for each jump
+	FunDef	    *function;		// the function being translated
+	FunctionDef *funs;
+	int	     locals;		// number of local variables
+	int	     depth;		// operands now on the stack
+	int	     frame;		// bytes of stack frame below the saved registers
+	int	     bodyEntry,		// labels:  the body, called with arguments
+		     bodyStart,		//	    after the parameters are placed
+		     epilogue,		//	    return to the caller
+		     abandon,		//	    abandon the call
+		     memoEntry;		//	    look up the cache first
+	bool	     ok;		// still possible to translate
+
+	// Encoding
+	void byte( int b )
+	{
+	    code.push_back( (unsigned char) b );
+	}
+	void word( int w );
+	void rex( bool wide, int reg, int rm );
+	void direct( int op, int reg, int rm, bool wide = false );
+	void onStack( int op, int reg, int offset );
+	void moveImmediate( int reg, int value );
+	void move( int to, int from );
+	void jumpTo( int op, int label );
+	void callAddress( const void *address );
+	void loadAddress( int reg, const void *address );
+
+	// Operands and variables
+	int  operand( int depth );
+	int  spillOffset( int depth );
+	void spill( int from, int to );
+	void reload( int from, int to );
+	void loadLocal( int reg, int slot );
+	void storeLocal( int slot, int reg );
+	void placeArguments( int count );
+	void zeroLocals( int from );
+
+	void prologue();
+	void finish();
+    public:
+	NativeBuilder( FunDef &f, FunctionDef &funs );
+
+	FunDef *self() const
+	{
+	    return function;
+	}
+	FunDef *find( const string &name ) const;
+
+	int  label();
+	void bind( int label );
+	int  stackDepth() const
+	{
+	    return depth;
+	}
+	void setDepth( int d )
+	{
+	    depth = d;
+	}
+
+	// Each of these consumes its operands from the stack,
+	// and pushes its result
+	void constant( int value );
+	void load( int slot );
+	void store( int slot );		// leaves the value on the stack
+	void binary( OpKind oper );
+	void jumpIfZero( int label );	// (pushes nothing)
+	void jump( int label );
+	void call( const Functional *call, FunDef *callee, int count );
+	bool tailCall( const Functional *call, FunDef *callee, int count );
+	void ret();			// return the top of the stack
+	void fail()			// the body cannot be translated
+	{
+	    ok = false;
+	}
+
+	// Returns:	false if the body could not be translated
+	bool assemble( const ExprNode *body );
+	const vector<unsigned char> &machineCode() const
+	{
+	    return code;
+	}
+};
+
+// nativeThreshold
+// How many times a function's body is evaluated before it is
+// translated (0 never translates anything); set at most once, before
+// any interpreter evaluates, since every thread reads it unlocked
+extern long nativeThreshold;
+
+// nativeSuspended
+// Calls on this thread being walked again after their machine code
+// abandoned them (nothing within them is run as machine code)
+extern thread_local int nativeSuspended;
+
+// translateNative
+// Translate a function that has become hot enough, unless that
+// is impossible (in which case it is never tried again)
+// Returns:		whether it now has machine code
+bool translateNative( FunDef &f, FunctionDef &funs );
+
+// nativeReady
+// Whether a function is to be run as machine code, translating it
+// now if it has just become hot enough
+inline bool nativeReady( FunDef &f, FunctionDef &funs )
+{
+    if (nativeSuspended != 0)
+	return false;
+    if (f.native != NULL)
+	return true;
+    if (f.calls < 0 || nativeThreshold == 0 || threadMemos != NULL)
+	return false;
+    return ++f.calls >= nativeThreshold && translateNative( f, funs );
+}
+
+// discardNative
+// Forget the machine code of functions whose definitions changed
+// (or that call them), so that they are counted and translated anew
+void discardNative( FunctionDef &funs, const set<string> &changed );
+
+// nativeReport
+// Display which functions run as machine code
+void nativeReport( ostream &out, FunctionDef &funs );
+
+#endif
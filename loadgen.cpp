@@ -0,0 +1,261 @@
+// Load Generator Program
+// Measures how quickly an evaluation server (see server.h) answers
+// many clients at once.  Each client connects, and sends its lines
+// as fast as the server answers them, keeping up to a given number
+// of them unanswered at any time.  The time from sending each line
+// until its answer arrives is its latency.
+//
+// The rate of answers for all the clients together and the latencies
+// summarized as percentiles, in microseconds, are written to the
+// standard output as JSON, as the benchmark program does.
+//
+// The lines sent are read from a file, or else are a mix of calls
+// to the functions every session begins with, assignments, and
+// expressions using the variables assigned.  Every client sends
+// the same lines, starting at a different place among them.
+//
+// This is a program of its own, built from this file alone:
+//	g++ -std=c++17 -O2 -o loadgen loadgen.cpp -pthread
+// Options:
+//	-socket path	where the server listens (required)
+//	-clients n	connections at once (default 8)
+//	-requests n	lines each client sends (default 10000)
+//	-depth d	lines each client may await at once (default 1)
+//	-shared		have each session use the shared library
+//	-file path	the lines to send, one per line
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// The lines sent when no file is given
+static const char *mix[] =
+{
+    "x = 17",
+    "y = 4",
+    "fib(15)",
+    "gcf(832040, 514229)",
+    "x * y + 3 * (x - y)",
+    "fact(12)",
+    "lcm(x, 18)",
+    "pow(3, 19)",
+    "x > y ? x - y : y - x",
+    "sqr(x) + cube(y) - abs(neg(x))",
+    "x = x + 1",
+    "avg5(x, y, 3, 4, 5) % 7"
+};
+
+// What each client accomplished
+struct Client
+{
+    vector<long> latencies;		// of every answer, in nanoseconds
+    string	 error;			// why it stopped early, if it did
+};
+
+//  connectTo
+//  Open a connection to the server
+//  Returns:	its file descriptor, or -1
+static int connectTo( const char path[] )
+{
+    sockaddr_un address;
+    memset( &address, 0, sizeof address );
+    address.sun_family = AF_UNIX;
+    if (strlen( path ) >= sizeof address.sun_path)
+	return -1;
+    strcpy( address.sun_path, path );
+    int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+    if (fd >= 0 && connect( fd, (sockaddr *) &address, sizeof address ) < 0)
+    {
+	close( fd );
+	fd = -1;
+    }
+    return fd;
+}
+
+//  sendAll
+//  Write the whole of some text to a connection
+static bool sendAll( int fd, const string &text )
+{
+    for (size_t sent = 0; sent < text.size(); )
+    {
+	ssize_t n = send( fd, text.data() + sent, text.size() - sent, MSG_NOSIGNAL );
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	    return false;
+	sent += n;
+    }
+    return true;
+}
+
+//  runClient
+//  Send one client's lines, timing every answer
+static void runClient( const char path[], const vector<string> &lines, int first,
+		       int requests, int depth, bool shared, Client &c )
+{
+    int fd = connectTo( path );
+    if (fd < 0)
+    {
+	c.error = string( "cannot connect: " ) + strerror( errno );
+	return;
+    }
+    char buffer[1 << 16];
+    if (shared && !sendAll( fd, ":shared\n" ))
+	c.error = "cannot send";
+
+    // The time each unanswered line was sent, oldest first
+    // (a ring of depth entries; the answer to :shared is not timed)
+    vector<Clock::time_point> sentAt( depth );
+    int sent = 0, answered = 0, skip = shared ? 1 : 0;
+    c.latencies.reserve( requests );
+    while (c.error.empty() && answered < requests)
+    {
+	string batch;
+	Clock::time_point now = Clock::now();
+	while (sent < requests && sent - answered < depth)
+	{
+	    batch += lines[(first + sent) % lines.size()];
+	    batch += '\n';
+	    sentAt[sent % depth] = now;
+	    sent++;
+	}
+	if (!batch.empty() && !sendAll( fd, batch ))
+	{
+	    c.error = "cannot send";
+	    break;
+	}
+
+	ssize_t n = read( fd, buffer, sizeof buffer );
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n <= 0)
+	{
+	    c.error = "the server closed the connection";
+	    break;
+	}
+	now = Clock::now();
+	for (ssize_t i = 0; i < n; i++)		// one answer per line
+	    if (buffer[i] != '\n')
+		continue;
+	    else if (skip > 0)
+		skip--;
+	    else
+	    {
+		c.latencies.push_back( chrono::duration_cast<chrono::nanoseconds>(
+					   now - sentAt[answered % depth] ).count() );
+		answered++;
+	    }
+    }
+    close( fd );
+}
+
+int main( int argc, char *argv[] )
+{
+    const char *path = NULL, *file = NULL;
+    int clients = 8, requests = 10000, depth = 1;
+    bool shared = false;
+    for (int i = 1; i < argc; i++)
+    {
+	string arg = argv[i];
+	if (arg == "-shared")
+	    shared = true;
+	else if (i + 1 < argc && arg == "-socket")
+	    path = argv[++i];
+	else if (i + 1 < argc && arg == "-clients")
+	    clients = atoi( argv[++i] );
+	else if (i + 1 < argc && arg == "-requests")
+	    requests = atoi( argv[++i] );
+	else if (i + 1 < argc && arg == "-depth")
+	    depth = atoi( argv[++i] );
+	else if (i + 1 < argc && arg == "-file")
+	    file = argv[++i];
+	else
+	{
+	    path = NULL;		// (to display the usage)
+	    break;
+	}
+    }
+    if (path == NULL)
+    {
+	cerr << "usage: " << argv[0] << " -socket path [-clients n]"
+	     << " [-requests n] [-depth d] [-shared] [-file path]" << endl;
+	return 1;
+    }
+    clients = max( clients, 1 );
+    requests = max( requests, 1 );
+    depth = max( depth, 1 );
+
+    vector<string> lines;
+    if (file != NULL)
+    {
+	ifstream in( file );
+	string line;
+	while (getline( in, line ))
+	    if (line.find_first_not_of( " \t\r" ) != string::npos)
+		lines.push_back( line );	// (a blank line has no answer)
+	if (lines.empty())
+	{
+	    cerr << "no lines to send in " << file << endl;
+	    return 1;
+	}
+    }
+    else
+	lines.assign( mix, mix + sizeof mix / sizeof mix[0] );
+
+    vector<Client> results( clients );
+    vector<thread> threads;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < clients; i++)
+	threads.push_back( thread( runClient, path, cref( lines ), i * 7,
+				   requests, depth, shared, ref( results[i] ) ) );
+    for (thread &t : threads)
+	t.join();
+    double seconds = chrono::duration<double>( Clock::now() - start ).count();
+
+    vector<long> t;
+    bool failed = false;
+    for (Client &c : results)
+    {
+	if (!c.error.empty())
+	{
+	    cerr << c.error << endl;
+	    failed = true;
+	}
+	t.insert( t.end(), c.latencies.begin(), c.latencies.end() );
+    }
+    if (t.empty())
+	return 1;
+    sort( t.begin(), t.end() );
+    double total = 0;
+    for (size_t i = 0; i < t.size(); i++)
+	total += t[i];
+    auto rank = [&]( double p )
+    {
+	size_t i = (size_t) (p * t.size());
+	return t[i < t.size() ? i : t.size() - 1] / 1000.0;
+    };
+    cout << "{ \"clients\": " << clients << ", \"depth\": " << depth
+	 << ", \"shared\": " << (shared ? "true" : "false")
+	 << ", \"requests\": " << t.size() << ", \"seconds\": " << seconds
+	 << ", \"requests_per_sec\": " << (long) (t.size() / seconds)
+	 << ",\n  \"latency\": { \"unit\": \"us\", \"min\": " << t.front() / 1000.0
+	 << ", \"mean\": " << total / t.size() / 1000.0
+	 << ", \"p50\": " << rank( 0.50 )
+	 << ", \"p90\": " << rank( 0.90 )
+	 << ", \"p99\": " << rank( 0.99 )
+	 << ", \"p999\": " << rank( 0.999 )
+	 << ", \"max\": " << t.back() / 1000.0 << " } }" << endl;
+    return failed ? 1 : 0;
+}
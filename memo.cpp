@@ -0,0 +1,311 @@
+// Memoization Implementation File
+// The cache is an array of entries, threaded both onto hash chains
+// (for lookup) and onto a doubly-linked list in order of use
+// (for eviction).  Links are array indexes, with -1 for none.
+#include "memo.h"
+#include "exprtree.h"
+
+MemoCache::MemoCache( int size )
+{
+    capacity = size;
+    for (mask = 1; mask < 2 * size; mask *= 2)
+	;			// at least two buckets per entry
+    buckets = new int[mask];
+    mask--;
+    entries = new Entry[capacity];
+    arguments = NULL;
+    width = 0;
+    hits = misses = 0;
+    used = 0;
+    large = false;
+    clear();
+}
+
+MemoCache::~MemoCache()
+{
+    clear();
+    delete [] entries;
+    delete [] arguments;
+    delete [] buckets;
+}
+
+//  clear
+//  Discard all the results (but not the statistics)
+void MemoCache::clear()
+{
+    if (large)
+	for (int e = 0; e < used; e++)
+	    discard( e );
+    large = false;
+    for (int i = 0; i <= mask; i++)
+	buckets[i] = -1;
+    used = 0;
+    newest = oldest = -1;
+}
+
+//  The arguments are either Integers or ints, each of which is
+//  taken as the Integer it stands for
+template <class Arg>
+unsigned MemoCache::hash( const Arg args[], int count ) const
+{
+    unsigned h = 2166136261u;
+    for (int i = 0; i < count; i++)
+	h = (h ^ Integer( args[i] ).hash()) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+//  discard
+//  Give up the copies an entry keeps
+void MemoCache::discard( int e )
+{
+    for (int i = 0; i < width; i++)
+	argsOf( e )[i].discard();
+    entries[e].result.discard();
+}
+
+//  unlink
+//  Remove an entry from the order of use
+void MemoCache::unlink( int e )
+{
+    if (entries[e].older >= 0)
+	entries[entries[e].older].newer = entries[e].newer;
+    else
+	oldest = entries[e].newer;
+    if (entries[e].newer >= 0)
+	entries[entries[e].newer].older = entries[e].older;
+    else
+	newest = entries[e].older;
+}
+
+//  pushNewest
+//  Make an entry the most recently used one
+void MemoCache::pushNewest( int e )
+{
+    entries[e].older = newest;
+    entries[e].newer = -1;
+    if (newest >= 0)
+	entries[newest].newer = e;
+    else
+	oldest = e;
+    newest = e;
+}
+
+//  find
+//  Look for a previous result for these arguments
+//  Parameters:
+//	args	(input Integer array)	argument values
+//	count	(input integer)		number of arguments
+//	result	(output Integer)	the result (a temporary), if found
+//  Returns:				whether it was found
+bool MemoCache::find( const Integer args[], int count, Integer &result )
+{
+    return lookup( args, count, result );
+}
+
+bool MemoCache::find( const int args[], int count, Integer &result )
+{
+    return lookup( args, count, result );
+}
+
+template <class Arg>
+bool MemoCache::lookup( const Arg args[], int count, Integer &result )
+{
+    int e = count == width ? buckets[hash( args, count ) & mask] : -1;
+    for ( ; e >= 0; e = entries[e].chain)
+    {
+	const Integer *kept = argsOf( e );
+	int i = 0;
+	while (i < count && kept[i] == Integer( args[i] ))
+	    i++;
+	if (i == count)
+	{
+	    if (e != newest)
+	    {
+		unlink( e );
+		pushNewest( e );
+	    }
+	    result = entries[e].result.temporary();
+	    hits++;
+	    return true;
+	}
+    }
+    misses++;
+    return false;
+}
+
+//  insert
+//  Record a result, discarding the least recently used one if full
+void MemoCache::insert( const Integer args[], int count, Integer result )
+{
+    record( args, count, result );
+}
+
+void MemoCache::insert( const int args[], int count, Integer result )
+{
+    record( args, count, result );
+}
+
+template <class Arg>
+void MemoCache::record( const Arg args[], int count, Integer result )
+{
+    int e;
+    if (count != width)			// (only when first used, or
+    {					// since the function was redefined)
+	clear();
+	delete [] arguments;
+	arguments = new Integer[capacity * count];
+	width = count;
+    }
+    if (used < capacity)
+	e = used++;
+    else
+    {
+	e = oldest;			// remove from its hash chain
+	int *link = &buckets[hash( argsOf( e ), width ) & mask];
+	while (*link != e)
+	    link = &entries[*link].chain;
+	*link = entries[e].chain;
+	unlink( e );
+	discard( e );
+    }
+
+    Integer *kept = argsOf( e );
+    entries[e].result = result.keep();
+    bool small = result.isSmall();
+    for (int i = 0; i < count; i++)
+    {
+	kept[i] = Integer( args[i] ).keep();
+	small &= kept[i].isSmall();
+    }
+    if (!small)
+	large = true;
+
+    int *bucket = &buckets[hash( args, count ) & mask];
+    entries[e].chain = *bucket;
+    *bucket = e;
+    pushNewest( e );
+}
+
+//  A function is pure if it only calls pure functions -- assignments
+//  within a body only reach that call's own variables, so they
+//  cannot affect anything outside.  A function calling one that is
+//  not (yet) defined is not considered pure.  Recursion is allowed,
+//  so start by assuming everything is pure, and then remove the
+//  functions that call something impure until nothing changes.
+static void findPure( FunctionDef &funs )
+{
+    FunctionDef::iterator f;
+    set<string>::iterator c;
+    bool changed = true;
+
+    for (f = funs.begin(); f != funs.end(); f++)
+	f->second.pure = true;
+    while (changed)
+    {
+	changed = false;
+	for (f = funs.begin(); f != funs.end(); f++)
+	    for (c = f->second.callees.begin();
+		 f->second.pure && c != f->second.callees.end(); c++)
+	    {
+		FunctionDef::iterator callee = funs.find( *c );
+		if (callee == funs.end() || !callee->second.pure)
+		{
+		    f->second.pure = false;
+		    changed = true;
+		}
+	    }
+    }
+}
+
+thread_local MemoTable *threadMemos = NULL;
+
+MemoTable::~MemoTable()
+{
+    for (unsigned i = 0; i < caches.size(); i++)
+	delete caches[i];
+}
+
+MemoCache *MemoTable::cache( const FunDef &f )
+{
+    if (f.number >= (int) caches.size())
+	caches.resize( f.number + 1, NULL );
+    if (caches[f.number] == NULL)
+	caches[f.number] = new MemoCache();
+    return caches[f.number];
+}
+
+void MemoTable::clear()
+{
+    for (unsigned i = 0; i < caches.size(); i++)
+	if (caches[i] != NULL)
+	    caches[i]->clear();
+}
+
+//  merge
+//  Count this table's lookups as if the shared caches had made them
+void MemoTable::merge( FunctionDef &funs )
+{
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+    {
+	int n = f->second.number;
+	if (n < (int) caches.size() && caches[n] != NULL && f->second.memo != NULL)
+	{
+	    f->second.memo->hits += caches[n]->hits;
+	    f->second.memo->misses += caches[n]->misses;
+	}
+    }
+}
+
+set<string> analyzeFunction( FunctionDef &funs, const string &name )
+{
+    FunDef &func = funs[name];
+    func.callees.clear();
+    func.functionBody->findCalls( func.callees );
+
+    // Everything that calls this function, directly or not,
+    // may now compute something different
+    set<string> changed;
+    changed.insert( name );
+    bool grew = true;
+    while (grew)
+    {
+	grew = false;
+	for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+	{
+	    if (changed.count( f->first ))
+		continue;
+	    for (set<string>::iterator c = f->second.callees.begin();
+		 c != f->second.callees.end(); c++)
+		if (changed.count( *c ))
+		{
+		    changed.insert( f->first );
+		    grew = true;
+		    break;
+		}
+	}
+    }
+    for (set<string>::iterator c = changed.begin(); c != changed.end(); c++)
+	if (funs[*c].memo != NULL)
+	    funs[*c].memo->clear();
+
+    findPure( funs );
+    return changed;
+}
+
+void memoReport( ostream &out, FunctionDef &funs )
+{
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+    {
+	out << f->first << ": ";
+	if (f->second.builtin != NULL)
+	    out << "built in, not cached";
+	else if (!f->second.pure)
+	    out << "not pure, not cached";
+	else if (f->second.memo == NULL)
+	    out << "not yet called";
+	else
+	    out << f->second.memo->hits << " hits, "
+		<< f->second.memo->misses << " misses";
+	out << endl;
+    }
+}
@@ -0,0 +1,122 @@
+// Memoization Header File
+// A function whose result depends only on its arguments need not
+// be evaluated twice for the same arguments.  Each such function
+// is given a bounded cache of previous results, keyed by its
+// argument list; when the cache is full, the entry that was
+// least recently used is discarded to make room.
+//
+// All the storage for a cache is allocated when it is created,
+// or when the first result is recorded (for the arguments, whose
+// number is only known then), so that looking up and recording
+// results otherwise never allocates (except to keep a copy of a
+// large Integer, see integer.h).
+#ifndef MEMO
+#define MEMO
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include "funmap.h"
+#include "integer.h"
+using namespace std;
+
+class MemoCache
+{
+    private:
+	struct Entry
+	{
+	    int	    older, newer;	// neighbors in order of use
+	    int	    chain;	// next entry in the same bucket
+	    Integer result;	// function value for those arguments (kept)
+	};
+	Entry	*entries;	// all the entries, used or not
+	Integer	*arguments;	// theirs, width for each entry (kept)
+	int	*buckets;	// first entry for each hash value
+	int	capacity,	// number of entries
+		width,		// number of arguments in every entry
+		mask,		// number of buckets, less one
+		used,		// number of entries holding results
+		newest, oldest;	// ends of the order of use
+	bool	large;		// whether any entry has kept a large value
+
+	Integer *argsOf( int e ) const
+	{
+	    return arguments + e * width;
+	}
+
+	template <class Arg>
+	unsigned hash( const Arg args[], int count ) const;
+	template <class Arg>
+	bool lookup( const Arg args[], int count, Integer &result );
+	template <class Arg>
+	void record( const Arg args[], int count, Integer result );
+	void discard( int e );
+	void unlink( int e );
+	void pushNewest( int e );
+
+    public:
+	long	hits,		// lookups that found a result
+		misses;		// lookups that did not
+
+	MemoCache( int size = 1024 );
+	~MemoCache();
+	bool find( const Integer args[], int count, Integer &result );
+	void insert( const Integer args[], int count, Integer result );
+	// (the same, for arguments that are plain ints, as in machine code)
+	bool find( const int args[], int count, Integer &result );
+	void insert( const int args[], int count, Integer result );
+	void clear();
+};
+
+// MemoTable
+// While several threads evaluate with the same functions at once,
+// each must have caches of its own, since finding a result changes
+// the order of use.  A table holds one thread's caches, by function
+// number, each created when the function is first called.
+class MemoTable
+{
+    private:
+	vector<MemoCache *> caches;
+    public:
+	MemoTable()
+	{
+	}
+	MemoTable( const MemoTable & ) = delete;
+	~MemoTable();
+	MemoCache *cache( const FunDef &f );
+	void clear();			// forget every result
+	void merge( FunctionDef &funs );	// add statistics to the shared caches
+};
+
+// The table for the running thread, or NULL to use the shared caches
+extern thread_local MemoTable *threadMemos;
+
+// memoFor
+// The cache of previous results for a function, as the running
+// thread should see it (a function's own cache is only made once it
+// is first looked in, since many functions are never called)
+inline MemoCache *memoFor( FunDef *f )
+{
+    MemoTable *t = threadMemos;
+    if (t != NULL)
+	return t->cache( *f );
+    if (f->memo == NULL)
+	f->memo = new MemoCache();
+    return f->memo;
+}
+
+// analyzeFunction
+// Record which functions a newly (re)defined function calls,
+// discard every cached result that the definition may change,
+// and decide again which functions are pure.
+// Parameters:
+//	funs	(modified FunctionDef)	all defined functions
+//	name	(input string)		the function just defined
+// Returns:				the functions whose results may change
+set<string> analyzeFunction( FunctionDef &funs, const string &name );
+
+// memoReport
+// Display the cache statistics for every function
+void memoReport( ostream &out, FunctionDef &funs );
+
+#endif
@@ -0,0 +1,256 @@
+// Parallel Batch Evaluation Implementation File
+// Lines are collected into a window, and then evaluated in order:
+// each line that must stand alone by itself, and each run of the
+// others in chunks handed out to whichever worker is free.  Each
+// chunk's lines are evaluated into a string of its own, just as they
+// would have been written out, and the strings are written out in
+// order once the whole run is done.  A line answered with a message
+// rather than a value (such as a division by zero) leaves the latest
+// value as it was, so the latest is that of the last line with one.
+//
+// A worker's copy of the variables is brought up to date before
+// every run.  Should the shared variables have gained names since
+// the last run, the copy is rebuilt so that every name has the same
+// id in both (and the expressions resolved against the old copy
+// are discarded).
+#include <sstream>
+#include <string.h>
+#include <ctype.h>
+#include "parallel.h"
+
+//  standsAlone
+//  Whether a line must be evaluated by itself, in order:
+//  a definition, anything that may assign a variable,
+//  or an expression taking the previous value
+static bool standsAlone( const char line[] )
+{
+    if (implicitOperand( line ) || definesFunction( line ))
+	return true;
+    for (const char *p = line; *p != '\0'; p++)
+	if (*p == '=' && p[1] != '=' &&
+	    (p == line || strchr( "<>!=", p[-1] ) == NULL))
+	    return true;
+    return false;
+}
+
+ParallelBatch::ParallelBatch( int threadCount, VarTree &v, FunctionDef &f,
+			      EvalMode m, ostream &o, Workspace &s )
+    : vars( v ), funs( f ), mode( m ), out( o ), space( s )
+{
+    last = space.previous.keep();
+    first = count = 0;
+    next = 0;
+    generation = 0;
+    busy = 0;
+    stopping = false;
+    for (int i = 0; i < threadCount || i == 0; i++)
+    {
+	Worker *w = new Worker();
+	w->vars = NULL;
+	w->synced = 0;
+	workers.push_back( w );
+    }
+    for (unsigned i = 1; i < workers.size(); i++)
+	threads.push_back( thread( &ParallelBatch::serve, this, i ) );
+}
+
+ParallelBatch::~ParallelBatch()
+{
+    {
+	lock_guard<mutex> hold( lock );
+	stopping = true;
+    }
+    start.notify_all();
+    for (unsigned i = 0; i < threads.size(); i++)
+	threads[i].join();
+
+    // Count the workers' lookups along with everyone else's
+    ExprCache &cache = space.cache;
+    for (unsigned i = 0; i < workers.size(); i++)
+    {
+	workers[i]->memos.merge( funs );
+	cache.hits += workers[i]->space.cache.hits;
+	cache.misses += workers[i]->space.cache.misses;
+	delete workers[i]->vars;
+	delete workers[i];
+    }
+    last.discard();
+}
+
+void ParallelBatch::add( const char line[], size_t length )
+{
+    starts.push_back( text.size() );
+    text.insert( text.end(), line, line + length );
+    text.push_back( '\0' );
+    alone.push_back( standsAlone( &text[starts.back()] ) );
+    if (starts.size() >= (size_t) Window)
+	flush();
+}
+
+void ParallelBatch::finish()
+{
+    flush();
+    out.flush();
+}
+
+//  flush
+//  Evaluate the lines collected so far
+void ParallelBatch::flush()
+{
+    int lines = starts.size();
+    for (int i = 0; i < lines; )
+    {
+	int j = i + 1;
+	if (!alone[i])
+	    while (j < lines && !alone[j])
+		j++;
+	if (alone[i] || j - i < 2 * Chunk || workers.size() == 1)
+	    for ( ; i < j; i++)		// not worth sharing out
+		runAlone( i );
+	else
+	    runTogether( i, j );
+	i = j;
+    }
+    text.clear();
+    starts.clear();
+    alone.clear();
+}
+
+//  share
+//  Bring a worker's copy of the variables up to date
+void ParallelBatch::share( Worker &w )
+{
+    if (w.vars == NULL || w.synced != vars.size())
+    {
+	delete w.vars;
+	w.vars = new VarTree();
+	for (int i = 0; i < vars.size(); i++)
+	    w.vars->intern( vars.name( i ) );
+	w.synced = vars.size();
+	w.space.cache.clear();
+    }
+    for (int i = 0; i < w.synced; i++)
+	w.vars->value( i ) = vars.value( i );
+}
+
+//  setLast
+//  Make a new value the latest one, keeping a copy of it
+void ParallelBatch::setLast( Integer value )
+{
+    Integer old = last;
+    last = value.keep();
+    old.discard();
+}
+
+//  runAlone
+//  Evaluate one line on the calling thread, with the shared variables
+void ParallelBatch::runAlone( int line )
+{
+    const char *expr = &text[starts[line]];
+    space.remember( last );
+    setLast( evaluate( expr, vars, funs, mode, out, space ) );
+    out << '\n';
+
+    // What the workers derived from the old definitions is gone
+    if (definesFunction( expr ))
+	for (unsigned i = 0; i < workers.size(); i++)
+	{
+	    workers[i]->space.cache.clear();
+	    workers[i]->memos.clear();
+	}
+}
+
+//  runTogether
+//  Evaluate lines from..to-1, none standing alone, with every worker
+void ParallelBatch::runTogether( int from, int to )
+{
+    for (unsigned i = 0; i < workers.size(); i++)
+	share( *workers[i] );
+    first = from;
+    count = to - from;
+    int chunks = (count + Chunk - 1) / Chunk;
+    if ((int) results.size() < chunks)
+    {
+	results.resize( chunks );
+	latest.resize( chunks );
+	valued.resize( chunks );
+    }
+    next = 0;
+    {
+	lock_guard<mutex> hold( lock );
+	generation++;
+	busy = threads.size();
+    }
+    start.notify_all();
+
+    work( *workers[0] );
+    {
+	unique_lock<mutex> hold( lock );
+	done.wait( hold, [this] { return busy == 0; } );
+    }
+    for (int c = 0; c < chunks; c++)
+	out.write( results[c].data(), results[c].size() );
+    for (int c = chunks - 1; c >= 0; c--)
+	if (valued[c])
+	{
+	    setLast( latest[c] );
+	    break;
+	}
+    for (int c = 0; c < chunks; c++)
+    {
+	latest[c].discard();
+	latest[c] = Integer();
+    }
+}
+
+//  work
+//  Evaluate chunks of the current run until there are none left
+void ParallelBatch::work( Worker &w )
+{
+    ostringstream chunk;
+    int chunks = (count + Chunk - 1) / Chunk, c;
+    threadMemos = &w.memos;
+    while ((c = next++) < chunks)
+    {
+	chunk.str( "" );
+	valued[c] = false;
+	int from = first + c * Chunk,
+	    to = from + Chunk < first + count ? from + Chunk : first + count;
+	for (int i = from; i < to; i++)
+	{
+	    Integer value = evaluate( &text[starts[i]], *w.vars, funs, mode,
+				      chunk, w.space );
+	    chunk << '\n';
+	    if (w.space.answered)
+	    {
+		valued[c] = true;
+		latest[c].discard();
+		latest[c] = value.keep();
+	    }
+	}
+	results[c] = chunk.str();
+    }
+    threadMemos = NULL;
+}
+
+//  serve
+//  What each thread besides the calling one does:  wait for a run,
+//  and share in it
+void ParallelBatch::serve( int id )
+{
+    long seen = 0;
+    for (;;)
+    {
+	{
+	    unique_lock<mutex> hold( lock );
+	    start.wait( hold, [&] { return stopping || generation != seen; } );
+	    if (stopping)
+		return;
+	    seen = generation;
+	}
+	work( *workers[id] );
+	lock_guard<mutex> hold( lock );
+	if (--busy == 0)
+	    done.notify_one();
+    }
+}
@@ -0,0 +1,93 @@
+// Parallel Batch Evaluation Header File
+// Most lines of a batch file do not depend on one another:  an
+// expression that assigns nothing and does not begin with an operator
+// only reads the variables as the lines before it left them.  A run
+// of such lines may be evaluated by several threads at once, each
+// with its own copy of the variables, its own parsed expressions and
+// call stack, and its own caches of function results, while sharing
+// the function definitions, which nothing changes in the meantime.
+//
+// Any other line -- a definition, an assignment, or one using the
+// previous value -- is evaluated alone, in order, on the calling
+// thread, just as it would be without the others.  The results are
+// written in the order of the input, exactly as they would have been
+// by evaluating one line at a time.
+#ifndef PARALLEL
+#define PARALLEL
+
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "evaluate.h"
+#include "memo.h"
+using namespace std;
+
+class ParallelBatch
+{
+    private:
+	static const int Chunk = 64,		// lines handed to a thread at once
+			 Window = 1 << 16;	// lines collected before evaluating
+
+	struct Worker
+	{
+	    VarTree  *vars;		// copy of the shared variables
+	    int	      synced;		// how many of them it has
+	    Workspace space;
+	    MemoTable memos;
+	};
+
+	VarTree	    &vars;
+	FunctionDef &funs;
+	EvalMode     mode;
+	ostream	    &out;
+	Workspace   &space;		// for the lines evaluated alone
+
+	// Lines waiting to be evaluated
+	vector<char>   text;		// each followed by a terminator
+	vector<size_t> starts;		// where each line begins
+	vector<bool>   alone;		// must be evaluated by itself
+	Integer	       last;		// value of the latest line (kept)
+
+	// The run of lines being evaluated by all the workers
+	vector<Worker *> workers;	// the first is the calling thread
+	vector<thread>	 threads;	// for the others
+	vector<string>	 results;	// output of each chunk
+	vector<Integer>	 latest;	// value of each one's last line with one
+	vector<char>	 valued;	// (kept), and whether there was one
+					// (not bits, which threads would share)
+	int		 first, count;	// lines in the run
+	atomic<int>	 next;		// chunk to hand out next
+	mutex		 lock;
+	condition_variable start, done;
+	long		 generation;	// runs started so far
+	int		 busy;		// workers still on this run
+	bool		 stopping;
+
+	void flush();
+	void setLast( Integer value );
+	void share( Worker &w );
+	void runAlone( int line );
+	void runTogether( int from, int to );
+	void work( Worker &w );
+	void serve( int id );
+    public:
+	// threads (input int)	number of threads to evaluate with
+	// (the other parameters are as for runBatch)
+	ParallelBatch( int threads, VarTree &vars, FunctionDef &funs,
+		       EvalMode mode, ostream &out, Workspace &space );
+	ParallelBatch( const ParallelBatch & ) = delete;
+	~ParallelBatch();
+
+	// add
+	// Queue one line (which is not blank) for evaluation
+	void add( const char line[], size_t length );
+
+	// finish
+	// Evaluate every line still queued
+	void finish();
+};
+
+#endif
@@ -0,0 +1,154 @@
+// Profiler Implementation File
+// Each call in progress has a frame on the profiler's own stack,
+// noting when it began and how long the calls it made took; when
+// it ends, the difference is its exclusive time.  Its inclusive time
+// is only added when no other call of the same function is still
+// in progress, so that recursion is not counted over and over.
+//
+// The timer signal only counts ticks, which is all a signal handler
+// may safely do; the stack is recorded as it stands at the next call
+// or return, before that changes it, and given all the ticks since.
+#include <algorithm>
+#include <iomanip>
+#include <signal.h>
+#include <sys/time.h>
+#include "profile.h"
+#include "exprtree.h"
+
+thread_local Profiler *profiler = NULL;
+
+static volatile sig_atomic_t ticks = 0;	// timer signals not yet sampled
+
+static void tick( int )
+{
+    ticks = ticks + 1;
+}
+
+Profiler::Profiler()
+{
+    struct sigaction action;
+    action.sa_handler = tick;
+    sigemptyset( &action.sa_mask );
+    action.sa_flags = SA_RESTART;
+    struct itimerval every = { { 0, 1000 }, { 0, 1000 } };
+    ticks = 0;
+    timing = sigaction( SIGPROF, &action, NULL ) == 0 &&
+	     setitimer( ITIMER_PROF, &every, NULL ) == 0;
+}
+
+Profiler::~Profiler()
+{
+    if (timing)
+    {
+	struct itimerval never = { { 0, 0 }, { 0, 0 } };
+	setitimer( ITIMER_PROF, &never, NULL );
+	signal( SIGPROF, SIG_IGN );
+    }
+}
+
+//  sample
+//  Charge the ticks since the last sample to the stack as it is
+void Profiler::sample()
+{
+    long count = ticks;
+    ticks = 0;
+    string folded;
+    for (size_t i = 0; i < stack.size(); i++)
+    {
+	if (i > 0)
+	    folded += ';';
+	folded += functions[stack[i].function].name;
+    }
+    if (folded.empty())
+	folded = "(top level)";
+    samples[folded] += count;
+}
+
+void Profiler::enter( const FunDef &f )
+{
+    if (ticks != 0)
+	sample();
+    if ((int) functions.size() <= f.number)
+	functions.resize( f.number + 1, FunctionProfile() );
+    FunctionProfile &p = functions[f.number];
+    if (p.name.empty())
+	p.name = f.name;
+    p.calls++;
+    if (++p.active > p.maxDepth)
+	p.maxDepth = p.active;
+
+    Frame frame;
+    frame.function = f.number;
+    frame.children = 0;
+    frame.start = Clock::now();
+    stack.push_back( frame );
+}
+
+void Profiler::leave()
+{
+    Clock::time_point now = Clock::now();
+    if (ticks != 0)
+	sample();
+    Frame &frame = stack.back();
+    FunctionProfile &p = functions[frame.function];
+    long elapsed = chrono::duration_cast<chrono::nanoseconds>( now - frame.start ).count();
+    p.exclusive += elapsed - frame.children;
+    if (--p.active == 0)
+	p.inclusive += elapsed;
+    stack.pop_back();
+    if (!stack.empty())
+	stack.back().children += elapsed;
+}
+
+void Profiler::abandon()
+{
+    while (!stack.empty())
+	leave();
+}
+
+void Profiler::evaluating( const FunDef &f )
+{
+    FunctionProfile &p = functions[f.number];
+    if (p.body != f.functionBody)	// (defined anew since)
+    {
+	p.body = f.functionBody;
+	p.bodyNodes = f.functionBody->nodeCount();
+    }
+    p.nodes += p.bodyNodes;
+}
+
+void Profiler::report( ostream &out ) const
+{
+    vector<const FunctionProfile *> order;
+    for (size_t i = 0; i < functions.size(); i++)
+	if (functions[i].calls > 0)
+	    order.push_back( &functions[i] );
+    sort( order.begin(), order.end(),
+	  []( const FunctionProfile *a, const FunctionProfile *b )
+	  {
+	      return a->exclusive > b->exclusive;
+	  } );
+
+    out << left << setw( 12 ) << "function" << right
+	<< setw( 12 ) << "calls" << setw( 15 ) << "inclusive ms"
+	<< setw( 15 ) << "exclusive ms" << setw( 8 ) << "depth"
+	<< setw( 14 ) << "nodes" << endl;
+    out << fixed << setprecision( 3 );
+    for (size_t i = 0; i < order.size(); i++)
+	out << left << setw( 12 ) << order[i]->name << right
+	    << setw( 12 ) << order[i]->calls
+	    << setw( 15 ) << order[i]->inclusive / 1e6
+	    << setw( 15 ) << order[i]->exclusive / 1e6
+	    << setw( 8 ) << order[i]->maxDepth
+	    << setw( 14 ) << order[i]->nodes << endl;
+    out << defaultfloat << setprecision( 6 );
+    if (order.empty())
+	out << "(no calls yet)" << endl;
+}
+
+void Profiler::writeFolded( ostream &out ) const
+{
+    for (map<string, long>::const_iterator s = samples.begin(); s != samples.end(); s++)
+	out << s->first << ' ' << s->second << '\n';
+    out.flush();
+}
@@ -0,0 +1,98 @@
+// Profiler Header File
+// When a script is slow, the profiler tells which functions are to
+// blame.  While it is on, every call the tree walker makes records
+// for the function called
+// -- how many times it was called (whether or not the result was
+//    found in its cache),
+// -- the time spent in it, both inclusive (with everything it called,
+//    counted once however deeply it recursed) and exclusive (its own),
+// -- how deeply it was ever nested within itself,
+// -- and how many nodes its body held, summed over every evaluation
+//    of the body (every node is counted, whichever case of each
+//    conditional was taken).
+//
+// The call stacks are also sampled about every millisecond of
+// processor time, for drawing flame graphs:  a timer signal counts
+// the ticks, and the stack is recorded at the next call or return.
+//
+// Profiling is off unless a Profiler is made active, and then costs
+// nothing but a test of the pointer in Functional::evaluate.  While it
+// is on, no machine code is run (see jit.h), and the bytecode machine
+// is not profiled at all.  A profiler records only the thread that
+// made it active; any others evaluating meanwhile are not profiled.
+#ifndef PROFILE
+#define PROFILE
+
+#include <iostream>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include "funmap.h"
+using namespace std;
+
+class ExprNode;
+
+class Profiler
+{
+    private:
+	typedef chrono::steady_clock Clock;
+
+	struct FunctionProfile		// totals for one function
+	{
+	    string	    name;
+	    long	    calls;
+	    long	    inclusive, exclusive;	// nanoseconds
+	    int		    active;	// calls now in progress
+	    int		    maxDepth;
+	    long	    nodes;
+	    const ExprNode *body;	// whose nodes were counted,
+	    int		    bodyNodes;	// and how many there are
+	};
+	struct Frame			// one call in progress
+	{
+	    int		      function;	// by FunDef::number
+	    Clock::time_point start;
+	    long	      children;	// nanoseconds in calls it made
+	};
+
+	vector<FunctionProfile> functions;	// by FunDef::number
+	vector<Frame>	   stack;
+	map<string, long>  samples;	// ticks seen by each stack
+	bool		   timing;	// whether the timer was started
+
+	void sample();
+    public:
+	Profiler();
+	Profiler( const Profiler & ) = delete;
+	~Profiler();
+
+	// enter, leave
+	// A call to a function begins or ends
+	void enter( const FunDef &f );
+	void leave();
+
+	// abandon
+	// Every call in progress ends at once (the evaluation was
+	// abandoned, see evaluate.h)
+	void abandon();
+
+	// evaluating
+	// The body of the function entered last is about to be evaluated
+	void evaluating( const FunDef &f );
+
+	// report
+	// Display the totals, most exclusive time first
+	void report( ostream &out ) const;
+
+	// writeFolded
+	// Write the sampled stacks, one per line, as the names of the
+	// functions from the outermost, separated by semicolons, then
+	// the number of samples ("folded" for flame graph tools)
+	void writeFolded( ostream &out ) const;
+};
+
+// The profiler now recording this thread, if any
+extern thread_local Profiler *profiler;
+
+#endif
@@ -0,0 +1,376 @@
+// Evaluation Server Implementation File
+// Only the thread running the loop ever changes which events epoll
+// watches for, or releases a session, so a session can never vanish
+// while epoll may still report it.  A worker done with a session
+// that needs the loop's attention -- one whose client has gone, or
+// whose answers could not all be sent at once -- puts it on a list
+// and signals the loop through an eventfd.
+//
+// Workers send answers themselves when they can, so that a client
+// waiting for one answer at a time is not also waiting on the loop.
+#include <thread>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "server.h"
+#include "batch.h"
+#include "builtins.h"
+
+//  sendSome
+//  Send as much output as the socket will take now
+//  Returns:	false if the client can no longer be written to
+static bool sendSome( int fd, string &output )
+{
+    size_t sent = 0;
+    while (sent < output.size())
+    {
+	ssize_t n = send( fd, output.data() + sent, output.size() - sent,
+			  MSG_NOSIGNAL | MSG_DONTWAIT );
+	if (n > 0)
+	    sent += n;
+	else if (n < 0 && errno == EINTR)
+	    continue;
+	else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+	    break;
+	else
+	{
+	    output.clear();
+	    return false;
+	}
+    }
+    output.erase( 0, sent );
+    return true;
+}
+
+Server::Server( const char where[], const char *const defs[], int count,
+		const char libraryPath[], int threads, EvalMode m )
+    : path( where ), mode( m ), builtins( defs, defs + count ), library( m )
+{
+    listener = poller = notifier = -1;
+
+    ostream quiet( NULL );		// the definitions are not displayed
+    defineBuiltins( library.functions() );
+    for (const char *b : builtins)
+	library.evaluate( b, quiet );
+    if (libraryPath != NULL)
+    {
+	BatchStats stats;
+	if (!runBatch( libraryPath, library.variables(), library.functions(),
+		       mode, quiet, stats, library.workspace() ))
+	{
+	    cerr << "cannot read " << libraryPath << endl;
+	    return;
+	}
+    }
+
+    sockaddr_un address;
+    memset( &address, 0, sizeof address );
+    address.sun_family = AF_UNIX;
+    if (strlen( path ) >= sizeof address.sun_path)
+    {
+	cerr << "socket path too long: " << path << endl;
+	return;
+    }
+    strcpy( address.sun_path, path );
+    unlink( path );			// left by an earlier server
+    listener = socket( AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0 );
+    if (listener < 0 || bind( listener, (sockaddr *) &address, sizeof address ) < 0
+	|| listen( listener, SOMAXCONN ) < 0)
+    {
+	cerr << "cannot listen on " << path << ": " << strerror( errno ) << endl;
+	listener = -1;
+	return;
+    }
+
+    poller = epoll_create1( EPOLL_CLOEXEC );
+    notifier = eventfd( 0, EFD_NONBLOCK | EFD_CLOEXEC );
+    epoll_event e;
+    e.events = EPOLLIN;
+    e.data.ptr = NULL;			// (the listener)
+    epoll_ctl( poller, EPOLL_CTL_ADD, listener, &e );
+    e.data.ptr = &attend;		// (the notifier)
+    epoll_ctl( poller, EPOLL_CTL_ADD, notifier, &e );
+
+    for (int i = 0; i < threads || i == 0; i++)
+	thread( &Server::serve, this ).detach();
+}
+
+void Server::run()
+{
+    epoll_event events[64];
+    for (;;)
+    {
+	int n = epoll_wait( poller, events, 64, -1 );
+	if (n < 0 && errno != EINTR)
+	{
+	    cerr << "epoll_wait: " << strerror( errno ) << endl;
+	    return;
+	}
+	for (int i = 0; i < n; i++)
+	{
+	    void *which = events[i].data.ptr;
+	    if (which == NULL)
+		accept();
+	    else if (which == &attend)
+		attended();
+	    else if (events[i].events & EPOLLOUT)
+		flush( (Session *) which );	// (receiving waits a turn)
+	    else
+		receive( (Session *) which );
+	}
+    }
+}
+
+//  accept
+//  Begin a session for every client waiting to connect
+void Server::accept()
+{
+    int fd;
+    while ((fd = accept4( listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC )) >= 0)
+    {
+	Session *s = new Session( mode );
+	s->fd = fd;
+	s->started = false;		// (see evaluateLine)
+	s->queued = s->closed = s->writing = s->attending = false;
+	epoll_event e;
+	e.events = EPOLLIN;
+	e.data.ptr = s;
+	epoll_ctl( poller, EPOLL_CTL_ADD, fd, &e );
+    }
+}
+
+//  receive
+//  Read whatever a client has sent, and hand the whole lines
+//  to a worker, unless one already has the session
+void Server::receive( Session *s )
+{
+    char buffer[1 << 16];
+    bool gone = false;
+    for (;;)
+    {
+	ssize_t n = read( s->fd, buffer, sizeof buffer );
+	if (n > 0)
+	    s->input.append( buffer, n );
+	else if (n < 0 && errno == EINTR)
+	    continue;
+	else
+	{
+	    gone = n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+	    break;
+	}
+    }
+    if (gone && !s->input.empty() && s->input.back() != '\n')
+	s->input += '\n';		// the last line need not end
+
+    bool schedule = false;
+    {
+	lock_guard<mutex> hold( s->lock );
+	size_t end = s->input.rfind( '\n' );
+	if (end != string::npos)
+	{
+	    s->lines.append( s->input, 0, end + 1 );
+	    s->input.erase( 0, end + 1 );
+	}
+	if (gone)
+	    s->closed = true;
+	if (!s->queued && !s->lines.empty())
+	    schedule = s->queued = true;
+    }
+    if (schedule)
+    {
+	lock_guard<mutex> hold( queueLock );
+	ready.push_back( s );
+	wake.notify_one();
+    }
+    if (gone)
+	settle( s );
+}
+
+//  flush
+//  Send what a worker could not
+void Server::flush( Session *s )
+{
+    {
+	lock_guard<mutex> hold( s->lock );
+	if (!sendSome( s->fd, s->output ))
+	    s->closed = true;		// (nobody to answer)
+    }
+    settle( s );
+}
+
+//  attended
+//  Look at every session the workers have finished with
+void Server::attended()
+{
+    uint64_t signals;
+    if (read( notifier, &signals, sizeof signals ) < 0)
+	return;				// (nothing yet)
+    vector<Session *> sessions;
+    {
+	lock_guard<mutex> hold( queueLock );
+	sessions.swap( attend );
+    }
+    for (Session *s : sessions)
+    {
+	{
+	    lock_guard<mutex> hold( s->lock );
+	    s->attending = false;
+	}
+	settle( s );
+    }
+}
+
+//  watch
+//  Have epoll report what the session is now waiting for
+//  (the session must be locked)
+void Server::watch( Session &s )
+{
+    epoll_event e;
+    e.events = 0;
+    if (!s.closed)
+	e.events |= EPOLLIN;
+    if (s.writing)
+	e.events |= EPOLLOUT;
+    e.data.ptr = &s;
+    epoll_ctl( poller, EPOLL_CTL_MOD, s.fd, &e );
+}
+
+//  settle
+//  Once something about a session has changed, arrange for what
+//  it needs next:  room to send its answers, or to be released
+//  (which must wait while a worker holds it, or until the loop
+//  has attended to it)
+void Server::settle( Session *s )
+{
+    {
+	lock_guard<mutex> hold( s->lock );
+	if (!s->closed || !s->output.empty() || s->queued || s->attending)
+	{
+	    s->writing = !s->output.empty();
+	    watch( *s );
+	    return;
+	}
+    }
+    release( s );
+}
+
+//  release
+//  End a session whose client has gone and has been answered
+void Server::release( Session *s )
+{
+    epoll_ctl( poller, EPOLL_CTL_DEL, s->fd, NULL );
+    close( s->fd );
+    delete s;
+}
+
+//  serve
+//  What each worker does:  take a session, evaluate its lines
+//  until no more have come, and let it go again
+void Server::serve()
+{
+    string work;			// the lines being evaluated
+    for (;;)
+    {
+	Session *s;
+	{
+	    unique_lock<mutex> hold( queueLock );
+	    wake.wait( hold, [this] { return !ready.empty(); } );
+	    s = ready.front();
+	    ready.pop_front();
+	}
+	bool notify = false;
+	for (;;)
+	{
+	    {
+		lock_guard<mutex> hold( s->lock );
+		work.clear();
+		work.swap( s->lines );
+		if (work.empty())
+		{
+		    s->queued = false;
+		    if ((s->closed || !s->output.empty()) && !s->attending)
+			notify = s->attending = true;
+		    break;
+		}
+	    }
+	    answer( *s, work );
+	}
+	if (notify)
+	{
+	    {
+		lock_guard<mutex> hold( queueLock );
+		attend.push_back( s );
+	    }
+	    uint64_t one = 1;
+	    if (write( notifier, &one, sizeof one ) < 0)
+		cerr << "cannot signal the loop: " << strerror( errno ) << endl;
+	}
+    }
+}
+
+//  answer
+//  Evaluate some whole lines of a session, and send the answers
+void Server::answer( Session &s, const string &lines )
+{
+    size_t start = 0, end;
+    while ((end = lines.find( '\n', start )) != string::npos)
+    {
+	string line( lines, start, end - start );
+	if (!line.empty() && line.back() == '\r')
+	    line.pop_back();
+	evaluateLine( s, line.c_str() );
+	s.reply << '\n';
+	start = end + 1;
+    }
+
+    string answers = s.reply.str();
+    s.reply.str( "" );
+    lock_guard<mutex> hold( s.lock );
+    s.output += answers;
+    if (!s.writing && !sendSome( s.fd, s.output ))
+	s.closed = true;
+}
+
+//  evaluateLine
+//  Evaluate one line of a session, displaying the answer
+void Server::evaluateLine( Session &s, const char line[] )
+{
+    const char *p = line;
+    while (isspace( *p ))
+	p++;
+    if (*p == '\0')
+	return;				// a blank line has a blank answer
+    if (strcmp( p, ":shared" ) == 0)
+    {
+	if (!s.interp.sharing())
+	    s.interp.share( library.functions() );	// nothing before applies to it
+	s.reply << "shared";
+	return;
+    }
+    if (*p == ':')
+    {
+	s.reply << "unknown command " << p;
+	return;
+    }
+
+    if (!s.started && !s.interp.sharing())	// its own functions, then
+    {
+	ostream quiet( NULL );
+	defineBuiltins( s.interp.functions() );
+	for (const char *b : builtins)
+	    s.interp.evaluate( b, quiet );
+	s.started = true;
+    }
+    if (!definesFunction( p ) && callsUndefined( p, s.interp.functions() ))
+    {
+	s.reply << "undefined function";
+	return;
+    }
+    s.interp.evaluate( p, s.reply );	// (which refuses definitions while sharing)
+}
@@ -0,0 +1,114 @@
+// Evaluation Server Header File
+// Besides the interactive prompt and batch files, expressions may be
+// sent to a server listening on a Unix domain socket, by any number
+// of clients at once.  The protocol is a line at a time:  each line
+// a client sends is evaluated just as it would be at the prompt, and
+// answered with exactly one line -- its value, the definition made,
+// or nothing at all for a blank line.
+//
+// Every connection is a session of its own, an Interpreter (see
+// interpreter.h) with its own variables, previous value, parsed
+// expressions and function results.  A session
+// begins with its own copy of the functions every session begins
+// with, and may define more.  Or, by sending the line ":shared", it
+// may instead call the functions of a library shared by all the
+// sessions, sparing it defining them; a session may not define
+// functions of its own while it uses the library.
+//
+// A line calling a function the session does not have is answered
+// "undefined function" rather than evaluated, and one that divides
+// by zero is answered "division by zero" (see evaluate.h).
+//
+// One thread waits on every connection at once (with epoll), and
+// hands each session that has received whole lines to a pool of
+// worker threads.  A session is only ever held by one worker, which
+// evaluates its lines in the order they arrived.
+#ifndef SERVER
+#define SERVER
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include "interpreter.h"
+using namespace std;
+
+class Server
+{
+    private:
+	struct Session
+	{
+	    int		  fd;		// the connection
+	    Interpreter	  interp;	// its own functions, or the library's
+	    bool	  started;	// whether it has defined its own yet
+	    ostringstream reply;	// what one evaluation displays
+	    string	  input,	// received, not yet a whole line
+			  lines,	// whole lines not yet evaluated
+			  output;	// answers not yet sent
+	    bool	  queued,	// waiting for or held by a worker
+			  closed,	// the client has gone
+			  writing,	// waiting for room to send output
+			  attending;	// waiting for the loop to look at it
+	    mutex	  lock;		// for lines, output and the flags
+
+	    Session( EvalMode mode ) : interp( mode )
+	    {
+	    }
+	};
+
+	const char *path;		// where the socket is
+	int	    listener,		// the socket accepting connections
+		    poller,		// epoll, for all the file descriptors
+		    notifier;		// eventfd, for the workers to signal
+	EvalMode    mode;
+	vector<const char *> builtins;	// what each session defines first
+	Interpreter library;		// whose functions sessions may share
+
+	// Sessions with lines to evaluate, for the workers,
+	// and sessions the workers are done with, for the loop
+	deque<Session *>   ready;
+	vector<Session *>  attend;
+	mutex		   queueLock;
+	condition_variable wake;
+
+	// (the thread running the loop)
+	void accept();
+	void receive( Session *s );
+	void flush( Session *s );
+	void attended();
+	void watch( Session &s );
+	void settle( Session *s );
+	void release( Session *s );
+	// (the workers)
+	void serve();
+	void answer( Session &s, const string &lines );
+	void evaluateLine( Session &s, const char line[] );
+    public:
+	// path	    (input string)	   where to listen
+	// builtins (input string array)   definitions every session begins with
+	//				   (after the functions built in)
+	// count    (input int)		   how many of them
+	// library  (input string)	   file of further definitions to share
+	//				   (NULL if none)
+	// threads  (input int)		   number of worker threads
+	// mode	    (input EvalMode)	   which engine to evaluate with
+	Server( const char path[], const char *const builtins[], int count,
+		const char library[], int threads, EvalMode mode );
+	Server( const Server & ) = delete;
+
+	// ok
+	// Whether the server is listening (if not, why was written
+	// to the standard error)
+	bool ok() const
+	{
+	    return listener >= 0 && poller >= 0 && notifier >= 0;
+	}
+
+	// run
+	// Answer clients until the process is stopped
+	void run();
+};
+
+#endif
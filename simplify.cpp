@@ -0,0 +1,213 @@
+// Simplification Implementation File
+// Each node simplifies its children first, and then itself.
+// A node whose children did not change is returned as it was.
+#include "simplify.h"
+#include "exprtree.h"
+#include "snapshot.h"
+
+bool Value::constant( Integer &v ) const
+{
+    v = value;
+    return true;
+}
+
+bool Value::sideEffectFree() const
+{
+    return true;
+}
+
+bool Variable::sideEffectFree() const
+{
+    return true;
+}
+
+//  Division may fail at run time, so it is never discarded
+bool Operation::sideEffectFree() const
+{
+    return oper != DIVIDE && oper != MODULO &&
+	left->sideEffectFree() && right->sideEffectFree();
+}
+
+int Operation::nodeCount() const
+{
+    return 1 + left->nodeCount() + right->nodeCount();
+}
+
+//  fold
+//  Apply an operator to two constants, unless that must fail
+static bool fold( OpKind o, Integer l, Integer r, Integer &result )
+{
+    if ((o == DIVIDE || o == MODULO) && r.isZero())
+	return false;
+    switch (o)
+    {
+    case PLUS:		result = apply<PLUS>( l, r );		break;
+    case MINUS:		result = apply<MINUS>( l, r );		break;
+    case TIMES:		result = apply<TIMES>( l, r );		break;
+    case DIVIDE:	result = apply<DIVIDE>( l, r );		break;
+    case MODULO:	result = apply<MODULO>( l, r );		break;
+    case LESS_EQ:	result = apply<LESS_EQ>( l, r );	break;
+    case GREATER_EQ:	result = apply<GREATER_EQ>( l, r );	break;
+    case LESS:		result = apply<LESS>( l, r );		break;
+    case GREATER:	result = apply<GREATER>( l, r );	break;
+    case EQUAL:		result = apply<EQUAL>( l, r );		break;
+    case NOT_EQUAL:	result = apply<NOT_EQUAL>( l, r );	break;
+    default:		return false;
+    }
+    return true;
+}
+
+//  combine
+//  Simplify the operation  l o r,  whose operands are simplified
+//  Returns:		the simpler tree, or NULL if there is none
+ExprNode *Operation::combine( Arena &a, ExprNode *l, OpKind o, ExprNode *r )
+{
+    Integer lv, rv, result;
+    bool lc = l->constant( lv ), rc = r->constant( rv );
+    if (lc && rc && fold( o, lv, rv, result ))
+	return new (a) Value( result );
+
+    switch (o)
+    {
+    case PLUS:
+	if (rc && rv == 0)
+	    return l;
+	if (lc && lv == 0)
+	    return r;
+	break;
+    case MINUS:
+	if (rc && rv == 0)
+	    return l;
+	if (lc && lv == 0)		// a negation -- of a negation?
+	{
+	    Operation *n = dynamic_cast<Operation *>( r );
+	    Integer nv;
+	    if (n != NULL && n->oper == MINUS && n->left->constant( nv ) && nv == 0)
+		return n->right;
+	}
+	break;
+    case TIMES:
+	if (rc && rv == 1)
+	    return l;
+	if (lc && lv == 1)
+	    return r;
+	if ((rc && rv == 0 && l->sideEffectFree()) ||
+	    (lc && lv == 0 && r->sideEffectFree()))
+	    return new (a) Value( 0 );
+	break;
+    case DIVIDE:
+	if (rc && rv == 1)
+	    return l;
+	break;
+    default:
+	break;
+    }
+
+    //  (e + c1) + c2  becomes  e + (c1 + c2), and likewise for *
+    if ((o == PLUS || o == TIMES) && rc)
+    {
+	Operation *n = dynamic_cast<Operation *>( l );
+	Integer nv;
+	if (n != NULL && n->oper == o && n->right->constant( nv ) &&
+	    fold( o, nv, rv, result ))
+	{
+	    ExprNode *c = new (a) Value( result );
+	    ExprNode *e = combine( a, n->left, o, c );
+	    return e != NULL ? e : make( a, n->left, o, c );
+	}
+    }
+    return NULL;
+}
+
+ExprNode *Operation::simplify( Arena &a )
+{
+    ExprNode *l = left->simplify( a ),
+	     *r = right->simplify( a ),
+	     *e = combine( a, l, oper, r );
+    if (e != NULL)
+	return e;
+    if (l == left && r == right)
+	return this;
+    return make( a, l, oper, r );
+}
+
+//  The target of an assignment is only a name, so it stays
+ExprNode *Assignment::simplify( Arena &a )
+{
+    ExprNode *r = right->simplify( a );
+    if (r == right)
+	return this;
+    return new (a) Assignment( left, r );
+}
+
+bool Assignment::sideEffectFree() const
+{
+    return false;
+}
+
+ExprNode *Conditional::simplify( Arena &a )
+{
+    ExprNode *b = test->simplify( a );
+    Integer value;
+    if (b->constant( value ))
+	return !value.isZero() ? trueCase->simplify( a ) : falseCase->simplify( a );
+
+    ExprNode *t = trueCase->simplify( a ),
+	     *f = falseCase->simplify( a );
+    if (b == test && t == trueCase && f == falseCase)
+	return this;
+    return new (a) Conditional( b, t, f );
+}
+
+bool Conditional::sideEffectFree() const
+{
+    return test->sideEffectFree() && trueCase->sideEffectFree() &&
+	falseCase->sideEffectFree();
+}
+
+int Conditional::nodeCount() const
+{
+    return 1 + test->nodeCount() + trueCase->nodeCount() + falseCase->nodeCount();
+}
+
+//  A call is kept as it is, but its arguments may be simplified
+ExprNode *Functional::simplify( Arena &a )
+{
+    ExprNode *args[10] = {NULL};
+    bool changed = false;
+    for (int i = 0; i < 10 && para_list[i] != NULL; i++)
+    {
+	args[i] = para_list[i]->simplify( a );
+	changed = changed || args[i] != para_list[i];
+    }
+    if (!changed)
+	return this;
+    return new (a) Functional( name, args, funcs );
+}
+
+int Functional::nodeCount() const
+{
+    int count = 1;
+    for (int i = 0; i < 10 && para_list[i] != NULL; i++)
+	count += para_list[i]->nodeCount();
+    return count;
+}
+
+void simplifyReport( ostream &out, FunctionDef &funs )
+{
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+    {
+	FunDef &func = f->second;
+	if (func.builtin != NULL)
+	{
+	    out << f->first << ": built in" << endl;
+	    continue;
+	}
+	decoded( func );		// (one loaded keeps no source)
+	out << f->first << ": " << func.parsedBody->nodeCount() << " nodes, "
+	    << func.functionBody->nodeCount() << " as evaluated" << endl
+	    << "    " << func.parsedBody->toLispString() << endl;
+	if (func.functionBody != func.parsedBody)
+	    out << " => " << func.functionBody->toLispString() << endl;
+    }
+}
@@ -0,0 +1,24 @@
+// Simplification Header File
+// A function body is simplified once, when it is defined, so
+// that every later call does less work.  Simplifying
+// -- evaluates any operation whose operands are both constants
+//    (except a division that would fail, left for run time),
+// -- gathers constants:  (x + 2) + 3  becomes  x + 5,
+// -- removes identities:  x + 0,  x - 0,  x * 1,  x / 1,
+//    and the double negation  0 - (0 - x),
+// -- replaces  x * 0  by 0, if x has no effects to preserve,
+// -- and chooses one case of a conditional with a constant test.
+#ifndef SIMPLIFY
+#define SIMPLIFY
+
+#include <iostream>
+#include "funmap.h"
+using namespace std;
+
+// simplifyReport
+// Display every function body as parsed and as evaluated (after
+// simplifying it and sharing subexpressions, see cse.h),
+// with the number of nodes in each
+void simplifyReport( ostream &out, FunctionDef &funs );
+
+#endif
@@ -0,0 +1,533 @@
+// Session Snapshot Implementation File
+// A snapshot file is laid out as:
+// -- a header, giving the counts and where each section begins,
+// -- the names:  where each begins within their text, and the text,
+// -- the variables:  the previous value, then each name and value,
+// -- the functions:  for each, its name, number, whether it is pure,
+//    its parameters, its callees, and where its body is,
+// -- and the bodies:  for each, its local variables, then its nodes.
+// Apart from the header, the names, and the limbs of large values,
+// everything is a sequence of numbers of seven bits to a byte (the
+// last byte of each having its top bit clear), so that small numbers
+// take a single byte.
+// A node is a tag followed by what it holds, then by its children.
+//
+// An Integer is one number:  a small value v is saved as 2v (or
+// -2v-1, if negative) doubled; a large one as its limb count, times
+// four, plus 2 if negative, plus 1, followed by its limbs.
+#include <fstream>
+#include <algorithm>
+#include <mutex>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "snapshot.h"
+#include "exprtree.h"
+#include "bytecode.h"
+#include "memo.h"
+#include "arena.h"
+
+static const char Magic[8] = { 'E', 'X', 'P', 'R', 'S', 'N', 'A', 'P' };
+static const uint32_t Version = 1;
+
+struct Header
+{
+    char     magic[8];
+    uint32_t version;
+    uint32_t names, variables, functions;
+    uint64_t nameStarts,		// offsets of the sections:
+	     nameText,
+	     variableData,
+	     functionData,
+	     bodies,
+	     size;			// of the whole file
+};
+
+// What each node is saved as
+enum NodeTag
+{
+    NODE_VALUE,				// value
+    NODE_VARIABLE,			// name
+    NODE_OPERATION,			// operator, left, right
+    NODE_CONDITIONAL,			// test, true case, false case
+    NODE_CALL				// name, argument count, arguments
+};
+
+class Snapshot
+{
+    public:
+	const char     *base;		// the whole file, as mapped
+	size_t		size;
+	const Header   *header;
+	const uint32_t *nameStarts;	// names + 1 of them
+	mutex		lock;		// while decoding
+	StoredBody     *bodies;		// one for each function
+
+	string name( unsigned id ) const
+	{
+	    if (id >= header->names)
+		return string();
+	    const char *text = base + header->nameText;
+	    return string( text + nameStarts[id], nameStarts[id + 1] - nameStarts[id] );
+	}
+};
+
+// Reader
+// Reads numbers from one section of a snapshot, noting if any
+// would lie beyond it
+class Reader
+{
+    private:
+	const unsigned char *at, *end;
+    public:
+	bool bad;
+
+	Reader( const Snapshot &s, size_t from, size_t to )
+	{
+	    at = (const unsigned char *) s.base + from;
+	    end = (const unsigned char *) s.base + to;
+	    bad = from > to;
+	}
+	int byte()
+	{
+	    if (at < end)
+		return *at++;
+	    bad = true;
+	    return 0;
+	}
+	unsigned long number()
+	{
+	    unsigned long n = 0;
+	    for (int shift = 0; shift < 64; shift += 7)
+	    {
+		int b = byte();
+		n |= (unsigned long) (b & 0x7f) << shift;
+		if ((b & 0x80) == 0)
+		    return n;
+	    }
+	    bad = true;
+	    return 0;
+	}
+	Integer integer()
+	{
+	    unsigned long n = number();
+	    if ((n & 1) == 0)
+		return Integer( (long) (n >> 2 ^ -(n >> 1 & 1)) );
+	    unsigned long count = n >> 2;
+	    if (count > (unsigned long) (end - at) / 4)
+	    {
+		bad = true;
+		return Integer();
+	    }
+	    vector<uint32_t> limbs( count );
+	    memcpy( limbs.data(), at, count * 4 );
+	    at += count * 4;
+	    return Integer::fromMagnitude( (n & 2) != 0, limbs.data(), count );
+	}
+};
+
+void SnapshotWriter::number( unsigned long n )
+{
+    while (n >= 0x80)
+    {
+	byte( (int) (n & 0x7f) | 0x80 );
+	n >>= 7;
+    }
+    byte( (int) n );
+}
+
+void SnapshotWriter::integer( Integer i )
+{
+    if (i.isSmall())
+    {
+	long v = i.small();
+	number( ((unsigned long) v << 1 ^ (unsigned long) (v >> 63)) << 1 );
+	return;
+    }
+    vector<uint32_t> limbs;
+    bool negative = i.magnitude( limbs );
+    number( limbs.size() << 2 | (negative ? 2 : 0) | 1 );
+    const unsigned char *bytes = (const unsigned char *) limbs.data();
+    out->insert( out->end(), bytes, bytes + limbs.size() * 4 );
+}
+
+void SnapshotWriter::name( const string &s )
+{
+    auto found = ids.emplace( s, names.size() );
+    if (found.second)
+	names.push_back( s );
+    number( found.first->second );
+}
+
+void Value::save( SnapshotWriter &w ) const
+{
+    w.byte( NODE_VALUE );
+    w.integer( value );
+}
+
+void Variable::save( SnapshotWriter &w ) const
+{
+    w.byte( NODE_VARIABLE );
+    w.name( name );
+}
+
+void Operation::save( SnapshotWriter &w ) const
+{
+    w.byte( NODE_OPERATION );
+    w.byte( oper );
+    left->save( w );
+    right->save( w );
+}
+
+void Conditional::save( SnapshotWriter &w ) const
+{
+    w.byte( NODE_CONDITIONAL );
+    test->save( w );
+    trueCase->save( w );
+    falseCase->save( w );
+}
+
+void Functional::save( SnapshotWriter &w ) const
+{
+    int count = 0;
+    while (count < 10 && para_list[count] != NULL)
+	count++;
+    w.byte( NODE_CALL );
+    w.name( name );
+    w.number( count );
+    for (int i = 0; i < count; i++)
+	para_list[i]->save( w );
+}
+
+//  decodeNode
+//  Rebuild one saved node, with its children
+static ExprNode *decodeNode( Reader &r, const Snapshot &s, Arena &a, FunctionDef *funs )
+{
+    switch (r.byte())
+    {
+    case NODE_VALUE:
+	return new (a) Value( r.integer() );
+    case NODE_VARIABLE:
+	return new (a) Variable( s.name( r.number() ) );
+    case NODE_OPERATION:
+    {
+	OpKind o = (OpKind) r.byte();
+	ExprNode *left = decodeNode( r, s, a, funs );
+	ExprNode *right = decodeNode( r, s, a, funs );
+	Operation *op = Operation::make( a, left, o, right );
+	if (op != NULL)
+	    return op;
+	break;
+    }
+    case NODE_CONDITIONAL:
+    {
+	ExprNode *test = decodeNode( r, s, a, funs );
+	ExprNode *t = decodeNode( r, s, a, funs );
+	return new (a) Conditional( test, t, decodeNode( r, s, a, funs ) );
+    }
+    case NODE_CALL:
+    {
+	string name = s.name( r.number() );
+	ExprNode *args[10] = { NULL };
+	unsigned long count = r.number();
+	for (unsigned long i = 0; i < count && i < 10 && !r.bad; i++)
+	    args[i] = decodeNode( r, s, a, funs );
+	return new (a) Functional( name, args, funs );
+    }
+    }
+    r.bad = true;			// (the file has been damaged)
+    return new (a) Value( 0 );
+}
+
+//  checkNode
+//  Whether one saved node, with its children, would be decoded into
+//  a tree that may be evaluated:  every tag and operator is one there
+//  is, only a variable is assigned, every name is in the table, every
+//  function called is defined, and it is nested no more than MaxDepth
+static bool checkNode( Reader &r, const Snapshot &s, const FunctionDef &funs, int depth )
+{
+    if (depth > MaxDepth)
+	return false;
+    switch (r.byte())
+    {
+    case NODE_VALUE:
+	r.integer();
+	return !r.bad;
+    case NODE_VARIABLE:
+	return r.number() < s.header->names && !r.bad;
+    case NODE_OPERATION:
+    {
+	int o = r.byte();
+	if (o == ASSIGN)
+	    return r.byte() == NODE_VARIABLE && r.number() < s.header->names
+		   && checkNode( r, s, funs, depth + 1 );
+	return o >= PLUS && o <= NOT_EQUAL && checkNode( r, s, funs, depth + 1 )
+	       && checkNode( r, s, funs, depth + 1 );
+    }
+    case NODE_CONDITIONAL:
+	return checkNode( r, s, funs, depth + 1 ) && checkNode( r, s, funs, depth + 1 )
+	       && checkNode( r, s, funs, depth + 1 );
+    case NODE_CALL:
+    {
+	unsigned long id = r.number();
+	if (id >= s.header->names || funs.find( s.name( id ) ) == funs.end())
+	    return false;
+	unsigned long count = r.number();
+	if (count > 10)
+	    return false;
+	for (unsigned long i = 0; i < count; i++)
+	    if (!checkNode( r, s, funs, depth + 1 ))
+		return false;
+	return !r.bad;
+    }
+    }
+    return false;
+}
+
+//  checkBody
+//  Whether a function's saved body would be decoded whole, with its
+//  parameters as the first of its local variables
+static bool checkBody( const FunDef &f, const Snapshot &s, const FunctionDef &funs )
+{
+    Reader r( s, s.header->bodies + f.stored->offset, s.size );
+    unsigned long count = r.number();
+    for (unsigned long i = 0; i < count && !r.bad; i++)
+    {
+	unsigned long id = r.number();
+	if (id >= s.header->names || (i < 10 && f.parameter[i] != ""
+				      && s.name( id ) != f.parameter[i]))
+	    return false;
+    }
+    if (count < 10 && f.parameter[count] != "")
+	return false;			// (a parameter has no slot)
+    return !r.bad && checkNode( r, s, funs, 0 );
+}
+
+void decodeStored( FunDef &f )
+{
+    StoredBody *stored = f.stored;
+    Snapshot &s = *stored->snapshot;
+    lock_guard<mutex> hold( s.lock );
+    if (stored->decoded.load( memory_order_relaxed ))
+	return;				// (by another thread meanwhile)
+
+    Reader r( s, s.header->bodies + stored->offset, s.size );
+    f.locals = new VarTree();		// in the same order as saved
+    for (unsigned long count = r.number(); count > 0 && !r.bad; count--)
+	f.locals->intern( s.name( r.number() ) );
+    f.arena = new Arena();
+    f.functionBody = decodeNode( r, s, *f.arena, stored->funs );	// (checked
+    f.functionBody->resolve( *f.locals );				// when loaded)
+    f.parsedBody = f.functionBody;	// (the source is not kept)
+    f.code = new Program();
+    f.functionBody->compileTail( *f.code );
+    stored->decoded.store( true, memory_order_release );
+}
+
+bool saveSnapshot( const char path[], VarTree &vars, FunctionDef &funs,
+		   Workspace &space )
+{
+    vector<unsigned char> variables, functions, bodies;
+    SnapshotWriter w( variables );
+    w.integer( space.previous );
+    for (int i = 0; i < vars.size(); i++)
+    {
+	w.name( vars.name( i ) );
+	w.integer( vars.value( i ) );
+    }
+
+    // In order of number, as they were first defined
+    // (those built in are there in every session anyway)
+    vector<FunDef *> order;
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+	if (f->second.builtin == NULL)
+	    order.push_back( &f->second );
+    sort( order.begin(), order.end(),
+	  []( FunDef *a, FunDef *b ) { return a->number < b->number; } );
+    for (FunDef *f : order)
+    {
+	decoded( *f );
+	w.into( bodies );
+	size_t offset = w.size();
+	w.number( f->locals->size() );
+	for (int i = 0; i < f->locals->size(); i++)
+	    w.name( f->locals->name( i ) );
+	f->functionBody->save( w );
+
+	w.into( functions );
+	w.name( f->name );
+	w.number( f->number );
+	w.byte( f->pure );
+	int count = 0;
+	while (count < 10 && f->parameter[count] != "")
+	    count++;
+	w.number( count );
+	for (int i = 0; i < count; i++)
+	    w.name( f->parameter[i] );
+	w.number( f->callees.size() );
+	for (const string &c : f->callees)
+	    w.name( c );
+	w.number( offset );
+    }
+
+    Header h;
+    memcpy( h.magic, Magic, sizeof Magic );
+    h.version = Version;
+    h.names = w.names.size();
+    h.variables = vars.size();
+    h.functions = order.size();
+    vector<uint32_t> starts( 1, 0 );
+    for (const string &n : w.names)
+	starts.push_back( starts.back() + n.size() );
+    h.nameStarts = sizeof h;
+    h.nameText = h.nameStarts + starts.size() * sizeof starts[0];
+    h.variableData = h.nameText + starts.back();
+    h.functionData = h.variableData + variables.size();
+    h.bodies = h.functionData + functions.size();
+    h.size = h.bodies + bodies.size();
+
+    ofstream out( path, ios::binary | ios::trunc );
+    out.write( (const char *) &h, sizeof h );
+    out.write( (const char *) starts.data(), starts.size() * sizeof starts[0] );
+    for (const string &n : w.names)
+	out.write( n.data(), n.size() );
+    out.write( (const char *) variables.data(), variables.size() );
+    out.write( (const char *) functions.data(), functions.size() );
+    out.write( (const char *) bodies.data(), bodies.size() );
+    out.close();
+    return !out.fail();
+}
+
+//  mapFile
+//  Map a snapshot file into memory, and check that its sections
+//  lie within it
+//  Returns:	the snapshot, or NULL if it is not one
+static Snapshot *mapFile( const char path[] )
+{
+    int fd = open( path, O_RDONLY | O_CLOEXEC );
+    struct stat info;
+    if (fd < 0 || fstat( fd, &info ) < 0)
+    {
+	cerr << "cannot read " << path << endl;
+	if (fd >= 0)
+	    close( fd );
+	return NULL;
+    }
+    size_t size = info.st_size;
+    void *base = size < sizeof(Header) ? MAP_FAILED
+		 : mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+    close( fd );			// (the mapping remains)
+    const Header *h = (const Header *) base;
+    if (base == MAP_FAILED || memcmp( h->magic, Magic, sizeof Magic ) != 0
+	|| h->version != Version || h->size != size
+	|| h->nameStarts != sizeof(Header)
+	|| h->nameText != h->nameStarts + ((uint64_t) h->names + 1) * 4
+	|| h->nameText > h->variableData || h->variableData > h->functionData
+	|| h->functionData > h->bodies || h->bodies > size)
+    {
+	cerr << path << " is not a snapshot" << endl;
+	if (base != MAP_FAILED)
+	    munmap( base, size );
+	return NULL;
+    }
+    Snapshot *s = new Snapshot();
+    s->base = (const char *) base;
+    s->size = size;
+    s->header = h;
+    s->nameStarts = (const uint32_t *) (s->base + h->nameStarts);
+    for (uint32_t i = 0; i < h->names; i++)
+	if (s->nameStarts[i] > s->nameStarts[i + 1]
+	    || h->nameText + s->nameStarts[i + 1] > h->variableData)
+	{
+	    cerr << path << " is damaged" << endl;
+	    munmap( base, size );
+	    delete s;
+	    return NULL;
+	}
+    return s;
+}
+
+bool loadSnapshot( const char path[], VarTree &vars, FunctionDef &funs,
+		   Workspace &space )
+{
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+	if (f->second.builtin == NULL)
+	{
+	    cerr << "a snapshot may only be loaded before defining functions" << endl;
+	    return false;
+	}
+    Snapshot *s = mapFile( path );
+    if (s == NULL)
+	return false;
+    const Header &h = *s->header;
+
+    Reader values( *s, h.variableData, h.functionData );
+    space.remember( values.integer() );
+    for (uint32_t i = 0; i < h.variables && !values.bad; i++)
+    {
+	int id = vars.intern( s->name( values.number() ) );
+	vars.value( id ) = values.integer();
+    }
+    vars.settle();			// (keeping copies of any large ones)
+    Integer::releaseTemporaries();
+
+    // Every function is known at once, but not yet decoded
+    // (each takes several bytes, so no more are made than could be)
+    if (values.bad || h.functions > h.bodies - h.functionData)
+    {
+	cerr << path << " is damaged" << endl;
+	return false;
+    }
+    s->bodies = new StoredBody[h.functions];
+    Reader r( *s, h.functionData, h.bodies );
+    for (uint32_t i = 0; i < h.functions && !r.bad; i++)
+    {
+	string name = s->name( r.number() );
+	FunctionDef::iterator builtin = funs.find( name );
+	int number = builtin != funs.end() ? builtin->second.number	// (shadowed)
+					   : funs.size();
+	FunDef &f = funs[name];
+	f = FunDef();
+	f.name = name;
+	f.number = number;
+	r.number();			// (numbered as defined here instead)
+	f.pure = r.byte() != 0;
+	unsigned long count = r.number();
+	for (unsigned long p = 0; p < count && p < 10; p++)
+	    f.parameter[p] = s->name( r.number() );
+	for (unsigned long c = r.number(); c > 0 && !r.bad; c--)
+	    f.callees.insert( s->name( r.number() ) );
+	f.locals = NULL;		// (all made when decoded)
+	f.functionBody = f.parsedBody = NULL;
+	f.arena = NULL;
+	f.code = NULL;
+	f.memo = NULL;			// (made when first called)
+	f.native = NULL;
+	f.calls = 0;
+	StoredBody &b = s->bodies[i];
+	b.snapshot = s;
+	b.funs = &funs;
+	b.offset = r.number();
+	b.decoded = false;
+	f.stored = &b;
+	f.builtin = NULL;
+    }
+    if (r.bad)
+    {
+	cerr << path << " is damaged" << endl;
+	return false;
+    }
+
+    // Every body is checked now, which only reads it, so that one that
+    // is damaged fails the load rather than the call that decodes it
+    for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+	if (f->second.stored != NULL && f->second.stored->snapshot == s
+	    && !checkBody( f->second, *s, funs ))
+	{
+	    cerr << path << " is damaged: the body of " << f->first << endl;
+	    return false;
+	}
+    return true;
+}
@@ -0,0 +1,117 @@
+// Session Snapshot Header File
+// The variables and functions of a session may be saved to a file,
+// and loaded again when a later session starts, far faster than by
+// defining the functions anew from their source text:  nothing is
+// tokenized, parsed or simplified again, and no function is analyzed
+// again to tell whether it is pure (see memo.h), which is what takes
+// longest once there are thousands of them.
+//
+// A snapshot holds a table of every name used anywhere within it,
+// each stored once and referred to by number; the value of every
+// variable; and for every function, its parameters, the functions
+// it calls, whether it is pure, its local variables, and its body
+// exactly as it was evaluated (simplified, with subexpressions
+// shared), encoded node by node.
+//
+// Loading maps the file into memory and makes only the entries for
+// the functions.  A function's body is decoded when the function is
+// first called, so a session pays only for the functions it uses;
+// the file therefore stays mapped for as long as the program runs.
+// Every body is read through once as the file is loaded, though, to
+// check that it is whole:  a damaged file fails to load, rather than
+// leaving a function that cannot be evaluated.
+#ifndef SNAPSHOT
+#define SNAPSHOT
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include "evaluate.h"
+using namespace std;
+
+class Snapshot;				// a loaded file (see snapshot.cpp)
+
+// StoredBody
+// Where a function's body is to be decoded from, until it is
+struct StoredBody
+{
+    Snapshot	*snapshot;
+    FunctionDef *funs;			// what its calls refer to
+    size_t	 offset;		// of its local variables and body
+    atomic<bool> decoded;
+};
+
+// decodeStored
+// Decode a function's body from where it was loaded, if no other
+// thread has yet (a function is decoded only once)
+void decodeStored( FunDef &f );
+
+// decoded
+// Make sure a function's body is ready to evaluate
+inline void decoded( FunDef &f )
+{
+    if (f.stored != NULL && !f.stored->decoded.load( memory_order_acquire ))
+	decodeStored( f );
+}
+
+// SnapshotWriter
+// Collects the encoded form of a snapshot.  Each node of a tree
+// encodes itself (see ExprNode::save), in these terms.
+class SnapshotWriter
+{
+    private:
+	vector<unsigned char> *out;	// the section being written
+	unordered_map<string, unsigned> ids;	// of the names, by name
+    public:
+	vector<string> names;		// every name, by number
+
+	SnapshotWriter( vector<unsigned char> &section )
+	{
+	    out = &section;
+	}
+	void into( vector<unsigned char> &section )	// write elsewhere now
+	{
+	    out = &section;
+	}
+	size_t size() const
+	{
+	    return out->size();
+	}
+	void byte( int b )
+	{
+	    out->push_back( (unsigned char) b );
+	}
+	void number( unsigned long n );	// (seven bits to a byte)
+	void integer( Integer i );
+	void name( const string &s );	// (by number)
+};
+
+// saveSnapshot
+// Write the variables and functions of a session to a file
+// Parameters:
+//	path	(input string)		file to write
+//	vars	(input VarTree)		variables to save
+//	funs	(modified FunctionDef)	functions to save (any still
+//					undecoded are decoded first)
+//	space	(input Workspace)	holding the previous value
+// Returns:				whether the file was written
+bool saveSnapshot( const char path[], VarTree &vars, FunctionDef &funs,
+		   Workspace &space );
+
+// loadSnapshot
+// Restore the variables and functions saved in a file, as a session
+// starts (that is, while there are none yet but those built in)
+// Parameters:
+//	path	(input string)		file to read
+//	vars	(modified VarTree)	variables to restore
+//	funs	(modified FunctionDef)	functions to restore
+//	space	(modified Workspace)	to hold the previous value
+// Returns:				whether they were (if not, why
+//					is written to the standard error,
+//					and what was restored is not to
+//					be used)
+bool loadSnapshot( const char path[], VarTree &vars, FunctionDef &funs,
+		   Workspace &space );
+
+#endif
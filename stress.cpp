@@ -0,0 +1,172 @@
+// Stress Program
+// Runs many interpreters (see interpreter.h) at once, one per thread,
+// to show that they are independent of one another.  Every context
+// evaluates the same script, but beginning from a variable k of its
+// own, so that no two compute the same values:  its own definitions,
+// formulas, assignments, deep and pure recursion, large integers, and
+// expressions using the previous value.  Half of the contexts define
+// their own functions; the other half share a library of them.
+//
+// What each context displays is first computed by evaluating its
+// script alone, one context after another, and then compared with
+// what it displays while all of them run together.  Any difference is
+// written to the standard error; a summary is written to the standard
+// output as JSON, as the benchmark program does.  The program fails
+// if any context differed.
+//
+// This is a program of its own, built from every file but driver.cpp,
+// benchmark.cpp, loadgen.cpp and tests.cpp:
+//	g++ -std=c++17 -O2 -o stress stress.cpp <the rest> -pthread
+// (and it is most telling built with -fsanitize=thread as well)
+// Options:
+//	-contexts n	interpreters running at once (default 64)
+//	-rounds r	times each repeats its script (default 200)
+//	-vm		evaluate with the bytecode machine
+//	-jit n		as for the interpreter (see jit.h)
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdlib.h>
+#include "interpreter.h"
+#include "builtins.h"
+#include "jit.h"
+using namespace std;
+
+// The functions every context calls, whether its own or the library's
+static const char *definitions[] =
+{
+    "deffn tri(n) = n <= 0 ? 0 : n + tri(n - 1)",
+    "deffn steps(n, s) = n == 1 ? s : steps(n % 2 ? 3 * n + 1 : n / 2, s + 1)",
+    "deffn cube(x) = x * x * x"
+};
+
+// What each context evaluates once it has its functions
+static const char *setup[] =
+{
+    "r = 0",
+    "x := k * r + tri(r % 50)",
+    "y := x * x - cube(k)"
+};
+
+// What it then evaluates every round
+static const char *repeated[] =
+{
+    "r = r + 1",
+    "y",
+    "fib(k % 20 + r % 30)",
+    "pow(k + 2, 40 + r % 20)",
+    "steps(k + r, 0)",
+    "+ 1",
+    "tri(200 + k)",
+    "gcf(x, y + 7)"
+};
+
+//  runScript
+//  Evaluate a context's whole script, returning what it displays
+static string runScript( Interpreter &interp, int k, int rounds )
+{
+    ostringstream out;
+    interp.evaluate( ("k = " + to_string( k )).c_str(), out );
+    out << '\n';
+    for (const char *s : setup)
+    {
+	interp.evaluate( s, out );
+	out << '\n';
+    }
+    for (int i = 0; i < rounds; i++)
+	for (const char *s : repeated)
+	{
+	    interp.evaluate( s, out );
+	    out << '\n';
+	}
+    return out.str();
+}
+
+//  runContext
+//  Make one context, with its own functions or the library's,
+//  and evaluate its script
+static string runContext( int k, int rounds, EvalMode mode, FunctionDef &library )
+{
+    Interpreter interp( mode );
+    if (k % 2 == 0)
+    {
+	ostream quiet( NULL );
+	defineBuiltins( interp.functions() );
+	for (const char *d : definitions)
+	    interp.evaluate( d, quiet );
+    }
+    else
+	interp.share( library );
+    return runScript( interp, k, rounds );
+}
+
+int main( int argc, char *argv[] )
+{
+    int contexts = 64, rounds = 200;
+    EvalMode mode = TREE;
+    for (int i = 1; i < argc; i++)
+    {
+	string arg = argv[i];
+	if (arg == "-vm")
+	    mode = MACHINE;
+	else if (i + 1 < argc && arg == "-contexts")
+	    contexts = atoi( argv[++i] );
+	else if (i + 1 < argc && arg == "-rounds")
+	    rounds = atoi( argv[++i] );
+	else if (i + 1 < argc && arg == "-jit")
+	    nativeThreshold = atol( argv[++i] );
+	else
+	{
+	    cerr << "usage: " << argv[0] << " [-contexts n] [-rounds r]"
+		 << " [-vm] [-jit n]" << endl;
+	    return 1;
+	}
+    }
+    if (contexts < 1)
+	contexts = 1;
+    if (rounds < 1)
+	rounds = 1;
+
+    // The library is complete before any context shares it
+    Interpreter library( mode );
+    ostream quiet( NULL );
+    defineBuiltins( library.functions() );
+    for (const char *d : definitions)
+	library.evaluate( d, quiet );
+
+    vector<string> expected( contexts ), actual( contexts );
+    for (int k = 0; k < contexts; k++)
+	expected[k] = runContext( k, rounds, mode, library.functions() );
+
+    vector<thread> threads;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int k = 0; k < contexts; k++)
+	threads.push_back( thread( [&, k] {
+	    actual[k] = runContext( k, rounds, mode, library.functions() );
+	} ) );
+    for (thread &t : threads)
+	t.join();
+    double seconds = chrono::duration<double>( chrono::steady_clock::now()
+					       - start ).count();
+
+    int differed = 0;
+    for (int k = 0; k < contexts; k++)
+	if (actual[k] != expected[k])
+	{
+	    cerr << "context " << k << " ("
+		 << (k % 2 == 0 ? "own functions" : "shared library")
+		 << ") differed when run alongside the others" << endl;
+	    differed++;
+	}
+    long expressions = (long) contexts * (1 + sizeof setup / sizeof setup[0]
+		       + rounds * (sizeof repeated / sizeof repeated[0]));
+    cout << "{ \"engine\": \"" << (mode == MACHINE ? "machine" : "tree")
+	 << "\", \"contexts\": " << contexts << ", \"rounds\": " << rounds
+	 << ", \"expressions\": " << expressions << ", \"seconds\": " << seconds
+	 << ", \"expressions_per_sec\": " << (long) (expressions / seconds)
+	 << ", \"differed\": " << differed << " }" << endl;
+    return differed == 0 ? 0 : 1;
+}
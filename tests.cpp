@@ -0,0 +1,771 @@
+// Test Program
+// Checks the interpreter against what it must do, and its engines
+// against one another.  Each test writes "ok" or "FAILED" and its
+// name, with why it failed; the program fails if any test did.
+//
+// This is a program of its own, built from every file but driver.cpp,
+// benchmark.cpp, loadgen.cpp and stress.cpp:
+//	g++ -std=c++17 -O2 -DCOUNT_ALLOCATIONS -o tests tests.cpp <the rest> -pthread
+// (without COUNT_ALLOCATIONS, the test of allocations fails)
+// Its arguments, if any, are the names of the tests to run.
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "interpreter.h"
+#include "builtins.h"
+#include "jit.h"
+#include "heapcount.h"
+#include "columns.h"
+#include "batch.h"
+#include "snapshot.h"
+#include "simplify.h"
+using namespace std;
+
+// Every engine, as the tests compare them
+struct Engine
+{
+    const char *name;
+    EvalMode	mode;
+    long	threshold;		// for nativeThreshold (see jit.h)
+};
+static const Engine engines[] =
+{
+    { "tree", TREE, 0 },
+    { "machine", MACHINE, 0 },
+    { "native", TREE, 1 }		// (translated once called)
+};
+
+// Run
+// What one interpreter displayed for each line it was given
+struct Run
+{
+    vector<string> answers;
+    vector<string> translated;	// functions it ran as machine code
+};
+
+//  runLines
+//  Evaluate some lines in a new interpreter with the functions built in
+static Run runLines( const Engine &e, const vector<string> &lines )
+{
+    long threshold = nativeThreshold;
+    nativeThreshold = e.threshold;
+    Run run;
+    {
+	Interpreter interp( e.mode );
+	defineBuiltins( interp.functions() );
+	for (const string &line : lines)
+	{
+	    ostringstream out;
+	    interp.evaluate( line.c_str(), out );
+	    run.answers.push_back( out.str() );
+	}
+	FunctionDef &funs = interp.functions();
+	for (FunctionDef::iterator f = funs.begin(); f != funs.end(); f++)
+	    if (f->second.native != NULL)
+		run.translated.push_back( f->first );
+    }
+    nativeThreshold = threshold;
+    return run;
+}
+
+//  shown
+//  A line as a failure shows it (the start of it, if long)
+static string shown( const string &line )
+{
+    return line.size() <= 60 ? line : line.substr( 0, 60 ) + "...";
+}
+
+//  sameAnswers
+//  Whether every engine displays the same for the same lines
+static bool sameAnswers( const vector<string> &lines, ostream &why,
+			 Run *native = NULL )
+{
+    Run first = runLines( engines[0], lines );
+    for (const Engine &e : engines)
+    {
+	Run run = runLines( e, lines );
+	for (size_t i = 0; i < lines.size(); i++)
+	    if (run.answers[i] != first.answers[i])
+	    {
+		why << shown( lines[i] ) << " gave " << shown( run.answers[i] ) << " by "
+		    << e.name << ", but " << shown( first.answers[i] ) << " by "
+		    << engines[0].name;
+		return false;
+	    }
+	if (native != NULL && e.threshold != 0)
+	    *native = run;
+    }
+    return true;
+}
+
+//  expectAnswers
+//  Whether every engine displays what is expected for each line
+//  (given as pairs of a line and its answer)
+static bool expectAnswers( const vector<pair<string, string>> &expected,
+			   ostream &why )
+{
+    vector<string> lines;
+    for (const pair<string, string> &e : expected)
+	lines.push_back( e.first );
+    for (const Engine &e : engines)
+    {
+	Run run = runLines( e, lines );
+	for (size_t i = 0; i < lines.size(); i++)
+	    if (run.answers[i] != expected[i].second)
+	    {
+		why << shown( lines[i] ) << " gave " << shown( run.answers[i] ) << " by "
+		    << e.name << ", not " << shown( expected[i].second );
+		return false;
+	    }
+    }
+    return true;
+}
+
+//  Functions of every kind the machine code treats differently
+static const char *definitions[] =
+{
+    "deffn sq(x) = x * x",
+    "deffn tri(n) = n <= 0 ? 0 : n + tri(n - 1)",
+    "deffn euclid(a, b) = b == 0 ? a : euclid(b, a % b)",
+    "deffn sum(n, s) = n == 0 ? s : sum(n - 1, s + n)",
+    "deffn grow(n) = n * 1000000 * 1000000",
+    "deffn quot(a, b) = a / b + a % b",
+    "deffn twice(x) = (y = x * 2) + y",
+    "deffn pick(x) = x > 5 ? x % 3 : -x",
+    "deffn ev(n) = n == 0 ? 1 : od(n - 1)",
+    "deffn od(n) = n == 0 ? 0 : ev(n - 1)",
+    "deffn viagcf(a) = gcf(a, 360)",
+    "deffn outer(n) = sq(n) + tri(n % 20)"
+};
+
+//  engines
+//  The tree walker, the bytecode machine and the machine code give
+//  the same answers for the same calls
+static bool testEngines( ostream &why )
+{
+    vector<string> lines( definitions, definitions + sizeof definitions
+						   / sizeof definitions[0] );
+    for (int i = -40; i <= 60; i++)
+    {
+	string n = to_string( i );
+	string m = to_string( i < 0 ? -i : i );
+	for (const char *call : { "sq(", "tri(", "grow(", "twice(", "pick(",
+				  "viagcf(", "outer(" })
+	    lines.push_back( call + n + ")" );
+	lines.push_back( "ev(" + m + ")" );
+	lines.push_back( "od(" + m + " * 100)" );
+	lines.push_back( "euclid(" + n + " * 7, 91)" );
+	lines.push_back( "sum(" + m + ", 0)" );
+	lines.push_back( "quot(" + n + ", " + to_string( i % 4 ) + ")" );
+    }
+    lines.push_back( "quot(-2147483648, -1)" );
+    lines.push_back( "sq(65536)" );
+    lines.push_back( "sum(100000, 0)" );
+
+    Run native;
+    if (!sameAnswers( lines, why, &native ))
+	return false;
+    for (const char *name : { "sq", "tri", "euclid", "sum", "pick" })
+	if (find( native.translated.begin(), native.translated.end(), name )
+	    == native.translated.end())
+	{
+	    why << name << " was never run as machine code";
+	    return false;
+	}
+    return true;
+}
+
+//  mutual
+//  Recursion through two functions in tail position runs in
+//  constant space, whichever engine runs it
+static bool testMutual( ostream &why )
+{
+    return expectAnswers( {
+	{ definitions[8], "Define ev(n)" },
+	{ definitions[9], "Define od(n)" },
+	{ "ev(10)", "1" },
+	{ "ev(50000)", "1" },
+	{ "od(1000001)", "1" },
+	{ "ev(1000001)", "0" } }, why );
+}
+
+//  deep
+//  Functions that carry their result along in an accumulator, as
+//  gcf and pow may be written, recur ten million deep in constant
+//  space, whichever engine runs them (and so do two functions
+//  recurring through each other)
+static bool testDeep( ostream &why )
+{
+    return expectAnswers( {
+	{ "deffn count(n, acc) = n == 0 ? acc : count(n - 1, acc + 1)",
+	  "Define count(n,acc)" },
+	{ "deffn subgcf(a, b) = a == b ? a : a > b ? subgcf(a - b, b) : subgcf(a, b - a)",
+	  "Define subgcf(a,b)" },
+	{ "deffn powmod(b, e, acc) = e == 0 ? acc : powmod(b, e - 1, acc * b % 1000003)",
+	  "Define powmod(b,e,acc)" },
+	{ definitions[8], "Define ev(n)" },
+	{ definitions[9], "Define od(n)" },
+	{ "count(10000000, 0)", "10000000" },
+	{ "subgcf(10000000, 1)", "1" },
+	{ "subgcf(1, 10000000)", "1" },
+	{ "powmod(3, 10000000, 1)", "4720" },
+	{ "ev(10000000)", "1" } }, why );
+}
+
+//  redefinition
+//  Redefining a function changes what every function calling it
+//  answers, however it was run or remembered before
+static bool testRedefinition( ostream &why )
+{
+    return expectAnswers( {
+	{ "deffn f(x) = x + 1", "Define f(x)" },
+	{ "deffn g(x) = f(x) * 2", "Define g(x)" },
+	{ "deffn h(n) = n <= 0 ? 0 : g(n) + h(n - 1)", "Define h(n)" },
+	{ "g(3)", "8" },
+	{ "g(3)", "8" },			// (remembered)
+	{ "h(4)", "28" },
+	{ "deffn f(x) = x + 10", "Define f(x)" },
+	{ "g(3)", "26" },
+	{ "g(3)", "26" },
+	{ "h(4)", "100" },
+	{ "deffn f(x) = x * x", "Define f(x)" },
+	{ "g(3)", "18" },
+	{ "h(4)", "60" } }, why );
+}
+
+//  cache
+//  An expression kept parsed is discarded when a function it calls is
+//  redefined, so that it answers by the new definition; and however
+//  many expressions push one another out of the cache, each answers
+//  as it would have had none been kept
+static bool testCache( ostream &why )
+{
+    long threshold = nativeThreshold;
+    bool fine = true;
+    for (const Engine &e : engines)
+    {
+	nativeThreshold = e.threshold;
+	Interpreter interp( e.mode );
+	ExprCache &cache = interp.workspace().cache;
+	ostream quiet( NULL );
+	interp.evaluate( "deffn f(x) = x + 1", quiet );
+	interp.evaluate( "x = 7", quiet );
+	vector<pair<string, string>> answers;
+	for (int i = 0; i < 3; i++)		// (kept the second time)
+	    answers.push_back( { "f(2) * 3 + x", "16" } );
+	answers.push_back( { "deffn f(x) = x * 10", "Define f(x)" } );
+	answers.push_back( { "f(2) * 3 + x", "67" } );
+
+	// Three times as many as the cache holds (1024), each seen twice
+	// to be kept, then once more
+	size_t many = 3 * 1024;
+	for (int pass = 0; pass < 3; pass++)
+	    for (size_t k = 0; k < many; k++)
+		answers.push_back( { "x * " + to_string( k ) + " + f(" + to_string( k % 5 )
+				     + ")", to_string( 7 * k + (k % 5) * 10 ) } );
+
+	long hits = cache.hits;
+	size_t kept = 0;
+	for (size_t i = 0; fine && i < answers.size(); i++)
+	{
+	    ostringstream out;
+	    interp.evaluate( answers[i].first.c_str(), out );
+	    if (out.str() != answers[i].second)
+	    {
+		why << shown( answers[i].first ) << " gave " << shown( out.str() ) << " by "
+		    << e.name << ", not " << answers[i].second;
+		fine = false;
+	    }
+	    if (i == 2)
+		kept = cache.size();
+	    if (i == 3 && cache.size() >= kept)
+	    {
+		why << "redefining f discarded nothing by " << e.name;
+		fine = false;
+	    }
+	}
+	if (fine && (kept == 0 || cache.hits == hits || cache.size() != 1024))
+	{
+	    why << "nothing was kept by " << e.name;
+	    fine = false;
+	}
+    }
+    nativeThreshold = threshold;
+    return fine;
+}
+
+//  subexpressions
+//  A repeated subexpression is shared (through a temporary #0, ...)
+//  only where it must have the same value:  not if it assigns, or a
+//  variable it uses is assigned between, or it calls an impure
+//  function (here, one calling a function not yet defined)
+static bool testSubexpressions( ostream &why )
+{
+    const string reset = "(a = 7) * 0 + (a * a + 1) * ((a = 2) + (a * a + 1))";
+    const string bump = "(a = a + 1) * 2 + (a = a + 1) * 2";
+    if (!expectAnswers( {
+	{ "a = 1", "1" },
+	{ bump, "10" },
+	{ bump, "18" },
+	{ bump, "26" },				// (kept parsed, as shared)
+	{ reset, "350" },
+	{ reset, "350" },
+	{ reset, "350" },
+	{ "deffn u(x) = (y = x + 1) * (x * 3 + y) + (y = x * 2) * (x * 3 + y)",
+	  "Define u(x)" },
+	{ "u(5)", "376" },
+	{ "deffn v(x) = (x > 2 ? (y = x * x + 1) : 0) + (x * x + 1) * (x * x + 1)",
+	  "Define v(x)" },
+	{ "v(3)", "110" },
+	{ "v(1)", "4" },
+	{ "deffn step(x) = (x = x + 1) * (x = x + 1)", "Define step(x)" },
+	{ "step(3)", "20" },
+	{ "deffn p(x) = q(x) + 1", "Define p(x)" },
+	{ "deffn r(x) = (p(x) * 2) * (p(x) * 2)", "Define r(x)" },
+	{ "deffn q(x) = x * x", "Define q(x)" },
+	{ "r(3)", "400" },
+	{ "deffn q(x) = x + 1", "Define q(x)" },
+	{ "r(3)", "100" } }, why ))
+	return false;
+
+    // Which bodies were shared
+    Interpreter interp( TREE );
+    ostream quiet( NULL );
+    for (const char *line : { "deffn p(x) = q(x) + 1",
+			      "deffn r(x) = (p(x) * 2) * (p(x) * 2)",
+			      "deffn w(x) = (x * x + 1) * (x * x + 1)",
+			      "deffn step(x) = (x = x + 1) * (x = x + 1)",
+			      "deffn q(x) = x * x" })
+	interp.evaluate( line, quiet );
+    ostringstream report;
+    simplifyReport( report, interp.functions() );
+    string text = "\n" + report.str();
+    for (const char *name : { "r", "w", "step" })
+    {
+	size_t at = text.find( string( "\n" ) + name + ": " ), end = at + 1;
+	if (at == string::npos)
+	{
+	    why << name << " is not reported";
+	    return false;
+	}
+	while (end < text.size() && (text[end] != '\n' || text[end + 1] == ' '))
+	    end++;
+	bool shared = text.find( "#0", at ) < end;
+	if (shared != (strcmp( name, "w" ) == 0))
+	{
+	    why << name << (shared ? " was" : " was not") << " shared:"
+		<< text.substr( at, end - at );
+	    return false;
+	}
+    }
+    return true;
+}
+
+//  literals
+//  A variable assigned a large literal keeps its value once the
+//  expression that assigned it is gone (or kept for reuse)
+static bool testLiterals( ostream &why )
+{
+    const char *large = "506252810597512174910550600934";
+    string assign = string( "a = " ) + large;
+    return expectAnswers( {
+	{ assign, large },
+	{ "a", large },
+	{ "a + 1", "506252810597512174910550600935" },
+	{ assign, large },
+	{ assign, large },		// (parsed once more, then reused)
+	{ "b = (c = -" + string( large ) + ") + 1", "-506252810597512174910550600933" },
+	{ "c", string( "-" ) + large },
+	{ "a + b", "1" } }, why );
+}
+
+//  batchFile
+//  Write lines to a new temporary file, returning its name
+static string batchFile( const vector<string> &lines )
+{
+    char path[] = "/tmp/testsXXXXXX";
+    int fd = mkstemp( path );
+    if (fd < 0)
+	return "";
+    close( fd );
+    ofstream file( path );
+    for (const string &line : lines)
+	file << line << '\n';
+    return path;
+}
+
+//  runFile
+//  What a batch run of a file writes, with some number of threads
+static string runFile( const string &path, EvalMode mode, int threads )
+{
+    Interpreter interp( mode );
+    ostream quiet( NULL );
+    defineBuiltins( interp.functions() );
+    for (const char *d : definitions)
+	interp.evaluate( d, quiet );
+    ostringstream out;
+    BatchStats stats;
+    runBatch( path.c_str(), interp.variables(), interp.functions(), mode,
+	      out, stats, interp.workspace(), threads );
+    return out.str();
+}
+
+//  batch
+//  A batch writes the same with several threads as with one, lines
+//  answered with a message (which leave the previous value as it was)
+//  among them
+static bool testBatch( ostream &why )
+{
+    vector<string> lines = { "x = 5", "y = 0" };
+    for (int run = 0; run < 3; run++)
+    {
+	for (int i = 0; i < 599; i++)		// (the last dividing by zero)
+	    if (i % 7 == 3)
+		lines.push_back( to_string( i ) + " / y" );
+	    else if (i % 5 == 0)
+		lines.push_back( "grow(x + " + to_string( i ) + ")" );
+	    else
+		lines.push_back( "x * " + to_string( i ) + " % (y + " + to_string( i % 4 ) + ")" );
+	lines.push_back( "+ 1" );		// (the value of the last one with one)
+	lines.push_back( "x = x + 1" );
+    }
+    string path = batchFile( lines );
+    if (path.empty())
+    {
+	why << "cannot write a temporary file";
+	return false;
+    }
+    bool same = true;
+    for (EvalMode mode : { TREE, MACHINE })
+    {
+	string single = runFile( path, mode, 1 );
+	for (int threads : { 2, 4 })
+	{
+	    string shared = runFile( path, mode, threads );
+	    if (same && shared != single)
+	    {
+		size_t at = 0, line = 1;
+		while (at < shared.size() && at < single.size() && shared[at] == single[at])
+		    line += shared[at++] == '\n';
+		why << "line " << line << " differed with " << threads << " threads";
+		same = false;
+	    }
+	}
+	if (same && single.find( "division by zero" ) == string::npos)
+	{
+	    why << "no line divided by zero";
+	    same = false;
+	}
+    }
+    unlink( path.c_str() );
+    return same;
+}
+
+//  snapshots
+//  A snapshot loads as it was saved; a copy of it cut short, or with
+//  any one byte changed, either fails to load or loads functions whose
+//  bodies may all be decoded and compiled (by saving them again).  The
+//  functions call nothing but built-ins, and none is evaluated once
+//  damaged, as a changed call could recur without end.
+static bool testSnapshots( ostream &why )
+{
+    string path = batchFile( {} ), copy = batchFile( {} );
+    if (path.empty() || copy.empty())
+    {
+	why << "cannot write a temporary file";
+	return false;
+    }
+    {
+	Interpreter interp( TREE );
+	ostream quiet( NULL );
+	defineBuiltins( interp.functions() );
+	for (const char *line : { "deffn sq(x) = x * x",
+				  "deffn both(x, y) = x * x + (y > 3 ? gcf(x, y) : x % (y + 9))",
+				  "deffn big(x) = x * 100000000000000000000 - 7",
+				  "deffn twice(x) = (y = x * 2) + y",
+				  "k = 12345678901234567890123" })
+	    interp.evaluate( line, quiet );
+	saveSnapshot( path.c_str(), interp.variables(), interp.functions(),
+		      interp.workspace() );
+    }
+    ifstream in( path, ios::binary );
+    string saved( (istreambuf_iterator<char>( in )), istreambuf_iterator<char>() );
+    const vector<pair<string, string>> expected = {
+	{ "sq(3)", "9" }, { "both(4, 6)", "18" }, { "both(4, 2)", "20" },
+	{ "big(2)", "199999999999999999993" }, { "twice(5)", "20" },
+	{ "k", "12345678901234567890123" } };
+
+    streambuf *errors = cerr.rdbuf( NULL );	// (damage is reported there)
+    bool fine = true;
+    int refused = 0;
+    for (size_t at = 0; fine && at <= 2 * saved.size(); at++)
+    {
+	string damaged = saved;
+	if (at < saved.size())
+	    damaged.resize( at );			// cut short
+	else if (at > saved.size())
+	    damaged[at - saved.size() - 1] ^= 0x5a;	// one byte changed
+	unlink( path.c_str() );			// (a new file, as the old
+	ofstream( path, ios::binary ) << damaged;	// one may yet be mapped)
+
+	Interpreter interp( TREE );
+	defineBuiltins( interp.functions() );
+	if (!loadSnapshot( path.c_str(), interp.variables(), interp.functions(),
+			   interp.workspace() ))
+	{
+	    refused++;
+	    if (at == saved.size())
+	    {
+		why << "the snapshot as saved did not load";
+		fine = false;
+	    }
+	    continue;
+	}
+	if (at < saved.size())
+	{
+	    why << "the snapshot cut to " << at << " bytes loaded";
+	    fine = false;
+	}
+	else if (at == saved.size())
+	    for (const pair<string, string> &e : expected)
+	    {
+		ostringstream out;
+		interp.evaluate( e.first.c_str(), out );
+		if (out.str() != e.second)
+		{
+		    why << e.first << " gave " << out.str() << " once loaded, not "
+			<< e.second;
+		    fine = false;
+		}
+	    }
+	else
+	    saveSnapshot( copy.c_str(), interp.variables(), interp.functions(),
+			  interp.workspace() );
+    }
+    cerr.rdbuf( errors );
+    if (fine && refused <= (int) saved.size())
+    {
+	why << "no changed byte was found to be damage";
+	fine = false;
+    }
+    unlink( path.c_str() );
+    unlink( copy.c_str() );
+    return fine;
+}
+
+//  formulas
+//  A formula is evaluated again whenever something it uses changes,
+//  after every formula it uses; binding it again replaces it, and
+//  assigning its variable a value unbinds it
+static bool testFormulas( ostream &why )
+{
+    return expectAnswers( {
+	{ "a = 2", "2" },
+	{ "d := c * c", "0" },			// (c is as yet a variable)
+	{ "b := a * 3", "6" },
+	{ "c := b + a", "8" },
+	{ "d", "64" },
+	{ "a = 5", "5" },
+	{ "d", "400" },				// (b, then c, then d)
+	{ "b := a - 1", "4" },			// bound again
+	{ "c", "9" },
+	{ "d", "81" },
+	{ "a = 1", "1" },
+	{ "d", "1" },
+	{ "b = 100", "100" },			// unbound
+	{ "c", "101" },
+	{ "a = 7", "7" },
+	{ "b", "100" },
+	{ "c", "107" },
+	{ "d", "11449" },
+	{ "a := c + 1", "a formula may not depend on its own variable" },
+	{ "b := b + 1", "a formula may not depend on its own variable" },
+	{ "x := (y = 3) + 1", "a formula may not assign variables" },
+	{ "a = a + 1", "8" },			// (still bound:  c and d follow)
+	{ "d", "11664" } }, why );
+}
+
+//  nesting
+//  However long a sum or product is, it is evaluated (in order, as
+//  written); anything else nested more deeply than MaxDepth is
+//  refused with a message
+static bool testNesting( ostream &why )
+{
+    string refused = "expression nested too deeply (more than "
+		     + to_string( MaxDepth ) + " levels)";
+    string wide = "1", mixed = "1", product = "1", parens = "x", calls = "x";
+    for (int i = 0; i < 200000; i++)
+	wide += " + x";
+    long long value = 1, y = 0;	// of mixed, as evaluated in order
+    for (int i = 0; i < 30000; i++)
+	switch (i % 4)
+	{
+	case 0:	mixed += " - x * " + to_string( i );	value -= 3LL * i;	break;
+	case 1:	mixed += " + " + to_string( i );	value += i;		break;
+	case 2:	mixed += " - (y = y * 2 % 1000 + 1)";	y = y * 2 % 1000 + 1;
+		value -= y;						break;
+	default: mixed += " + y % 7 * 2 * x";		value += y % 7 * 6;	break;
+	}
+    for (int i = 0; i < 20001; i++)
+	product += i % 2 ? " * (x - 2)" : " * (0 - 1)";
+    for (int i = 0; i < MaxDepth; i++)
+    {
+	parens = "(x + " + parens + ")";
+	calls = "abs(" + calls + ")";
+    }
+    return expectAnswers( {
+	{ "x = 3", "3" },
+	{ "y = 0", "0" },
+	{ wide, "600001" },
+	{ wide, "600001" },		// (parsed once more, then reused)
+	{ mixed, to_string( value ) },
+	{ "y", to_string( y ) },
+	{ product, "-1" },
+	{ parens, refused },
+	{ calls, refused },
+	{ "deffn long(x) = " + wide, "Define long(x)" },
+	{ "long(2)", "400001" },
+	{ "w := " + wide, "600001" },
+	{ "x = 1", "1" },
+	{ "w", "200001" } }, why );
+}
+
+//  allocations
+//  A call to a function is evaluated without allocating anything:
+//  its frame is carved from the call stack (once the cache of its
+//  results has been made, by a first call)
+static bool testAllocations( ostream &why )
+{
+    if (!countingAllocations())
+    {
+	why << "allocations are not counted (build with -DCOUNT_ALLOCATIONS)";
+	return false;
+    }
+    long threshold = nativeThreshold;
+    nativeThreshold = 0;		// (translating allocates)
+    Interpreter interp( TREE );
+    ostream quiet( NULL );
+    defineBuiltins( interp.functions() );
+    interp.evaluate( "deffn shadow fib(n) = n < 2 ? n : fib(n - 1) + fib(n - 2)", quiet );
+    interp.evaluate( "fib(1)", quiet );
+    Integer result = interp.evaluate( "fib(25)", quiet );
+    long allocations = interp.workspace().allocations;
+    nativeThreshold = threshold;
+    if (result != Integer( 75025 ))
+	why << "fib(25) gave " << result;
+    else if (allocations != 0)
+	why << "fib(25) made " << allocations << " heap allocations";
+    return result == Integer( 75025 ) && allocations == 0;
+}
+
+//  columns
+//  A formula evaluated over columns gives, in every row, what it does
+//  evaluated in that row alone:  with a conditional, an assignment,
+//  values too large for an int, and calls whose results are (so that
+//  those rows are walked singly)
+static bool testColumns( ostream &why )
+{
+    static const char *formulas[] =
+    {
+	"a * b - 3 * a + b % 7",
+	"a > b ? a - b : b < 0 ? sq(b) : -b",
+	"(c = a + b) * c - a / 7",
+	"a * 100000 * b",
+	"a % 20 < 10 ? tri(a % 20) : fact(a % 20)"
+    };
+    Interpreter interp( TREE );
+    ostream quiet( NULL );
+    defineBuiltins( interp.functions() );
+    for (const char *d : definitions)
+	interp.evaluate( d, quiet );
+
+    // (more than one block of rows, and a partial one)
+    const int rows = ColumnPlan::Block * 3 + 17;
+    vector<int> a( rows ), b( rows );
+    for (int r = 0; r < rows; r++)
+    {
+	a[r] = r * 37 % 601 - 300;
+	b[r] = r * 53 % 211 - 100;
+    }
+    vector<Integer> out( rows );
+    for (const char *f : formulas)
+    {
+	ColumnExpr columns( f, interp.variables(), interp.functions() );
+	columns.bind( "a", a.data() );
+	columns.bind( "b", b.data() );
+	columns.run( rows, out.data() );
+	vector<string> columnar;
+	for (int r = 0; r < rows; r++)
+	    columnar.push_back( out[r].toString() );
+
+	for (int r = 0; r < rows; r++)
+	{
+	    interp.evaluate( ("a = " + to_string( a[r] )).c_str(), quiet );
+	    interp.evaluate( ("b = " + to_string( b[r] )).c_str(), quiet );
+	    string single = interp.evaluate( f, quiet ).toString();
+	    if (columnar[r] != single)
+	    {
+		why << f << " gave " << columnar[r] << " by columns, but "
+		    << single << " alone, for a = " << a[r] << ", b = " << b[r];
+		return false;
+	    }
+	}
+	if (strstr( f, "fact" ) != NULL && columns.fallbacks == 0)
+	{
+	    why << f << " never walked a row singly";
+	    return false;
+	}
+    }
+    return true;
+}
+
+// Every test, by name
+struct Test
+{
+    const char *name;
+    bool      (*run)( ostream &why );
+};
+static const Test tests[] =
+{
+    { "engines", testEngines },
+    { "mutual", testMutual },
+    { "deep", testDeep },
+    { "redefinition", testRedefinition },
+    { "cache", testCache },
+    { "subexpressions", testSubexpressions },
+    { "literals", testLiterals },
+    { "batch", testBatch },
+    { "snapshots", testSnapshots },
+    { "nesting", testNesting },
+    { "formulas", testFormulas },
+    { "allocations", testAllocations },
+    { "columns", testColumns }
+};
+
+int main( int argc, char *argv[] )
+{
+    int failed = 0;
+    for (const Test &t : tests)
+    {
+	bool chosen = argc == 1;
+	for (int i = 1; i < argc; i++)
+	    chosen = chosen || strcmp( argv[i], t.name ) == 0;
+	if (!chosen)
+	    continue;
+	ostringstream why;
+	if (t.run( why ))
+	    cout << "ok     " << t.name << endl;
+	else
+	{
+	    cout << "FAILED " << t.name << ": " << why.str() << endl;
+	    failed++;
+	}
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -5,11 +5,52 @@
 #include "token.h"
 #include <string>
 
-ostream& operator<<( ostream &stream, Token &t)
+ostream& operator<<( ostream &stream, const Token &t)
 {
     if (t.isNull())
 	return stream << "(null)";
     if (t.isInteger())
 	return stream <<  t.value ;
-    else return stream <<  t.oper ;
+    else return stream <<  string_view( t.text, t.length ) ;
+}
+
+OpKind operKind( string_view s )
+{
+    if (s.length() == 1)
+	switch (s[0])
+	{
+	case '+':	return PLUS;
+	case '-':	return MINUS;
+	case '*':	return TIMES;
+	case '/':	return DIVIDE;
+	case '%':	return MODULO;
+	case '<':	return LESS;
+	case '>':	return GREATER;
+	case '=':	return ASSIGN;
+	case '(':	return LEFT_PAREN;
+	case ')':	return RIGHT_PAREN;
+	case '?':	return QUESTION;
+	case ':':	return COLON;
+	case ',':	return COMMA;
+	}
+    else if (s.length() == 2 && s[1] == '=')
+	switch (s[0])
+	{
+	case '<':	return LESS_EQ;
+	case '>':	return GREATER_EQ;
+	case '=':	return EQUAL;
+	case '!':	return NOT_EQUAL;
+	case ':':	return BIND;
+	}
+    return NO_OP;
+}
+
+const char *operSymbol( OpKind k )
+{
+    static const char *symbols[] = { "",
+	"+", "-", "*", "/", "%",
+	"<=", ">=", "<", ">", "==", "!=",
+	"=",
+	"(", ")", "?", ":", ",", ":=" };
+    return symbols[k];
 }
@@ -1,7 +1,7 @@
 // Token Header file
 // This is for the beginning of an object-oriented string tokenizer
 // to be used for arithmetic expressions.    The tokenizer is an
-// object that returns a linked list of object tokens, which are these.
+// object that returns an array of object tokens, which are these.
 
 // Since lots of files want to know what a token is, there is the
 // danger of redeclaration, which these next couple lines will neutralize.
@@ -13,49 +13,74 @@
 #include <iostream>
 #include <stdlib.h>
 #include <ctype.h>
+#include <string>
+#include <string_view>
+#include "integer.h"
 using namespace std;
 
-// Here is a definition of the token itself:
+// The operators and punctuation recognized by the tokenizer.
+// Every later stage identifies an operator by this kind alone,
+// so that no strings need to be compared after tokenizing.
+enum OpKind
+{
+    NO_OP,			// not an operator (integer or name)
+    PLUS, MINUS, TIMES, DIVIDE, MODULO,
+    LESS_EQ, GREATER_EQ, LESS, GREATER, EQUAL, NOT_EQUAL,
+    ASSIGN,
+    LEFT_PAREN, RIGHT_PAREN, QUESTION, COLON, COMMA,
+    BIND			// := (see formula.h)
+};
+
+// operKind
+// Identify the operator spelled by a string (NO_OP if none)
+OpKind operKind( string_view s );
+
+// operSymbol
+// The spelling of an operator, for display
+const char *operSymbol( OpKind k );
+
+// Here is a definition of the token itself.
+// A token is small and plain, so that a whole expression's worth
+// may be kept in one array.  It does not hold a copy of its text,
+// but only refers to the characters within the source string,
+// which must therefore outlive it.
 class Token
 {
 	//  All the data members are private to keep them protected.
 private:
 	bool    isInt;          // to identify the token type later
-	int     value;          // value for an integer token
-	string    oper;           // character for an operator token
-    string  variable;
+	OpKind  kind;           // which operator, for an operator token
+	Integer value;          // value for an integer token
+	int     length;         // number of characters of text
+	const char *text;       // where the token appears in the source
     
 	//  All of the methods here are public (which is not always the case)
 	//  First, a couple to initialize a new token, either operator or integer
 public:
-	Token(int i)
+	Token(Integer i)
 	{
 		value = i;
 		isInt = true;
-		oper = "";           // initialize unused value
+		kind = NO_OP;
+		text = "";           // initialize unused value
+		length = 0;
 	}
 
-    Token(string v)
+    Token(const char *t, int len)	// a name or an operator
     {
         isInt = false;
-        value = 0;
-        
-        if (!isOper(v))
-        {
-            variable = v;
-            oper = "";
-        }
-        else
-        {
-            variable = "";
-            oper = v;
-        }
+        value = Integer();
+        text = t;
+        length = len;
+        kind = ::operKind(string_view(t, len));
     }
     
 	Token()                 // default constructor
 	{
-		value = 0;
-		oper = "";
+		value = Integer();
+		kind = NO_OP;
+		text = "";
+		length = 0;
 		isInt = false;
 	}
 	//  Here are several accessor methods used to describe
@@ -73,20 +98,9 @@ public:
 
 	bool isNull() const
 	{
-		return !isInt && oper == "" && !isVariable();
+		return !isInt && length == 0;
 	}
 
-    bool isOper(string v) const
-    {
-        if (v != "+" && v != "-" && v != "*" && v != "/" &&
-            v != "%" && v != "<=" && v != ">=" && v != ">" &&
-            v != "<" && v != "==" && v != "!=" && v != "=" &&
-            v != "(" && v != ")" && v != "?" && v != ":" && v!= ",")
-            return false;
-        
-        return true;
-    }
-    
 	bool isInteger() const
 	{
 		return isInt;
@@ -94,30 +108,37 @@ public:
 
     bool isVariable() const
     {
-        if (variable == "")
-            return false;
-        return true;
+        return !isInt && kind == NO_OP && length > 0;
     }
     
-	int integerValue() const
+	Integer integerValue() const
 	{
 		return value;
 	}
 
-    string variableName() const
+    string_view variableName() const
     {
-        return variable;
+        if (!isVariable())
+            return string_view();
+        return string_view(text, length);
     }
     
-	string tokenChar() const
+	string_view tokenChar() const
+	{
+		if (kind == NO_OP)
+			return string_view();
+		return string_view(text, length);
+	}
+
+	OpKind operKind() const
 	{
-		return oper;
+		return kind;
 	}
 
 	//   And some functions will be postponed to an
 	//   implementation file.
 
-	friend ostream& operator <<(ostream& stream, Token &t);
+	friend ostream& operator <<(ostream& stream, const Token &t);
 };
 
 // End of the conditional compilation
@@ -1,142 +1,94 @@
 // Token List Implementation file
 //
 // This tokenizer will scan a character string representing
-// an expression, and will return a list of tokens.
-// --- only integers and operators are supported (no names)
+// an expression, and will fill an array of tokens.
+// Names and operators are not copied -- each token simply
+// records where in the string it was found.
 
 // The standard C library has some useful functions for us
-#include <string>
+#include <string.h>
+#include <new>
 #include <ctype.h>
 // And to get the definition of a token:
 #include "tokenlist.h"
 
 //  output operation
 //  Display all of the tokens in the list
-ostream& operator<<( ostream &stream, TokenList &t )
+ostream& operator<<( ostream &stream, const TokenList &t )
 {
-	ListElement *curr;
-	for (curr = t.head; curr != NULL; curr = curr->next)
-		stream << " " << curr->token;
+	for (const Token *curr = t.begin(); curr != t.end(); curr++)
+		stream << " " << *curr;
 	return stream;
 }
 
+//  There is room for just one token before the first,
+//  for an implicit operand supplied by the caller
 void TokenList::push_front( Token t )
 {
-	ListElement *newNode = new ListElement;
-	newNode->token = t;
-	newNode->next = head;
-	if (head == NULL)
-		head = tail = newNode;
-	else
-		head = newNode;
+	tokens[--first] = t;
 }
 
 void TokenList::push_back( Token t )
 {
-    ListElement *newNode = new ListElement;
-    newNode->token = t;
-	newNode->next = NULL;
-	if (head == NULL)
-		head = tail = newNode;
-	else
-	{
-		tail->next = newNode;
-		tail = newNode;
-	}
+	tokens[last++] = t;
+	tokens[last] = Token();		// keep the null token at the end
 }
 
+//  Every token uses at least one character, so the number of
+//  characters bounds the number of tokens.  One extra is set
+//  aside at the front (see push_front) and one at the end.
+//  The array is not initialized, since tokens are plain data
+//  that are only ever read after being stored.
 TokenList::TokenList( const char str[] )
 {
-    int total = 0;
-    
-    head = NULL;
-    tail = NULL;
-    
+    tokens = (Token *) ::operator new( (strlen(str) + 2) * sizeof(Token) );
+    first = last = 1;
+
     for (int i = 0; str[i] != '\0'; i++)
     {
         if (!isspace(str[i]))
         {
 			if (isdigit(str[i]))
 			{
+				int start = i;
 				while (isdigit(str[i]))
-				{
-					total = 10 * total + str[i] - '0';
 					i++;
-				}
-				push_back(Token(total));
-                total = 0;
+				push_back(Token(Integer::parse(str + start, i - start)));
                 i--;
 			}
             else if (isalpha(str[i]))
             {
-                string temp_name;
+                int start = i;
                 while (isalpha(str[i]) || isdigit(str[i]))
-                {
-                    temp_name.push_back(str[i]);
                     i++;
-                }
-                push_back(Token(temp_name));
+                push_back(Token(str + start, i - start));
                 i--;
             }
             else
             {
-                string temp_name;
-                temp_name.push_back(str[i]);
-                if (str[i] != ')')
-                {
+                int start = i;
+                if (str[i] != ')' && str[i + 1] == '=')
                     i++;
-                    if (str[i] == '=')
-                        temp_name.push_back(str[i]);
-                    else
-                        i--;
-                }
-                push_back(Token(temp_name));
+                push_back(Token(str + start, i - start + 1));
             }
         }
     }
+    tokens[last] = Token();
 }
 
-void TokenList::removeHead()
-{
-	ListElement *remove = head;
-	if (head->next != NULL)
-		current = head = head->next;
-	else
-		current = head = NULL;
-	delete remove;
-}
-
-
 void TokenList::print()
 {
-	ListIterator l = begin();
-	while (l != end())
+	for (const Token *l = begin(); l != end(); l++)
 	{
-		if (l.token().isInteger())
-			cout << l.token().integerValue() << " ";
+		if (l->isInteger())
+			cout << l->integerValue() << " ";
 		else
         {
-            if (l.token().isVariable())
-                cout << l.token().variableName() << " ";
+            if (l->isVariable())
+                cout << l->variableName() << " ";
             else
-                cout << l.token().tokenChar() << " ";
+                cout << l->tokenChar() << " ";
         }
-		l.advance();
 	}
 	cout << endl;
 }
-
-// Here follow a couple extra functions to add into
-// the TokenList implementation file to support iterators.
-
-//  Creates an iterator to refer to the beginning of the list
-ListIterator TokenList::begin()
-{
-	return ListIterator(this, &head);
-}
-
-//  Creates an iterator to refer after the end of the list
-ListIterator TokenList::end()
-{
-	return ListIterator(this, &tail->next);
-}
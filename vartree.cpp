@@ -1,111 +1,181 @@
 // Variable Tree Implementation File
-// This is a simple binary search tree associating variables
-// with integer values.
+// This is a hash table associating variables with Integer values.
+// The table holds only ids; the names themselves are compared
+// only when the full hash values match.
 #include <iostream>
 #include <string>
+#include <algorithm>
 #include "vartree.h"
 using namespace std;
 
-//  recursiveAssign
-//  A recursive tree-traversal function to assign to a variable.
-//  Parameters:
-//  	node	(modified TreeNode ptr)	tree to insert into
-//  	name	(input string)		name of variable
-//  	value	(input integer)		value to assign
-//  NOTE: node May be a null pointer, indicating an empty tree
-void VarTree::recursiveAssign( TreeNode *&root, string name, int value )
+const unsigned FirstSize = 16;		// slots in a new table
+
+VarTree::VarTree()
+{
+    mask = FirstSize - 1;
+    table = new int[FirstSize]();
+}
+
+VarTree::VarTree( VarTree &&other )
+    : names( move( other.names ) ), hashes( move( other.hashes ) ),
+      values( move( other.values ) ), kept( move( other.kept ) )
+{
+    table = other.table;
+    mask = other.mask;
+    other.table = new int[FirstSize]();	// leave the other one empty
+    other.mask = FirstSize - 1;
+}
+
+VarTree::~VarTree()
+{
+    for (unsigned id = 0; id < kept.size(); id++)
+        kept[id].discard();
+    delete [] table;
+}
+
+//  hash
+//  Compute a hash value for a name (FNV-1a)
+unsigned VarTree::hash( const string &name )
+{
+    unsigned h = 2166136261u;
+    for (unsigned i = 0; i < name.length(); i++)
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+    return h;
+}
+
+//  grow
+//  Double the number of slots, keeping at most half of them in use
+void VarTree::grow()
 {
-    if (root != NULL)
+    delete [] table;
+    mask = 2 * mask + 1;
+    table = new int[mask + 1]();
+    for (unsigned id = 0; id < names.size(); id++)
     {
-        if (name.compare(root->name) == 0)
-            root->value = value;
-        else if (name.compare(root->name) < 0)
-            recursiveAssign(root->left, name, value);
-        else
-            recursiveAssign(root->right, name, value);
+        unsigned slot = hashes[id] & mask;
+        while (table[slot] != 0)
+            slot = (slot + 1) & mask;
+        table[slot] = id + 1;
     }
-    else
-        root = new TreeNode(name, value);
 }
 
-//  assign
-//  Assigns a value to a variable.
-//  If the variable does not yet exist, it is created.
+//  find
+//  Searches for the id of a variable
 //  Parameters:
 //  	name	(input string)		name of variable
-//  	value	(input integer)		value to assign
-void VarTree::assign( string name, int value )
+//  Returns:				its id, or -1 if there is none
+int VarTree::find( const string &name ) const
 {
-    recursiveAssign( root, name, value );
+    unsigned h = hash( name );
+    for (unsigned slot = h & mask; table[slot] != 0; slot = (slot + 1) & mask)
+    {
+        int id = table[slot] - 1;
+        if (hashes[id] == h && names[id] == name)
+            return id;
+    }
+    return -1;
 }
 
-//  recursiveLookup
-//  A recursive tree-traversal function to search for a variable.
-//  If the variable does not exist, it is created with a value of 0.
+//  intern
+//  Searches for the id of a variable
+//  If the variable does not yet exist, it is created with a value of 0.
 //  Parameters:
-//  	node	(modified TreeNode ptr)	tree to insert into
 //  	name	(input string)		name of variable
-//  	value	(output integer)	value of variable
-//  NOTE: node May be a null pointer, indicating an empty tree
-void VarTree::recursiveLookup( TreeNode *&root, string name, int &value )
+//  Returns:				its id
+int VarTree::intern( const string &name )
 {
-    if (root == NULL)
-        root = new TreeNode(name, value = 0);
-    else
+    unsigned h = hash( name );
+    unsigned slot;
+    for (slot = h & mask; table[slot] != 0; slot = (slot + 1) & mask)
     {
-        if (name.compare(root->name) == 0)
-            value = root->value;
-        else if (name.compare(root->name) < 0)
-            recursiveLookup(root->left, name, value);
-        else
-            recursiveLookup(root->right, name, value);
+        int id = table[slot] - 1;
+        if (hashes[id] == h && names[id] == name)
+            return id;
     }
+
+    names.push_back( name );
+    hashes.push_back( h );
+    values.push_back( Integer() );
+    kept.push_back( Integer() );
+    table[slot] = names.size();
+    if (2 * names.size() > mask + 1)
+        grow();
+    return names.size() - 1;
+}
+
+//  assign
+//  Assigns a value to a variable.
+//  If the variable does not yet exist, it is created.
+//  Parameters:
+//  	name	(input string)		name of variable
+//  	value	(input Integer)		value to assign
+void VarTree::assign( const string &name, Integer value )
+{
+    values[intern( name )] = value;
+    settle();
 }
 
 //  lookup
 //  Searches for a variable to get its value
 //  If the variable does not yet exist, it is created.
 //  Parameters:
-//  	name	(input char array)	name of variable
+//  	name	(input string)		name of variable
 //  Returns:				value of variable
-int VarTree::lookup( string name )
+Integer VarTree::lookup( const string &name )
+{
+    return values[intern( name )];
+}
+
+//  reset
+//  Return every variable to the value it would have if it
+//  had never been assigned, without releasing any storage.
+void VarTree::reset()
+{
+    for (unsigned id = 0; id < kept.size(); id++)
+        kept[id].discard();
+    fill( values.begin(), values.end(), Integer() );
+    fill( kept.begin(), kept.end(), Integer() );
+}
+
+//  settle
+//  Any variable whose value is not the copy kept for it has
+//  changed since the last time:  the old copy is discarded,
+//  and a large new value is copied to be kept instead
+void VarTree::settle()
 {
-    int value;
-    recursiveLookup( root, name, value );
-    return value;
+    for (unsigned id = 0; id < values.size(); id++)
+        settle( id );
 }
 
+void VarTree::settle( int id )
+{
+    if (!values[id].identical( kept[id] ))
+    {
+        kept[id].discard();
+        kept[id] = values[id].keep();
+        values[id] = kept[id];
+    }
+}
+
+//  The listing is in order by name, which the table does not
+//  keep, so the ids are sorted just for the occasion
 ostream& operator<<(ostream& os, VarTree &vars)
 {
     os << "\n\nThe variables you inserted are as the following: \n\n";
-    
-    if (vars.root == NULL)
+
+    // names beginning with # are temporaries (see cse.h)
+    vector<int> order;
+    for (unsigned id = 0; id < vars.names.size(); id++)
+        if (vars.names[id][0] != '#')
+            order.push_back( id );
+    if (order.empty())
         os << "None\n";
     else
     {
-        stack<TreeNode*> s;
-        TreeNode *current = vars.root;
-        bool done = false;
-        while (!done)
-        {
-            if (current)
-            {
-                s.push(current);
-                current = current->left;
-            }
-            else
-            {
-                if (s.empty())
-                    done = true;
-                else
-                {
-                    current = s.top();
-                    s.pop();
-                    os << current->name << " = " << current->value << endl;
-                    current = current->right;
-                }
-            }
-        }
+        sort( order.begin(), order.end(), [&vars]( int a, int b )
+              { return vars.names[a] < vars.names[b]; } );
+        for (unsigned i = 0; i < order.size(); i++)
+            os << vars.names[order[i]] << " = " << vars.values[order[i]] << endl;
     }
     return os;
 }
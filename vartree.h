@@ -1,58 +1,71 @@
 // Variable Tree Header File
-// A symbol table for variables will be represented here with 
-// a binary tree, associating variable names with integer variables.
-// The exterior interface will do nothing but assign to variables
-// and look up their values, so the only purpose in having the
-// structure definition here is to enable access to the overall tree.
+// A symbol table for variables, associating variable names with
+// integer variables.  (It was once a binary tree, hence the name.)
+//
+// Each name is interned when first seen:  it is given a small
+// integer id, which never changes, and its value is kept in an
+// array indexed by that id.  An open-addressing hash table maps
+// names to ids, so a lookup takes constant expected time no matter
+// what order the variables were created in.
+//
+// A variable may hold a large Integer only briefly made (see
+// integer.h); settle() gives the table its own copy of any such
+// value, which it discards when the variable changes again.  Where
+// it is known which variables may have changed, settling only those
+// saves looking at all the others.
 #ifndef VARTREE
 #define VARTREE
 
 #include <iostream>
 #include <string>
-#include <stack>
+#include <vector>
+#include "integer.h"
 using namespace std;
 
-class VarTree;
-
-// A node anywhere in tree
-class TreeNode
+class VarTree
 {
-    friend class VarTree;
     private:
-	string	name;		// variable name
-	int	value;		// variable value
-	TreeNode *left,		// sub-tree for less than
-		 *right;	// sub-tree for greater than
+	vector<string>	 names;		// name of each variable, by id
+	vector<unsigned> hashes;	// hash of each name, by id
+	vector<Integer>	 values;	// value of each variable, by id
+	vector<Integer>	 kept;		// the copy owned for each, by id
+	int	*table;			// id + 1 for each slot, 0 if empty
+	unsigned mask;			// number of slots, less one
 
-	// Private constructor: only for use by VarTree
-	TreeNode( string newName , int val )
-	{
-	    name.assign( newName );	// get the name
-	    value = val;		// and the value
-	    left = right = NULL;	// no children
-	}
-    
+	static unsigned hash( const string &name );
+	void grow();
     public:
-    friend ostream& operator<<(ostream& os, VarTree &vars);
-};
+        VarTree();
+	VarTree( VarTree &&other );	// take over another table
+	VarTree( const VarTree & ) = delete;	// the table has only one owner
+	~VarTree();
 
-// And a mechanism to store and retrieve entries in the tree.
-class VarTree
-{
-    private:
-	TreeNode *root;
-    public:
-        VarTree()
+	int intern( const string &name );	// id for a name, creating it
+	int find( const string &name ) const;	// id for a name, or -1
+	void assign( const string &name, Integer value );
+	Integer lookup( const string &name );
+	void reset();		// set every variable back to 0
+	void settle();		// keep copies of any values just made
+	void settle( int id );	// (of just one variable)
+
+	int size() const	// number of variables
 	{
-	    root = NULL;	// empty tree
+	    return names.size();
 	}
-	void assign( string, int );
-	int lookup( string );
+	const string &name( int id ) const
+	{
+	    return names[id];
+	}
+	Integer &value( int id )	// the variable with the given id
+	{
+	    return values[id];
+	}
+	Integer *slots()		// all the variables, indexed by id
+	{
+	    return values.data();
+	}
+
     friend ostream& operator<<(ostream& os, VarTree &vars);
-    
-    private:		// these just help VarTree do its job
-	void recursiveAssign( TreeNode *&, string, int );
-	void recursiveLookup( TreeNode *&, string, int & );
 };
 
 #endif